@@ -1,182 +1,585 @@
 /* File:    mpi_array_precision.c
  *
- * Author:    Mark Marnell  
- *     
+ * Author:    Mark Marnell
+ *
  *
  * Purpose: DAXPY- "Double precision Alpha X Plus Y."
- *           Reads in 2 arrays, multiplies each element of one 
- *           by alpha and then adds it to the second array
- *           
- *       
+ *           Precision study:  run y = alpha*x + y and the dot product
+ *           x.y with x and y stored as float, double or bf16 and the
+ *           arithmetic done in a wider (or the same) type, and report
+ *           the throughput and the error of each against a high-
+ *           precision reference, so the cheapest precision that is
+ *           still accurate enough can be picked for a workload.
+ *
  *
  * Input:
- *     n: order
- *     y, x: the matrix and the vector to be multiplied
+ *     none:  x and y are generated (see note 3)
  *
  * Output:
- *     y: the product vector
+ *     A comment line with n, thread_count, reps, alpha and the kernels
+ *     used, then one CSV line per variant:
+ *        variant,bytes,axpy_GB_per_s,axpy_Melem_per_s,dot_GB_per_s,
+ *        axpy_rel_err,dot_rel_err
  *
- * Compile:  gcc -g -Wall -o mpi_array_precision mpi_array_precision.c -lpthread
+ * Compile:  gcc -g -Wall -O2 -o mpi_array_precision mpi_array_precision.c -lpthread -lm
  * Usage:
- *     homework9.c  <thread_count>
+ *     mpi_array_precision [-r reps] [-a alpha] [-v variant] <thread_count> <n>
+ *        reps:     times each kernel is run (default 10)
+ *        alpha:    default 0.1
+ *        variant:  run only this variant (default all of them)
  *
- * Notes:  
+ * Notes:
  *     1.  Local storage for x, y is dynamically allocated.
- *     2.  Number of threads (thread_count) should evenly divide both 
- *         m and n.  The program doesn't check for this.
- *     3.  We use a 1-dimensional array for A and compute subscripts
- *         using the formula A[i][j] = A[i*n + j]
- *     4.  Distribution of x, and y is logical:  all three are 
+ *     2.  Number of threads (thread_count) doesn't need to divide n.
+ *     3.  x and y are filled with drand48 values in [-1, 1) from a
+ *         fixed seed, so every run and every variant starts from the
+ *         same doubles.  Each variant rounds them to its storage type,
+ *         so the errors include the cost of storing the inputs.
+ *     4.  Distribution of x, and y is logical:  all three are
  *         globally shared.
+ *     5.  x and y start on a cache line, and each thread gets one
+ *         contiguous block of whole cache lines (see Thread_range),
+ *         so no two threads write to the same line of y.  The first
+ *         (lines % thread_count) threads get one extra line, and the
+ *         last block stops at n.
+ *     6.  A variant is <storage>_<accumulator>.  VARIANT_LIST is
+ *         expanded by DEFINE_VARIANT into a scalar, an AVX2/FMA and
+ *         an AVX-512 copy of Axpy_<name> and Dot_<name>, each
+ *         specialized for its two types at compile time;  the best
+ *         copy the CPU supports is used.  To add a variant, add a
+ *         line to VARIANT_LIST.
+ *     7.  Axpy_<name> loads x[i] and y[i], computes alpha*x[i] + y[i]
+ *         in the accumulator type (alpha is rounded to it first) and
+ *         rounds the result back to the storage type, reps times, so
+ *         the storage rounding errors build up the way they do in an
+ *         iteration.  Dot_<name> keeps DOT_LANES partial sums in the
+ *         accumulator type;  the threads' sums are added in rank order.
+ *         The dot product is computed on the starting x and y.
+ *     8.  bf16 keeps the sign, the 8 exponent bits and the top 7
+ *         fraction bits of a float;  Float_to_bf16 rounds to nearest
+ *         even.  A double result is rounded to float and then to bf16.
+ *     9.  The reference is y0 + reps*alpha*x0 in long double, and the
+ *         dot product of the starting doubles in __float128 (long
+ *         double if the compiler has no __float128).  axpy_rel_err is
+ *         ||y - y_ref||_2/||y_ref||_2.  dot_rel_err is
+ *         |dot - dot_ref|/sum |x0[i]*y0[i]|, so cancellation in the
+ *         data doesn't inflate it.
+ *    10.  Throughput counts the bytes of x and y each kernel has to
+ *         move:  3 stored elements per Axpy element, 2 per Dot element.
+ *         Times are for all reps, between barriers, and don't include
+ *         creating the threads.
  *
 */
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <time.h>
+#include <math.h>
 #include <pthread.h>
 
-const int MAX_THREADS = 64;
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#  define HAVE_X86_SIMD
+#endif
+
+#define CACHE_LINE 64
+#define DOT_LANES  16     /* partial sums in a Dot kernel             */
+#define AXPY_LANES 16     /* elements per iteration of an Axpy kernel */
+#define MAX_THREADS 64
+
+/* Kernel levels:  index into the axpy and dot arrays of a variant */
+#define LEVEL_REF    0
+#define LEVEL_AVX2   1
+#define LEVEL_AVX512 2
+
+#ifdef __SIZEOF_FLOAT128__
+typedef __float128  ref_t;
+#else
+typedef long double ref_t;
+#endif
+
+typedef void   (*Axpy_t)(int count, double alpha, const void* x, void* y);
+typedef double (*Dot_t)(int count, const void* x, const void* y);
+
+typedef struct {
+   const char* name;
+   int         size;                    /* bytes per stored element */
+   void      (*from_double)(int count, const double in[], void* out);
+   void      (*to_double)(int count, const void* in, double out[]);
+   Axpy_t      axpy[3];                 /* indexed by LEVEL_*       */
+   Dot_t       dot[3];
+} variant_t;
+
+typedef struct {
+   double val;
+   char   pad[CACHE_LINE - sizeof(double)];
+} padded_sum_t;
 
 /* Global variables */
 int     thread_count;
 int     n;
-double alpha;
-double* x;
-double* y;
+int     reps = 10;
+double alpha = 0.1;
+int     level;                 /* set by Select_level */
+const variant_t* Cur;          /* the variant being timed */
+void*   xs;                    /* x and y in Cur's storage type */
+void*   ys;
+pthread_barrier_t Barrier;
+padded_sum_t Partial[MAX_THREADS] __attribute__((aligned(CACHE_LINE)));
+double  Axpy_time, Dot_time;   /* set by thread 0 of Study */
 
 /* Serial functions */
 void Usage(char* prog_name);
-void Read_vector(char* prompt, double x[], int n);
-void Print_vector(char* title, double y[], double m);
+void* Alloc_vector(int n, int size);
+void Fill_vector(double x[], int n);
+int Select_level(void);
+double Wtime(void);
+void Run_variant(const variant_t* v, const double x0[], const double y0[],
+      double y[], ref_t dot_ref, double dot_scale);
+ref_t Dot_reference(const double x0[], const double y0[], double* scale_p);
+double Axpy_error(const double x0[], const double y0[], const double y[]);
 
 /* Parallel function */
-void *Daxpy(void* rank);
+void *Study(void* rank);
+void Thread_range(long my_rank, int line_elems, int* first_p, int* last_p);
 
-/*------------------------------------------------------------------*/
+/*------------------------------------------------------------------
+ * Function:  Float_to_bf16
+ * Purpose:   Round a float to the nearest bf16, ties to even
+ * In arg:    x
+ * Ret val:   The bf16 bits
+ */
+static inline uint16_t Float_to_bf16(float x) {
+   uint32_t u, rounded, nan;
 
+   memcpy(&u, &x, sizeof(u));
+   rounded = (u + 0x7fff + ((u >> 16) & 1)) >> 16;
+   /* NaN:  keep it quiet.  A mask, not a branch, so the kernels */
+   /* vectorize                                                  */
+   nan = -(uint32_t) ((u & 0x7fffffff) > 0x7f800000);
+   return (uint16_t) ((rounded & ~nan) | (((u >> 16) | 0x40) & nan));
+}  /* Float_to_bf16 */
 
-int main(int argc, char* argv[]) {
-   long       thread;
-   pthread_t* thread_handles;
+/*------------------------------------------------------------------
+ * Function:  Bf16_to_float
+ * Purpose:   Widen a bf16 to a float (exact)
+ * In arg:    h
+ * Ret val:   The float
+ */
+static inline float Bf16_to_float(uint16_t h) {
+   uint32_t u = (uint32_t) h << 16;
+   float    x;
+
+   memcpy(&x, &u, sizeof(x));
+   return x;
+}  /* Bf16_to_float */
+
+/* Loading and storing each storage type:  WIDEN_<tag> gives a value */
+/* the accumulator can take, NARROW_<tag> rounds one back            */
+#define WIDEN_F32(v)   (v)
+#define NARROW_F32(v)  ((float) (v))
+#define WIDEN_F64(v)   (v)
+#define NARROW_F64(v)  ((double) (v))
+#define WIDEN_BF16(v)  Bf16_to_float(v)
+#define NARROW_BF16(v) Float_to_bf16((float) (v))
+
+/* name, storage type, its tag, and accumulator type of each variant */
+#define VARIANT_LIST(X)                         \
+   X(f32_f32,  float,    F32,  float)           \
+   X(f32_f64,  float,    F32,  double)          \
+   X(f64_f64,  double,   F64,  double)          \
+   X(f64_f80,  double,   F64,  long double)     \
+   X(bf16_f32, uint16_t, BF16, float)           \
+   X(bf16_f64, uint16_t, BF16, double)
+
+/* Body of Axpy_<name>:  y[i] = alpha*x[i] + y[i] in atype, stored as */
+/* stype.  The inner loop over AXPY_LANES is what gets vectorized.    */
+/* x and y are restrict parameters of an inline Axpy_loop_<name>:     */
+/* gcc ignores restrict on local pointers, and without it the loop    */
+/* isn't vectorized.                                                  */
+#define AXPY_BODY(stype, tag, atype)                                    \
+   atype a = alpha;                                                     \
+   int i, j;                                                            \
+                                                                        \
+   for (i = 0; i + AXPY_LANES <= count; i += AXPY_LANES)                \
+      for (j = 0; j < AXPY_LANES; j++)                                  \
+         y[i + j] = NARROW_##tag(a*(atype) WIDEN_##tag(x[i + j])        \
+               + (atype) WIDEN_##tag(y[i + j]));                        \
+   for (; i < count; i++)                                               \
+      y[i] = NARROW_##tag(a*(atype) WIDEN_##tag(x[i])                   \
+            + (atype) WIDEN_##tag(y[i]));
+
+/* Body of Dot_<name>:  DOT_LANES partial sums of x[i]*y[i] in atype */
+#define DOT_BODY(stype, tag, atype)                                     \
+   const stype* restrict x = xv;                                        \
+   const stype* restrict y = yv;                                        \
+   atype sum[DOT_LANES] = {0}, total = 0;                               \
+   int i, j;                                                            \
+                                                                        \
+   for (i = 0; i + DOT_LANES <= count; i += DOT_LANES)                  \
+      for (j = 0; j < DOT_LANES; j++)                                   \
+         sum[j] += (atype) WIDEN_##tag(x[i + j])                        \
+               *(atype) WIDEN_##tag(y[i + j]);                          \
+   for (; i < count; i++)                                               \
+      sum[0] += (atype) WIDEN_##tag(x[i])*(atype) WIDEN_##tag(y[i]);    \
+   for (j = 0; j < DOT_LANES; j++)                                      \
+      total += sum[j];                                                  \
+   return (double) total;
+
+/* One copy of Axpy_<name> and Dot_<name> for a target */
+#define DEFINE_KERNELS(name, stype, tag, atype, suffix, ...)            \
+   __VA_ARGS__                                                          \
+   static inline void Axpy_loop_##name##suffix(int count, double alpha, \
+         const stype* restrict x, stype* restrict y) {                  \
+      AXPY_BODY(stype, tag, atype)                                      \
+   }                                                                    \
+   __VA_ARGS__                                                          \
+   static void Axpy_##name##suffix(int count, double alpha,             \
+         const void* xv, void* yv) {                                    \
+      Axpy_loop_##name##suffix(count, alpha, xv, yv);                   \
+   }                                                                    \
+   __VA_ARGS__                                                          \
+   static double Dot_##name##suffix(int count, const void* xv,          \
+         const void* yv) {                                              \
+      DOT_BODY(stype, tag, atype)                                       \
+   }
 
-   if (argc != 2) Usage(argv[0]);
-   // error checks thread count
+#ifdef HAVE_X86_SIMD
+#  define DEFINE_SIMD_KERNELS(name, stype, tag, atype)                  \
+   DEFINE_KERNELS(name, stype, tag, atype, _avx2,                       \
+         __attribute__((target("avx2,fma"))))                           \
+   DEFINE_KERNELS(name, stype, tag, atype, _avx512,                     \
+         __attribute__((target("avx512f"))))
+#  define KERNEL_ENTRY(name)                                            \
+   {Axpy_##name##_ref, Axpy_##name##_avx2, Axpy_##name##_avx512},       \
+   {Dot_##name##_ref, Dot_##name##_avx2, Dot_##name##_avx512}
+#else
+#  define DEFINE_SIMD_KERNELS(name, stype, tag, atype)
+#  define KERNEL_ENTRY(name)                                            \
+   {Axpy_##name##_ref, Axpy_##name##_ref, Axpy_##name##_ref},           \
+   {Dot_##name##_ref, Dot_##name##_ref, Dot_##name##_ref}
+#endif
+
+/* The kernels and the conversions to and from double of a variant */
+#define DEFINE_VARIANT(name, stype, tag, atype)                         \
+   DEFINE_KERNELS(name, stype, tag, atype, _ref)                        \
+   DEFINE_SIMD_KERNELS(name, stype, tag, atype)                         \
+   static void From_double_##name(int count, const double in[],         \
+         void* out) {                                                   \
+      stype* o = out;                                                   \
+      int i;                                                            \
+      for (i = 0; i < count; i++)                                       \
+         o[i] = NARROW_##tag(in[i]);                                    \
+   }                                                                    \
+   static void To_double_##name(int count, const void* in,              \
+         double out[]) {                                                \
+      const stype* v = in;                                              \
+      int i;                                                            \
+      for (i = 0; i < count; i++)                                       \
+         out[i] = WIDEN_##tag(v[i]);                                    \
+   }
 
-   thread_count = atoi(argv[1]);
+#define VARIANT_ENTRY(name, stype, tag, atype)                          \
+   {#name, sizeof(stype), From_double_##name, To_double_##name,         \
+      KERNEL_ENTRY(name)},
 
-   // error checks thread count
-   if (thread_count <= 0 || thread_count > MAX_THREADS) Usage(argv[0]);
+VARIANT_LIST(DEFINE_VARIANT)
+
+const variant_t Variants[] = {
+   VARIANT_LIST(VARIANT_ENTRY)
+};
+#define N_VARIANTS ((int) (sizeof(Variants)/sizeof(Variants[0])))
+
+/*------------------------------------------------------------------*/
 
-   thread_handles = malloc(thread_count*sizeof(pthread_t));
 
-   //asks for the dimensions of the arrays
-   printf("Enter n: \n");
-   scanf("%d", &n);
+int main(int argc, char* argv[]) {
+   int     c, v, found = 0;
+   char*   only = NULL;
+   double* x0;
+   double* y0;
+   double* y;
+   double  dot_scale;
+   ref_t   dot_ref;
+   const char* level_names[] = {"ref", "avx2", "avx512"};
+
+   while ((c = getopt(argc, argv, "r:a:v:")) != -1) {
+      switch (c) {
+         case 'r':
+            reps = strtol(optarg, NULL, 10);
+            if (reps <= 0) Usage(argv[0]);
+            break;
+         case 'a':
+            alpha = strtod(optarg, NULL);
+            break;
+         case 'v':
+            only = optarg;
+            break;
+         default:
+            Usage(argv[0]);
+      }
+   }
+   if (argc - optind != 2) Usage(argv[0]);
+   // error checks thread count
 
+   thread_count = atoi(argv[optind]);
+   n = atoi(argv[optind + 1]);
 
-  //allocates storage for arrays
-   x = malloc(n*sizeof(double));
-   y = malloc(n*sizeof(double));
+   // error checks thread count
+   if (thread_count <= 0 || thread_count > MAX_THREADS) Usage(argv[0]);
+   if (n <= 0) Usage(argv[0]);
+
+   //allocates storage for arrays
+   x0 = Alloc_vector(n, sizeof(double));
+   y0 = Alloc_vector(n, sizeof(double));
+   y = Alloc_vector(n, sizeof(double));
+   xs = Alloc_vector(n, sizeof(double));
+   ys = Alloc_vector(n, sizeof(double));
+   level = Select_level();
+   pthread_barrier_init(&Barrier, NULL, thread_count);
+
+   for (v = 0; v < N_VARIANTS; v++)
+      if (only == NULL || strcmp(only, Variants[v].name) == 0)
+         found = 1;
+   if (!found) {
+      fprintf(stderr, "Unknown variant %s.  The variants are", only);
+      for (v = 0; v < N_VARIANTS; v++)
+         fprintf(stderr, " %s", Variants[v].name);
+      fprintf(stderr, "\n");
+      Usage(argv[0]);
+   }
 
+   srand48(1);
+   Fill_vector(x0, n);
+   Fill_vector(y0, n);
+   dot_ref = Dot_reference(x0, y0, &dot_scale);
 
+   printf("# n = %d, thread_count = %d, reps = %d, alpha = %g, "
+         "kernels = %s\n", n, thread_count, reps, alpha,
+         level_names[level]);
+   printf("variant,bytes,axpy_GB_per_s,axpy_Melem_per_s,dot_GB_per_s,"
+         "axpy_rel_err,dot_rel_err\n");
+   for (v = 0; v < N_VARIANTS; v++)
+      if (only == NULL || strcmp(only, Variants[v].name) == 0)
+         Run_variant(&Variants[v], x0, y0, y, dot_ref, dot_scale);
 
-   // Reads and prints first array
-   Read_vector("Enter the x array: ", x, n);
-   Print_vector("We read", x, n);
+   //Frees the allocated memory
+   pthread_barrier_destroy(&Barrier);
+   free(x0);
+   free(y0);
+   free(y);
+   free(xs);
+   free(ys);
 
-   //Reads and prints second array
-   Read_vector("Enter the y array: ", y, n);
-   Print_vector("We read", y, n);
+   return 0;
+}  /* main */
 
-   //Reads in alpha
-   printf("Enter Alpha: \n");
-   scanf("%lf", &alpha);
+/*------------------------------------------------------------------
+ * Function:  Run_variant
+ * Purpose:   Time Dot and Axpy for one variant on the threads and
+ *            print its CSV line
+ * In args:   v, x0, y0:  the starting doubles
+ *            dot_ref, dot_scale:  from Dot_reference
+ * Scratch:   y:  n doubles
+ * Globals:   Cur, xs, ys, Axpy_time, Dot_time, Partial
+ */
+void Run_variant(const variant_t* v, const double x0[], const double y0[],
+      double y[], ref_t dot_ref, double dot_scale) {
+   long       thread;
+   pthread_t  thread_handles[MAX_THREADS];
+   double     dot = 0.0, axpy_err, dot_err;
 
+   Cur = v;
+   v->from_double(n, x0, xs);
+   v->from_double(n, y0, ys);
 
-   //Creates threads and passes Daxpy function 
+   //Creates threads and passes Study function
    for (thread = 0; thread < thread_count; thread++)
       pthread_create(&thread_handles[thread], NULL,
-         Daxpy, (void*) thread);
+         Study, (void*) thread);
 
    //Gathers threads
    for (thread = 0; thread < thread_count; thread++)
       pthread_join(thread_handles[thread], NULL);
 
-   //Prints the solution
-   Print_vector("The product is", y, n);
-
-
-   //Frees the allocated memory
-   free(x);
-   free(y);
-   free(thread_handles);
-
-   return 0;
-}  /* main */
-
-
+   for (thread = 0; thread < thread_count; thread++)
+      dot += Partial[thread].val;
+   dot_err = (double) fabsl((long double) ((ref_t) dot - dot_ref))
+         /dot_scale;
+   v->to_double(n, ys, y);
+   axpy_err = Axpy_error(x0, y0, y);
 
+   printf("%s,%d,%.3f,%.1f,%.3f,%.3e,%.3e\n", v->name, v->size,
+         3.0*v->size*n*reps/Axpy_time/1.0e9, 1.0*n*reps/Axpy_time/1.0e6,
+         2.0*v->size*n*reps/Dot_time/1.0e9, axpy_err, dot_err);
+}  /* Run_variant */
 
 /*------------------------------------------------------------------
- * Function:       Daxpy
- * Purpose:        Multiply one array by alpha and add
- *                 it to the second array
+ * Function:       Study
+ * Purpose:        Run reps Dots and then reps Axpys of the current
+ *                 variant on this thread's block
  * In arg:         rank
- * Global in vars: alpha, x, n, thread_count
- * Global out var: y
+ * Global in vars: Cur, level, alpha, n, reps, xs, thread_count
+ * Global out var: ys, Partial[rank], and in thread 0 Dot_time and
+ *                 Axpy_time
  */
-void *Daxpy(void* rank) {
+void *Study(void* rank) {
    long my_rank = (long) rank;
-   int i;
-   int local_n = n/thread_count; 
-   int my_first_row = my_rank*local_n;
+   int my_first, my_last, r;
+   int size = Cur->size;
+   const char* x;
+   char* y;
+   double start = 0.0;
+
+   Thread_range(my_rank, CACHE_LINE/size, &my_first, &my_last);
+   x = (const char*) xs + (size_t) my_first*size;
+   y = (char*) ys + (size_t) my_first*size;
+
+   pthread_barrier_wait(&Barrier);
+   if (my_rank == 0) start = Wtime();
+   for (r = 0; r < reps; r++) {
+      Partial[my_rank].val = Cur->dot[level](my_last - my_first, x, y);
+      pthread_barrier_wait(&Barrier);
+   }
+   if (my_rank == 0) {
+      Dot_time = Wtime() - start;
+      start = Wtime();
+   }
+   for (r = 0; r < reps; r++) {
+      Cur->axpy[level](my_last - my_first, alpha, x, y);
+      pthread_barrier_wait(&Barrier);
+   }
+   if (my_rank == 0) Axpy_time = Wtime() - start;
 
+   return NULL;
+}  /*  Study */
 
-   for (i = my_first_row; i <= n; i = i +0) {
-           y[i] += alpha*x[i];
+/*------------------------------------------------------------------
+ * Function:       Thread_range
+ * Purpose:        Find the block of x and y for a thread:  whole
+ *                 cache lines, with the first lines % thread_count
+ *                 threads getting one extra line
+ * In arg:         my_rank, line_elems:  elements per cache line
+ * Global in vars: n, thread_count
+ * Out args:       first_p, last_p:  the thread does my_first <= i <
+ *                 my_last
+ */
+void Thread_range(long my_rank, int line_elems, int* first_p, int* last_p) {
+   long lines = (n + line_elems - 1)/line_elems;
+   long quotient = lines/thread_count;
+   long remainder = lines % thread_count;
+   long first_line, my_lines;
+
+   if (my_rank < remainder) {
+      my_lines = quotient + 1;
+      first_line = my_rank*my_lines;
+   } else {
+      my_lines = quotient;
+      first_line = my_rank*quotient + remainder;
+   }
+   *first_p = (first_line*line_elems < n) ? first_line*line_elems : n;
+   *last_p = ((first_line + my_lines)*line_elems < n)
+         ? (first_line + my_lines)*line_elems : n;
+}  /* Thread_range */
 
-	if( (i + local_n) < n){
-		 i+=local_n;
-	}else{
-		i = n+1;
-	}
+/*------------------------------------------------------------------
+ * Function:  Dot_reference
+ * Purpose:   The dot product of the starting doubles in ref_t
+ * In args:   x0, y0
+ * Out arg:   scale_p:  sum |x0[i]*y0[i]|
+ * Ret val:   The dot product
+ */
+ref_t Dot_reference(const double x0[], const double y0[], double* scale_p) {
+   ref_t sum = 0, scale = 0, term;
+   int i;
 
+   for (i = 0; i < n; i++) {
+      term = (ref_t) x0[i]*y0[i];
+      sum += term;
+      scale += (term < 0) ? -term : term;
    }
+   *scale_p = (double) scale;
+   return sum;
+}  /* Dot_reference */
 
-   return NULL;
-}  /*  Daxpys */
-
+/*------------------------------------------------------------------
+ * Function:  Axpy_error
+ * Purpose:   ||y - y_ref||_2/||y_ref||_2, where y_ref = y0 +
+ *            reps*alpha*x0 in long double
+ * In args:   x0, y0, y
+ * Ret val:   The relative error
+ */
+double Axpy_error(const double x0[], const double y0[], const double y[]) {
+   long double ref, diff, err2 = 0.0L, norm2 = 0.0L;
+   int i;
 
+   for (i = 0; i < n; i++) {
+      ref = y0[i] + (long double) reps*alpha*x0[i];
+      diff = y[i] - ref;
+      err2 += diff*diff;
+      norm2 += ref*ref;
+   }
+   return (norm2 > 0.0L) ? (double) sqrtl(err2/norm2) : (double) sqrtl(err2);
+}  /* Axpy_error */
 
 /*------------------------------------------------------------------
- * Function:        Read_vector
- * Purpose:         Read in the vector x
- * In arg:          prompt, n
- * Out arg:         x
+ * Function:  Select_level
+ * Purpose:   Choose the widest kernels the CPU supports
+ * Ret val:   LEVEL_AVX512, LEVEL_AVX2 or LEVEL_REF
  */
-void Read_vector(char* prompt, double x[], int n) {
-   int   i;
+int Select_level(void) {
+#  ifdef HAVE_X86_SIMD
+   __builtin_cpu_init();
+   if (__builtin_cpu_supports("avx512f"))
+      return LEVEL_AVX512;
+   if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+      return LEVEL_AVX2;
+#  endif
+   return LEVEL_REF;
+}  /* Select_level */
 
-   printf("%s\n", prompt);
-   for (i = 0; i < n; i++) 
-      scanf("%lf", &x[i]);
-}  /* Read_vector */
+/*------------------------------------------------------------------
+ * Function:  Alloc_vector
+ * Purpose:   Allocate storage for n elements of size bytes starting
+ *            on a cache line
+ * In args:   n, size
+ * Ret val:   The storage:  free it with free
+ */
+void* Alloc_vector(int n, int size) {
+   void* ptr;
 
+   if (posix_memalign(&ptr, CACHE_LINE, (size_t) (n > 0 ? n : 1)*size)
+         != 0) {
+      fprintf(stderr, "Can't allocate %d elements of %d bytes\n", n, size);
+      exit(1);
+   }
+   return ptr;
+}  /* Alloc_vector */
 
+/*------------------------------------------------------------------
+ * Function:  Fill_vector
+ * Purpose:   Fill x with drand48 values in [-1, 1)
+ * In arg:    n
+ * Out arg:   x
+ */
+void Fill_vector(double x[], int n) {
+   int i;
 
+   for (i = 0; i < n; i++)
+      x[i] = 2.0*drand48() - 1.0;
+}  /* Fill_vector */
 
 /*------------------------------------------------------------------
- * Function:    Print_vector
- * Purpose:     Print a vector
- * In args:     title, y, m
+ * Function:  Wtime
+ * Purpose:   Wall clock time in seconds
  */
-void Print_vector(char* title, double y[], double m) {
-   int   i;
+double Wtime(void) {
+   struct timespec now;
 
-   printf("%s\n", title);
-   for (i = 0; i < m; i++)
-      printf("%4.1f ", y[i]);
-   printf("\n");
-}  /* Print_vector */
+   clock_gettime(CLOCK_MONOTONIC, &now);
+   return now.tv_sec + 1.0e-9*now.tv_nsec;
+}  /* Wtime */
 
 /*------------------------------------------------------------------
  * Function:  Usage
@@ -185,7 +588,7 @@ void Print_vector(char* title, double y[], double m) {
  * In arg :   prog_name
  */
 void Usage (char* prog_name) {
-   fprintf(stderr, "usage: %s <thread_count>\n", prog_name);
+   fprintf(stderr, "usage: %s [-r reps] [-a alpha] [-v variant] "
+         "<thread_count> <n>\n", prog_name);
    exit(0);
 }  /* Usage */
-
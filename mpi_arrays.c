@@ -5,36 +5,192 @@
  *
  * Purpose: DAXPY- "Double precision Alpha X Plus Y."
  *           Reads in 2 arrays, multiplies each element of one 
- *           by alpha and then adds it to the second array
+ *           by alpha and then adds it to the second array.
+ *           The arrays are block-distributed across the MPI
+ *           processes, and each process splits its block among a
+ *           pool of threads.
  *           
  *       
  *
- * Input:
+ * Input (process 0):
  *     n: order
  *     y, x: the matrix and the vector to be multiplied
+ *     alpha
  *
  * Output:
  *     y: the product vector
  *
- * Compile:  gcc -g -Wall -o  mpi_arrays.c -lpthread
+ * Compile:  mpicc -g -Wall -O2 -o mpi_arrays mpi_arrays.c -lpthread -lm
  * Usage:
- *     mpi_arrays.c <thread_count>
+ *     mpiexec -n <p> ./mpi_arrays [-b n] [-r reps] <thread_count>
+ *     -b times the pool and each BLAS-1 kernel on vectors of order n
+ *     instead of reading input (see note 8)
  *
  * Notes:  
  *     1.  Local storage for x, y is dynamically allocated.
- *     2.  Number of threads (thread_count) should evenly divide both 
- *         m and n.  The program doesn't check for this.
+ *     2.  Neither the number of processes nor the number of
+ *         threads (thread_count) needs to divide n.
  *     3.  We use a 1-dimensional array for A and compute subscripts
  *         using the formula A[i][j] = A[i*n + j]
- *     4.  Distribution of x, and y is logical:  all three are 
- *         globally shared.
+ *     4.  x and y are block-distributed:  process q has the
+ *         Block_range(n, q, comm_sz) block of each, with the first
+ *         n % comm_sz processes getting one extra element.  Within a
+ *         process the block is shared by the threads.  Process 0
+ *         reads all of the input first, then broadcasts n and alpha
+ *         together as one input_t and scatters x and y.
+ *     5.  x and y start on a cache line, and each thread gets one
+ *         contiguous block of whole cache lines (see Thread_range),
+ *         so no two threads write to the same line of y.  The first
+ *         (lines % thread_count) threads get one extra line, and the
+ *         last block stops at n.
+ *     6.  Each thread's block is done by Daxpy_kernel, chosen at run
+ *         time:  an AVX-512 kernel, an AVX2/FMA kernel, or the scalar
+ *         Daxpy_ref.  The vector kernels use fused multiply-adds, so
+ *         y can differ from Daxpy_ref's in the last bit.
+ *     7.  The threads are started once, by Pool_start, and wait for
+ *         work in Pool_worker; the calling thread is rank 0.  Pool_run
+ *         publishes a job by bumping Pool.generation and then waits
+ *         for Pool.arrived to reach size - 1, so a fork/join is two
+ *         atomic updates and no system calls.  Waiting threads spin
+ *         with a pause instruction for SPIN_LIMIT tries and then call
+ *         sched_yield, so an oversubscribed machine still makes
+ *         progress.  If the pool has more threads than the process
+ *         has CPUs, they yield right away instead:  spinning would
+ *         only keep the thread they wait for off its CPU.  With one
+ *         thread Pool_run just calls the job.  Thread r is pinned to the
+ *         ((node_rank*thread_count + r) % cpus)-th CPU the process
+ *         may run on, where node_rank is the process' rank among the
+ *         processes on its node.  So if the processes on a node share
+ *         a mask (e.g., mpiexec --bind-to none) their threads go to
+ *         different CPUs, and if each has its own mask the offset just
+ *         rotates its threads within it.
+ *     8.  Daxpy, Dscal, Ddot, Dnrm2, Dcopy and Daxpby are the BLAS-1
+ *         operations on the pool.  Each thread works on its block
+ *         from Thread_range, and Ddot and Dnrm2 add the threads'
+ *         partial sums in rank order, so the result doesn't depend
+ *         on which thread finishes first.  Dnrm2 squares the
+ *         entries directly, and only if that overflows or underflows
+ *         makes a second pass scaled by the largest magnitude.  With
+ *         -b the time per call of an empty fork/join, of a
+ *         pthread_create/pthread_join of every thread, and of each
+ *         kernel are printed as CSV, with the memory traffic of each
+ *         kernel in GB/s.  With thread_count = 1 the fork/join time is
+ *         just a function call, so time the pool with 2 or more.
+ *     9.  Daxpy_dot, Daxpy_nrm2 and Dexpr are fused operations:  one
+ *         pass over memory instead of one per operation.  Dexpr
+ *         computes out = c[0]*v[0] + ... + c[nv-1]*v[nv-1] for up to
+ *         MAX_EXPR vectors, and also out.w if w isn't NULL (the new
+ *         out if w == out).  Each thread's block is done by
+ *         Dexpr_kernel, which keeps the coefficients, the element of
+ *         out and the partial dot product in registers.  out may be
+ *         one of the v[k], but mustn't overlap them otherwise.
+ *         Dscal and Daxpby are one- and two-vector Dexprs.  With -b,
+ *         each fused operation is timed next to the same work done
+ *         by separate calls.
+ *    10.  The BLAS-1 and fused operations are collective:  every
+ *         process calls them with n, the order of its own block.
+ *         Daxpy, Dscal, Dcopy and Daxpby only touch local data.
+ *         Ddot, Dexpr with a w, and Daxpy_dot add the processes'
+ *         sums with one MPI_Allreduce (Global_sum).  Dnrm2 finds the
+ *         norm of the local block as in note 8, and one MPI_Allreduce
+ *         with Nrm2_op, which combines two norms with hypot, gives
+ *         the global norm without overflow.  Daxpy_nrm2 uses the
+ *         global sum of squares from Daxpy_dot, and falls back to
+ *         Dnrm2 only if it overflows or underflows.  With one process
+ *         no MPI calls are made, so p = 1 costs what the threads-only
+ *         version did.  Only the calling thread makes MPI calls
+ *         (MPI_THREAD_FUNNELED).  With -b, each process times its
+ *         block, the slowest time is printed, and the GB/s are for
+ *         all n elements.
  *
 */
+#define _GNU_SOURCE       /* for pthread_setaffinity_np */
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <float.h>
+#include <math.h>
+#include <time.h>
+#include <sched.h>
 #include <pthread.h>
+#include <stdatomic.h>
+#include <mpi.h>
 
-const int MAX_THREADS = 64;
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#  define HAVE_X86_SIMD
+#  include <immintrin.h>
+#endif
+
+#define CACHE_LINE 64
+#define LINE_DOUBLES 8    /* doubles per cache line */
+#define MAX_THREADS 64
+#define SPIN_LIMIT 1024   /* pauses before a waiting thread yields */
+#define DOT_LANES 16      /* accumulators in Ddot_ref and friends  */
+#define MAX_EXPR 4        /* most vectors in a Dexpr               */
+
+#ifdef HAVE_X86_SIMD
+#  define CPU_RELAX() _mm_pause()
+#else
+#  define CPU_RELAX()
+#endif
+
+typedef void (*Daxpy_kernel_t)(int count, double alpha, const double x[],
+      double y[]);
+typedef double (*Ddot_kernel_t)(int count, const double x[],
+      const double y[]);
+typedef double (*Dexpr_kernel_t)(int count, int nv, const double c[],
+      const double* const v[], double out[], const double w[]);
+
+/* A job for the pool:  called by every thread with its rank */
+typedef void (*Job_t)(long my_rank, void* args);
+
+/* The thread pool (note 7).  The counters are on their own cache */
+/* lines, so the waiting threads don't slow down the caller.      */
+typedef struct {
+   pthread_t*  handles;     /* size - 1 of them:  rank 0 is the caller */
+   int         size;
+   Job_t       job;
+   void*       args;
+   cpu_set_t   cpus;        /* the CPUs we may run on */
+   int         first_cpu;   /* index in cpus of rank 0's CPU */
+   int         spin_limit;  /* SPIN_LIMIT, or 0 if oversubscribed */
+   atomic_uint generation __attribute__((aligned(CACHE_LINE)));
+   atomic_int  arrived __attribute__((aligned(CACHE_LINE)));
+   atomic_int  stop;
+} pool_t;
+
+/* Operations done by Blas1_job */
+#define OP_AXPY  0
+#define OP_DOT   1
+#define OP_COPY  2
+#define OP_AMAX  3   /* largest |x[i]|, for Dnrm2's scaled pass */
+#define OP_SSQ   4   /* sum of (alpha*x[i])^2 */
+#define OP_EXPR  5   /* Dexpr:  uses nv, c, v and w */
+
+typedef struct {
+   int           op;
+   int           n;
+   double        alpha, beta;
+   const double* x;
+   double*       y;
+   int           nv;
+   double        c[MAX_EXPR];
+   const double* v[MAX_EXPR];
+   const double* w;
+} blas1_args_t;
+
+/* n and alpha, sent by Get_input in one broadcast */
+typedef struct {
+   double alpha;
+   int    n;
+} input_t;
+
+/* A partial result, alone on its cache line */
+typedef struct {
+   double val;
+   char   pad[CACHE_LINE - sizeof(double)];
+} padded_sum_t;
 
 /* Global variables */
 int     thread_count;
@@ -42,73 +198,180 @@ int     n;
 double alpha;
 double* x;
 double* y;
+pool_t  Pool;
+int     proc_rank, comm_sz;   /* in MPI_COMM_WORLD */
+MPI_Op  Nrm2_op;              /* set up by main:  see note 10 */
+padded_sum_t Partial[MAX_THREADS] __attribute__((aligned(CACHE_LINE)));
+
+/* Kernels for one thread's block, set by Select_kernels */
+Daxpy_kernel_t  Daxpy_kernel;
+Ddot_kernel_t   Ddot_kernel;
+Dexpr_kernel_t  Dexpr_kernel;
 
 /* Serial functions */
 void Usage(char* prog_name);
+double* Alloc_vector(int n);
+void Get_input(input_t* input_p, double** x_p, double** y_p);
+void Build_input_type(input_t* input_p, MPI_Datatype* input_mpi_t_p);
 void Read_vector(char* prompt, double x[], int n);
-void Print_vector(char* title, double y[], double m);
+double* Scatter_vector(double x[], int local_n, int n);
+void Print_vector(char* title, double local_y[], int local_n, int n);
+void Block_range(int n, int rank, int p, int* first_p, int* count_p);
+void Block_counts(int n, int counts[], int displs[]);
+void Select_kernels(void);
+void Run_benchmark(int n, int reps);
+double Wtime(void);
 
-/* Parallel function */
-void *Daxpy(void* rank);
+/* Thread pool */
+void Pool_start(int size, int first_cpu);
+void Pool_run(Job_t job, void* args);
+void Pool_stop(void);
+void* Pool_worker(void* rank);
+void Pin_thread(long my_rank);
+void Empty_job(long my_rank, void* args);
+void* Empty_thread(void* rank);
 
-/*------------------------------------------------------------------*/
+/* BLAS-1 operations on the pool */
+void Daxpy(int n, double alpha, const double x[], double y[]);
+void Dscal(int n, double alpha, double x[]);
+double Ddot(int n, const double x[], const double y[]);
+double Dnrm2(int n, const double x[]);
+void Dcopy(int n, const double x[], double y[]);
+void Daxpby(int n, double alpha, const double x[], double beta,
+      double y[]);
 
+/* Fused operations on the pool */
+double Daxpy_dot(int n, double alpha, const double x[], double y[],
+      const double z[]);
+double Daxpy_nrm2(int n, double alpha, const double x[], double y[]);
+double Dexpr(int n, int nv, const double c[], const double* const v[],
+      double out[], const double w[]);
 
-int main(int argc, char* argv[]) {
-   long       thread;
-   pthread_t* thread_handles;
+void Blas1_job(long my_rank, void* args);
+double Sum_partials(void);
+double Local_dot(int n, const double x[], const double y[]);
+double Local_nrm2(int n, const double x[]);
+double Global_sum(double local);
+void Hypot_op(void* in, void* inout, int* len, MPI_Datatype* type);
+void Thread_range(int n, long my_rank, int* first_p, int* last_p);
 
-   if (argc != 2) Usage(argv[0]);
-   // error checks thread count
+/* Kernels for one thread's block */
+void Daxpy_ref(int count, double alpha, const double x[], double y[]);
+#ifdef HAVE_X86_SIMD
+void Daxpy_avx2(int count, double alpha, const double x[], double y[]);
+void Daxpy_avx512(int count, double alpha, const double x[], double y[]);
+#endif
+double Damax_ref(int count, const double x[]);
+double Dssq_ref(int count, double scale, const double x[]);
+double Dexpr_ref(int count, int nv, const double c[],
+      const double* const v[], double out[], const double w[]);
+#ifdef HAVE_X86_SIMD
+double Dexpr_avx2(int count, int nv, const double c[],
+      const double* const v[], double out[], const double w[]);
+double Dexpr_avx512(int count, int nv, const double c[],
+      const double* const v[], double out[], const double w[]);
+#endif
 
-   thread_count = atoi(argv[1]);
+/* name_ref, and with x86 SIMD name_avx2 and name_avx512, all with */
+/* the same body:  the compiler vectorizes it for each target      */
+#ifdef HAVE_X86_SIMD
+#  define DEFINE_KERNEL(ret, name, params, ...)                 \
+   ret name##_ref params __VA_ARGS__                            \
+   __attribute__((target("avx2,fma")))                          \
+   ret name##_avx2 params __VA_ARGS__                           \
+   __attribute__((target("avx512f")))                           \
+   ret name##_avx512 params __VA_ARGS__
+#else
+#  define DEFINE_KERNEL(ret, name, params, ...)                 \
+   ret name##_ref params __VA_ARGS__
+#endif
 
-   // error checks thread count
-   if (thread_count <= 0 || thread_count > MAX_THREADS) Usage(argv[0]);
+/*------------------------------------------------------------------*/
 
-   thread_handles = malloc(thread_count*sizeof(pthread_t));
 
-   //asks for the dimensions of the arrays
-   printf("Enter n: \n");
-   scanf("%d", &n);
+int main(int argc, char* argv[]) {
+   int c, bench_n = 0, reps = 100, provided, my_first, local_n;
+   int node_rank;
+   MPI_Comm node_comm;
+   input_t input;
 
+   /* Only the calling thread makes MPI calls:  the pool doesn't */
+   MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &provided);
+   MPI_Comm_rank(MPI_COMM_WORLD, &proc_rank);
+   MPI_Comm_size(MPI_COMM_WORLD, &comm_sz);
+   if (provided < MPI_THREAD_FUNNELED) {
+      if (proc_rank == 0)
+         fprintf(stderr, "The MPI library doesn't support "
+               "MPI_THREAD_FUNNELED\n");
+      MPI_Abort(MPI_COMM_WORLD, 1);
+   }
+   MPI_Op_create(Hypot_op, 1, &Nrm2_op);
 
-  //allocates storage for arrays
-   x = malloc(n*sizeof(double));
-   y = malloc(n*sizeof(double));
+   /* My rank among the processes on my node, for Pin_thread */
+   MPI_Comm_split_type(MPI_COMM_WORLD, MPI_COMM_TYPE_SHARED, 0,
+         MPI_INFO_NULL, &node_comm);
+   MPI_Comm_rank(node_comm, &node_rank);
+   MPI_Comm_free(&node_comm);
+
+   while ((c = getopt(argc, argv, "b:r:")) != -1) {
+      switch (c) {
+         case 'b':
+            bench_n = strtol(optarg, NULL, 10);
+            if (bench_n <= 0) Usage(argv[0]);
+            break;
+         case 'r':
+            reps = strtol(optarg, NULL, 10);
+            if (reps <= 0) Usage(argv[0]);
+            break;
+         default:
+            Usage(argv[0]);
+      }
+   }
+   if (argc - optind != 1) Usage(argv[0]);
+   // error checks thread count
 
+   thread_count = atoi(argv[optind]);
 
+   // error checks thread count
+   if (thread_count <= 0 || thread_count > MAX_THREADS) Usage(argv[0]);
 
-   // Reads and prints first array
-   Read_vector("Enter the x array: ", x, n);
-   Print_vector("We read", x, n);
+   Select_kernels();
+   Pool_start(thread_count, node_rank*thread_count);
+   if (bench_n > 0) {
+      Run_benchmark(bench_n, reps);
+      Pool_stop();
+      MPI_Op_free(&Nrm2_op);
+      MPI_Finalize();
+      return 0;
+   }
 
-   //Reads and prints second array
-   Read_vector("Enter the y array: ", y, n);
-   Print_vector("We read", y, n);
+   //reads n, the arrays and alpha, and sends n and alpha to everyone
+   Get_input(&input, &x, &y);
+   n = input.n;
+   alpha = input.alpha;
+   Block_range(n, proc_rank, comm_sz, &my_first, &local_n);
 
-   //Reads in alpha
-   printf("Enter Alpha: \n");
-   scanf("%lf", &alpha);
 
+   //gives each process its blocks of the arrays, and prints them
+   x = Scatter_vector(x, local_n, n);
+   y = Scatter_vector(y, local_n, n);
+   Print_vector("We read", x, local_n, n);
+   Print_vector("We read", y, local_n, n);
 
-   //Creates threads and passes Daxpy function 
-   for (thread = 0; thread < thread_count; thread++)
-      pthread_create(&thread_handles[thread], NULL,
-         Daxpy, (void*) thread);
 
-   //Gathers threads
-   for (thread = 0; thread < thread_count; thread++)
-      pthread_join(thread_handles[thread], NULL);
+   //Hands each process' Daxpy to the threads in its pool
+   Daxpy(local_n, alpha, x, y);
 
    //Prints the solution
-   Print_vector("The product is", y, n);
+   Print_vector("The product is", y, local_n, n);
 
 
-   //Frees the allocated memory
+   //Frees the allocated memory, and stops the threads
    free(x);
    free(y);
-   free(thread_handles);
+   Pool_stop();
+   MPI_Op_free(&Nrm2_op);
+   MPI_Finalize();
 
    return 0;
 }  /* main */
@@ -117,39 +380,871 @@ int main(int argc, char* argv[]) {
 
 
 /*------------------------------------------------------------------
- * Function:       Daxpy
- * Purpose:        Multiply one array by alpha and add
- *                 it to the second array
- * In arg:         rank
- * Global in vars: alpha, x, n, thread_count
- * Global out var: y
+ * Function:  Pool_start
+ * Purpose:   Start size - 1 threads that wait for jobs from Pool_run;
+ *            the caller is rank 0
+ * In args:   size
+ *            first_cpu:  thread r is pinned to the (first_cpu + r)-th
+ *               CPU in the mask, mod the number of CPUs (note 7)
+ * Global out var:  Pool
  */
-void *Daxpy(void* rank) {
+void Pool_start(int size, int first_cpu) {
+   long thread;
+
+   Pool.size = size;
+   Pool.first_cpu = first_cpu;
+   Pool.handles = malloc(size*sizeof(pthread_t));
+   atomic_init(&Pool.generation, 0);
+   atomic_init(&Pool.arrived, 0);
+   atomic_init(&Pool.stop, 0);
+   if (sched_getaffinity(0, sizeof(cpu_set_t), &Pool.cpus) != 0)
+      CPU_ZERO(&Pool.cpus);
+   /* With more threads than CPUs a spinning thread only delays the */
+   /* one it's waiting for                                          */
+   Pool.spin_limit = (CPU_COUNT(&Pool.cpus) >= size) ? SPIN_LIMIT : 0;
+
+   Pin_thread(0);
+   for (thread = 1; thread < size; thread++)
+      pthread_create(&Pool.handles[thread - 1], NULL, Pool_worker,
+            (void*) thread);
+}  /* Pool_start */
+
+/*------------------------------------------------------------------
+ * Function:  Pool_run
+ * Purpose:   Run job(rank, args) on every thread in the pool, and
+ *            return when they've all finished
+ * In args:   job, args
+ */
+void Pool_run(Job_t job, void* args) {
+   long spins = 0;
+
+   if (Pool.size == 1) {
+      job(0, args);
+      return;
+   }
+   Pool.job = job;
+   Pool.args = args;
+   atomic_store_explicit(&Pool.arrived, 0, memory_order_relaxed);
+   atomic_fetch_add_explicit(&Pool.generation, 1, memory_order_release);
+
+   job(0, args);
+   while (atomic_load_explicit(&Pool.arrived, memory_order_acquire)
+         < Pool.size - 1)
+      if (++spins < Pool.spin_limit) CPU_RELAX(); else sched_yield();
+}  /* Pool_run */
+
+/*------------------------------------------------------------------
+ * Function:  Pool_stop
+ * Purpose:   Tell the threads in the pool to quit, and join them
+ */
+void Pool_stop(void) {
+   long thread;
+
+   atomic_store_explicit(&Pool.stop, 1, memory_order_relaxed);
+   atomic_fetch_add_explicit(&Pool.generation, 1, memory_order_release);
+   for (thread = 1; thread < Pool.size; thread++)
+      pthread_join(Pool.handles[thread - 1], NULL);
+   free(Pool.handles);
+}  /* Pool_stop */
+
+/*------------------------------------------------------------------
+ * Function:  Pool_worker
+ * Purpose:   Thread function for the pool:  wait for a new
+ *            generation, run the job, and check in
+ * In arg:    rank
+ */
+void* Pool_worker(void* rank) {
    long my_rank = (long) rank;
+   unsigned seen = 0, now;
+   long spins;
+
+   Pin_thread(my_rank);
+   while (1) {
+      spins = 0;
+      while ((now = atomic_load_explicit(&Pool.generation,
+            memory_order_acquire)) == seen)
+         if (++spins < Pool.spin_limit) CPU_RELAX(); else sched_yield();
+      seen = now;
+      if (atomic_load_explicit(&Pool.stop, memory_order_relaxed)) break;
+
+      Pool.job(my_rank, Pool.args);
+      atomic_fetch_add_explicit(&Pool.arrived, 1, memory_order_release);
+   }
+   return NULL;
+}  /* Pool_worker */
+
+/*------------------------------------------------------------------
+ * Function:  Pin_thread
+ * Purpose:   Pin the calling thread to the
+ *            ((Pool.first_cpu + my_rank) % cpus)-th CPU in Pool.cpus
+ * In arg:    my_rank
+ */
+void Pin_thread(long my_rank) {
+   int cpus = CPU_COUNT(&Pool.cpus), cpu, k = -1;
+   cpu_set_t mine;
+
+   if (cpus == 0) return;
+   for (cpu = 0; cpu < CPU_SETSIZE; cpu++)
+      if (CPU_ISSET(cpu, &Pool.cpus)
+            && ++k == (Pool.first_cpu + my_rank) % cpus) break;
+   CPU_ZERO(&mine);
+   CPU_SET(cpu, &mine);
+   pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &mine);
+}  /* Pin_thread */
+
+/*------------------------------------------------------------------
+ * Function:  Daxpy
+ * Purpose:   Multiply one array by alpha and add
+ *            it to the second array:  y += alpha*x
+ * In args:   n, alpha, x
+ * In/out arg:  y
+ */
+void Daxpy(int n, double alpha, const double x[], double y[]) {
+   blas1_args_t args = {.op = OP_AXPY, .n = n, .alpha = alpha,
+         .x = x, .y = y};
+
+   Pool_run(Blas1_job, &args);
+}  /*  Daxpy */
+
+/*------------------------------------------------------------------
+ * Function:  Dscal
+ * Purpose:   x *= alpha
+ * In args:   n, alpha
+ * In/out arg:  x
+ */
+void Dscal(int n, double alpha, double x[]) {
+   const double* v[1] = {x};
+
+   Dexpr(n, 1, &alpha, v, x, NULL);
+}  /* Dscal */
+
+/*------------------------------------------------------------------
+ * Function:  Ddot
+ * Purpose:   Find the dot product x.y of the distributed vectors
+ * In args:   n, x, y:  this process' blocks
+ * Ret val:   x.y, on every process
+ */
+double Ddot(int n, const double x[], const double y[]) {
+   return Global_sum(Local_dot(n, x, y));
+}  /* Ddot */
+
+/*------------------------------------------------------------------
+ * Function:  Dnrm2
+ * Purpose:   Find the 2-norm of the distributed vector x
+ * In args:   n, x:  this process' block
+ * Ret val:   sqrt(x.x), on every process
+ */
+double Dnrm2(int n, const double x[]) {
+   double local = Local_nrm2(n, x), nrm;
+
+   if (comm_sz == 1) return local;
+   MPI_Allreduce(&local, &nrm, 1, MPI_DOUBLE, Nrm2_op, MPI_COMM_WORLD);
+   return nrm;
+}  /* Dnrm2 */
+
+/*------------------------------------------------------------------
+ * Function:  Local_dot
+ * Purpose:   Find the dot product of this process' blocks on the
+ *            pool
+ * In args:   n, x, y
+ * Ret val:   x.y
+ */
+double Local_dot(int n, const double x[], const double y[]) {
+   blas1_args_t args = {.op = OP_DOT, .n = n, .x = x,
+         .y = (double*) y};
+
+   Pool_run(Blas1_job, &args);
+   return Sum_partials();
+}  /* Local_dot */
+
+/*------------------------------------------------------------------
+ * Function:  Local_nrm2
+ * Purpose:   Find the 2-norm of this process' block on the pool
+ * In args:   n, x
+ * Ret val:   sqrt(x.x)
+ */
+double Local_nrm2(int n, const double x[]) {
+   blas1_args_t args = {.op = OP_AMAX, .n = n, .x = x};
+   double ssq = Local_dot(n, x, x), amax;
+   int t;
+
+   if (ssq < INFINITY && ssq >= DBL_MIN/DBL_EPSILON)
+      return sqrt(ssq);
+
+   /* Overflow, or some x[i]^2 may have underflowed:  scale by 1/max */
+   Pool_run(Blas1_job, &args);
+   for (amax = 0.0, t = 0; t < Pool.size; t++)
+      if (Partial[t].val > amax) amax = Partial[t].val;
+   if (amax == 0.0 || amax == INFINITY || isnan(ssq))
+      return (amax == 0.0) ? 0.0 : ssq;
+   args.op = OP_SSQ;
+   args.alpha = 1.0/amax;
+   Pool_run(Blas1_job, &args);
+   return amax*sqrt(Sum_partials());
+}  /* Local_nrm2 */
+
+/*------------------------------------------------------------------
+ * Function:  Global_sum
+ * Purpose:   Add up the processes' values with one MPI_Allreduce,
+ *            or none if there's only one process
+ * In arg:    local
+ * Ret val:   The sum, on every process
+ */
+double Global_sum(double local) {
+   double sum;
+
+   if (comm_sz == 1) return local;
+   MPI_Allreduce(&local, &sum, 1, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+   return sum;
+}  /* Global_sum */
+
+/*------------------------------------------------------------------
+ * Function:  Hypot_op
+ * Purpose:   MPI reduction operator for Nrm2_op:  inout[i] =
+ *            sqrt(in[i]^2 + inout[i]^2), without overflow or
+ *            underflow
+ * In args:   in, len, type (MPI_DOUBLE)
+ * In/out arg:  inout
+ */
+void Hypot_op(void* in, void* inout, int* len, MPI_Datatype* type) {
+   const double* a = in;
+   double* b = inout;
    int i;
-   int local_n = n/thread_count; 
-   int my_first_row = my_rank*local_n;
 
+   (void) type;
+   for (i = 0; i < *len; i++)
+      b[i] = hypot(a[i], b[i]);
+}  /* Hypot_op */
 
-   for (i = my_first_row; i <= n; i = i +0) {
-           y[i] += alpha*x[i];
+/*------------------------------------------------------------------
+ * Function:  Dcopy
+ * Purpose:   y = x
+ * In args:   n, x
+ * Out arg:   y
+ */
+void Dcopy(int n, const double x[], double y[]) {
+   blas1_args_t args = {.op = OP_COPY, .n = n, .x = x, .y = y};
 
-	if( (i + local_n) < n){
-		 i+=local_n;
-	}else{
-		i = n+1;
-	}
+   Pool_run(Blas1_job, &args);
+}  /* Dcopy */
+
+/*------------------------------------------------------------------
+ * Function:  Daxpby
+ * Purpose:   y = alpha*x + beta*y
+ * In args:   n, alpha, x, beta
+ * In/out arg:  y
+ */
+void Daxpby(int n, double alpha, const double x[], double beta,
+      double y[]) {
+   double c[2] = {alpha, beta};
+   const double* v[2] = {x, y};
 
+   Dexpr(n, 2, c, v, y, NULL);
+}  /* Daxpby */
+
+/*------------------------------------------------------------------
+ * Function:  Daxpy_dot
+ * Purpose:   y += alpha*x, and find the dot product of the new y
+ *            with z, in one pass and one MPI_Allreduce
+ * In args:   n, alpha, x
+ *            z:  may be y
+ * In/out arg:  y
+ * Ret val:   y.z
+ */
+double Daxpy_dot(int n, double alpha, const double x[], double y[],
+      const double z[]) {
+   double c[2] = {1.0, alpha};
+   const double* v[2] = {y, x};
+
+   return Dexpr(n, 2, c, v, y, z);
+}  /* Daxpy_dot */
+
+/*------------------------------------------------------------------
+ * Function:  Daxpy_nrm2
+ * Purpose:   y += alpha*x, and find the 2-norm of the new y, in one
+ *            pass
+ * In args:   n, alpha, x
+ * In/out arg:  y
+ * Ret val:   ||y||
+ * Note:      As in Dnrm2, there's a second, scaled pass over y if
+ *            the sum of squares overflows or underflows.
+ */
+double Daxpy_nrm2(int n, double alpha, const double x[], double y[]) {
+   double ssq = Daxpy_dot(n, alpha, x, y, y);
+
+   if (ssq < INFINITY && ssq >= DBL_MIN/DBL_EPSILON)
+      return sqrt(ssq);
+   return Dnrm2(n, y);
+}  /* Daxpy_nrm2 */
+
+/*------------------------------------------------------------------
+ * Function:  Dexpr
+ * Purpose:   out = c[0]*v[0] + ... + c[nv-1]*v[nv-1] in one pass,
+ *            and the dot product of the new out with w (one
+ *            MPI_Allreduce)
+ * In args:   n
+ *            nv:  1 <= nv <= MAX_EXPR
+ *            c, v
+ *            w:  NULL for no dot product; may be out
+ * Out arg:   out:  may be one of the v[k]
+ * Ret val:   out.w, on every process, or 0 if w is NULL
+ */
+double Dexpr(int n, int nv, const double c[], const double* const v[],
+      double out[], const double w[]) {
+   blas1_args_t args = {.op = OP_EXPR, .n = n, .y = out, .nv = nv,
+         .w = w};
+   int k;
+
+   for (k = 0; k < nv; k++) {
+      args.c[k] = c[k];
+      args.v[k] = v[k];
    }
+   Pool_run(Blas1_job, &args);
+   return (w != NULL) ? Global_sum(Sum_partials()) : 0.0;
+}  /* Dexpr */
 
+/*------------------------------------------------------------------
+ * Function:  Blas1_job
+ * Purpose:   Do one thread's block of a BLAS-1 operation
+ * In args:   my_rank
+ *            args:  a blas1_args_t
+ * Global out var:  Partial[my_rank] for OP_DOT, OP_AMAX, OP_SSQ and
+ *            OP_EXPR
+ */
+void Blas1_job(long my_rank, void* args) {
+   blas1_args_t* a = args;
+   const double* v[MAX_EXPR];
+   int first, last, count, k;
+
+   Thread_range(a->n, my_rank, &first, &last);
+   count = last - first;
+   switch (a->op) {
+      case OP_AXPY:
+         Daxpy_kernel(count, a->alpha, a->x + first, a->y + first);
+         break;
+      case OP_DOT:
+         Partial[my_rank].val = Ddot_kernel(count, a->x + first,
+               a->y + first);
+         break;
+      case OP_COPY:
+         memcpy(a->y + first, a->x + first, count*sizeof(double));
+         break;
+      case OP_AMAX:
+         Partial[my_rank].val = Damax_ref(count, a->x + first);
+         break;
+      case OP_SSQ:
+         Partial[my_rank].val = Dssq_ref(count, a->alpha, a->x + first);
+         break;
+      case OP_EXPR:
+         for (k = 0; k < a->nv; k++)
+            v[k] = a->v[k] + first;
+         Partial[my_rank].val = Dexpr_kernel(count, a->nv, a->c, v,
+               a->y + first, (a->w != NULL) ? a->w + first : NULL);
+         break;
+   }
+}  /* Blas1_job */
+
+/*------------------------------------------------------------------
+ * Function:  Sum_partials
+ * Purpose:   Add up Partial[0], ..., Partial[Pool.size-1] in order
+ * Ret val:   The sum
+ */
+double Sum_partials(void) {
+   double sum = 0.0;
+   int t;
+
+   for (t = 0; t < Pool.size; t++)
+      sum += Partial[t].val;
+   return sum;
+}  /* Sum_partials */
+
+/*------------------------------------------------------------------
+ * Function:       Thread_range
+ * Purpose:        Find the block of x and y for a thread:  whole
+ *                 cache lines, with the first lines % Pool.size
+ *                 threads getting one extra line
+ * In args:        n, my_rank
+ * Global in var:  Pool.size
+ * Out args:       first_p, last_p:  the thread does my_first <= i <
+ *                 my_last
+ */
+void Thread_range(int n, long my_rank, int* first_p, int* last_p) {
+   long lines = (n + LINE_DOUBLES - 1)/LINE_DOUBLES;
+   long quotient = lines/Pool.size;
+   long remainder = lines % Pool.size;
+   long first_line, my_lines;
+
+   if (my_rank < remainder) {
+      my_lines = quotient + 1;
+      first_line = my_rank*my_lines;
+   } else {
+      my_lines = quotient;
+      first_line = my_rank*quotient + remainder;
+   }
+   *first_p = (first_line*LINE_DOUBLES < n) ? first_line*LINE_DOUBLES : n;
+   *last_p = ((first_line + my_lines)*LINE_DOUBLES < n)
+         ? (first_line + my_lines)*LINE_DOUBLES : n;
+}  /* Thread_range */
+
+/*------------------------------------------------------------------
+ * Function:  Daxpy_ref
+ * Purpose:   y[i] += alpha*x[i] for 0 <= i < count
+ * In args:   count, alpha, x
+ * In/out arg:  y
+ */
+void Daxpy_ref(int count, double alpha, const double x[], double y[]) {
+   int i;
+
+   for (i = 0; i < count; i++)
+      y[i] += alpha*x[i];
+}  /* Daxpy_ref */
+
+#ifdef HAVE_X86_SIMD
+/*------------------------------------------------------------------
+ * Function:  Daxpy_avx2
+ * Purpose:   AVX2/FMA version of Daxpy_ref, 8 elements per iteration
+ */
+__attribute__((target("avx2,fma")))
+void Daxpy_avx2(int count, double alpha, const double x[], double y[]) {
+   __m256d a = _mm256_set1_pd(alpha);
+   int i;
+
+   for (i = 0; i + 8 <= count; i += 8) {
+      _mm256_storeu_pd(y + i, _mm256_fmadd_pd(a, _mm256_loadu_pd(x + i),
+            _mm256_loadu_pd(y + i)));
+      _mm256_storeu_pd(y + i + 4, _mm256_fmadd_pd(a,
+            _mm256_loadu_pd(x + i + 4), _mm256_loadu_pd(y + i + 4)));
+   }
+   for (; i < count; i++)
+      y[i] = fma(alpha, x[i], y[i]);
+}  /* Daxpy_avx2 */
+
+/*------------------------------------------------------------------
+ * Function:  Daxpy_avx512
+ * Purpose:   AVX-512 version of Daxpy_ref, 16 elements per iteration
+ *            and a masked tail
+ */
+__attribute__((target("avx512f")))
+void Daxpy_avx512(int count, double alpha, const double x[], double y[]) {
+   __m512d a = _mm512_set1_pd(alpha);
+   __mmask8 mask;
+   int i;
+
+   for (i = 0; i + 16 <= count; i += 16) {
+      _mm512_storeu_pd(y + i, _mm512_fmadd_pd(a, _mm512_loadu_pd(x + i),
+            _mm512_loadu_pd(y + i)));
+      _mm512_storeu_pd(y + i + 8, _mm512_fmadd_pd(a,
+            _mm512_loadu_pd(x + i + 8), _mm512_loadu_pd(y + i + 8)));
+   }
+   for (; i < count; i += 8) {
+      mask = (count - i >= 8) ? 0xff : (__mmask8) ((1u << (count - i)) - 1);
+      _mm512_mask_storeu_pd(y + i, mask, _mm512_fmadd_pd(a,
+            _mm512_maskz_loadu_pd(mask, x + i),
+            _mm512_maskz_loadu_pd(mask, y + i)));
+   }
+}  /* Daxpy_avx512 */
+#endif  /* HAVE_X86_SIMD */
+
+/*------------------------------------------------------------------
+ * Function:  Ddot_ref, Ddot_avx2, Ddot_avx512
+ * Purpose:   Sum of x[i]*y[i] for 0 <= i < count
+ * Note:      The DOT_LANES separate sums are what let the compiler
+ *            vectorize the loop without reassociating a single sum.
+ */
+DEFINE_KERNEL(double, Ddot, (int count, const double x[],
+      const double y[]), {
+   double sum[DOT_LANES] = {0.0}, total = 0.0;
+   int i, j;
+
+   for (i = 0; i + DOT_LANES <= count; i += DOT_LANES)
+      for (j = 0; j < DOT_LANES; j++)
+         sum[j] += x[i + j]*y[i + j];
+   for (; i < count; i++)
+      sum[0] += x[i]*y[i];
+   for (j = 0; j < DOT_LANES; j++)
+      total += sum[j];
+   return total;
+})
+
+/*------------------------------------------------------------------
+ * Function:  Dexpr_ref
+ * Purpose:   out[i] = c[0]*v[0][i] + ... + c[nv-1]*v[nv-1][i] for
+ *            0 <= i < count, and the sum of out[i]*w[i]
+ * In args:   count, nv, c, v
+ *            w:  NULL for no sum; may be out
+ * Out arg:   out
+ * Ret val:   The sum, or 0 if w is NULL
+ */
+double Dexpr_ref(int count, int nv, const double c[],
+      const double* const v[], double out[], const double w[]) {
+   double t, sum = 0.0;
+   int i, k;
+
+   for (i = 0; i < count; i++) {
+      t = c[0]*v[0][i];
+      for (k = 1; k < nv; k++)
+         t += c[k]*v[k][i];
+      if (w == out)
+         sum += t*t;
+      else if (w != NULL)
+         sum += t*w[i];
+      out[i] = t;
+   }
+   return sum;
+}  /* Dexpr_ref */
+
+#ifdef HAVE_X86_SIMD
+/*------------------------------------------------------------------
+ * Function:  Dexpr_avx2
+ * Purpose:   AVX2/FMA version of Dexpr_ref, 4 elements per iteration
+ * Note:      The tests of nv and w are the same every iteration, so
+ *            they're predicted, and unused vectors are never loaded.
+ */
+__attribute__((target("avx2,fma")))
+double Dexpr_avx2(int count, int nv, const double c[],
+      const double* const v[], double out[], const double w[]) {
+   const double* v0 = v[0];
+   const double* v1 = (nv > 1) ? v[1] : v0;
+   const double* v2 = (nv > 2) ? v[2] : v0;
+   const double* v3 = (nv > 3) ? v[3] : v0;
+   __m256d c0 = _mm256_set1_pd(c[0]);
+   __m256d c1 = _mm256_set1_pd(nv > 1 ? c[1] : 0.0);
+   __m256d c2 = _mm256_set1_pd(nv > 2 ? c[2] : 0.0);
+   __m256d c3 = _mm256_set1_pd(nv > 3 ? c[3] : 0.0);
+   __m256d t, sum = _mm256_setzero_pd();
+   __m128d half;
+   const double* tail_v[MAX_EXPR] = {v0, v1, v2, v3};
+   int i;
+
+   for (i = 0; i + 4 <= count; i += 4) {
+      t = _mm256_mul_pd(c0, _mm256_loadu_pd(v0 + i));
+      if (nv > 1) t = _mm256_fmadd_pd(c1, _mm256_loadu_pd(v1 + i), t);
+      if (nv > 2) t = _mm256_fmadd_pd(c2, _mm256_loadu_pd(v2 + i), t);
+      if (nv > 3) t = _mm256_fmadd_pd(c3, _mm256_loadu_pd(v3 + i), t);
+      if (w == out)
+         sum = _mm256_fmadd_pd(t, t, sum);
+      else if (w != NULL)
+         sum = _mm256_fmadd_pd(t, _mm256_loadu_pd(w + i), sum);
+      _mm256_storeu_pd(out + i, t);
+   }
+   half = _mm_add_pd(_mm256_castpd256_pd128(sum),
+         _mm256_extractf128_pd(sum, 1));
+   half = _mm_add_sd(half, _mm_unpackhi_pd(half, half));
+
+   if (i < count) {
+      tail_v[0] += i; tail_v[1] += i; tail_v[2] += i; tail_v[3] += i;
+      return _mm_cvtsd_f64(half) + Dexpr_ref(count - i, nv, c, tail_v,
+            out + i, (w == out) ? out + i : (w != NULL) ? w + i : NULL);
+   }
+   return _mm_cvtsd_f64(half);
+}  /* Dexpr_avx2 */
+
+/*------------------------------------------------------------------
+ * Function:  Dexpr_avx512
+ * Purpose:   AVX-512 version of Dexpr_ref, 8 elements per iteration
+ *            and a masked tail
+ */
+__attribute__((target("avx512f")))
+double Dexpr_avx512(int count, int nv, const double c[],
+      const double* const v[], double out[], const double w[]) {
+   const double* v0 = v[0];
+   const double* v1 = (nv > 1) ? v[1] : v0;
+   const double* v2 = (nv > 2) ? v[2] : v0;
+   const double* v3 = (nv > 3) ? v[3] : v0;
+   __m512d c0 = _mm512_set1_pd(c[0]);
+   __m512d c1 = _mm512_set1_pd(nv > 1 ? c[1] : 0.0);
+   __m512d c2 = _mm512_set1_pd(nv > 2 ? c[2] : 0.0);
+   __m512d c3 = _mm512_set1_pd(nv > 3 ? c[3] : 0.0);
+   __m512d t, sum = _mm512_setzero_pd();
+   __mmask8 m = 0xff;
+   int i;
+
+   for (i = 0; i < count; i += 8) {
+      if (count - i < 8) m = (__mmask8) ((1u << (count - i)) - 1);
+      t = _mm512_mul_pd(c0, _mm512_maskz_loadu_pd(m, v0 + i));
+      if (nv > 1)
+         t = _mm512_fmadd_pd(c1, _mm512_maskz_loadu_pd(m, v1 + i), t);
+      if (nv > 2)
+         t = _mm512_fmadd_pd(c2, _mm512_maskz_loadu_pd(m, v2 + i), t);
+      if (nv > 3)
+         t = _mm512_fmadd_pd(c3, _mm512_maskz_loadu_pd(m, v3 + i), t);
+      if (w == out)
+         sum = _mm512_fmadd_pd(t, t, sum);
+      else if (w != NULL)
+         sum = _mm512_fmadd_pd(t, _mm512_maskz_loadu_pd(m, w + i), sum);
+      _mm512_mask_storeu_pd(out + i, m, t);
+   }
+   return _mm512_reduce_add_pd(sum);
+}  /* Dexpr_avx512 */
+#endif  /* HAVE_X86_SIMD */
+
+/*------------------------------------------------------------------
+ * Function:  Damax_ref
+ * Purpose:   Find the largest |x[i]| for 0 <= i < count
+ */
+double Damax_ref(int count, const double x[]) {
+   double amax = 0.0;
+   int i;
+
+   for (i = 0; i < count; i++)
+      if (fabs(x[i]) > amax) amax = fabs(x[i]);
+   return amax;
+}  /* Damax_ref */
+
+/*------------------------------------------------------------------
+ * Function:  Dssq_ref
+ * Purpose:   Sum of (scale*x[i])^2 for 0 <= i < count
+ */
+double Dssq_ref(int count, double scale, const double x[]) {
+   double sum = 0.0, t;
+   int i;
+
+   for (i = 0; i < count; i++) {
+      t = scale*x[i];
+      sum += t*t;
+   }
+   return sum;
+}  /* Dssq_ref */
+
+/*------------------------------------------------------------------
+ * Function:  Select_kernels
+ * Purpose:   Choose the fastest block kernels the CPU supports
+ * Global out vars:  Daxpy_kernel, Ddot_kernel, Dexpr_kernel
+ */
+void Select_kernels(void) {
+   Daxpy_kernel = Daxpy_ref;
+   Ddot_kernel = Ddot_ref;
+   Dexpr_kernel = Dexpr_ref;
+#  ifdef HAVE_X86_SIMD
+   __builtin_cpu_init();
+   if (__builtin_cpu_supports("avx512f")) {
+      Daxpy_kernel = Daxpy_avx512;
+      Ddot_kernel = Ddot_avx512;
+      Dexpr_kernel = Dexpr_avx512;
+   } else if (__builtin_cpu_supports("avx2")
+         && __builtin_cpu_supports("fma")) {
+      Daxpy_kernel = Daxpy_avx2;
+      Ddot_kernel = Ddot_avx2;
+      Dexpr_kernel = Dexpr_avx2;
+   }
+#  endif
+}  /* Select_kernels */
+
+/*------------------------------------------------------------------
+ * Function:  Alloc_vector
+ * Purpose:   Allocate storage for n doubles starting on a cache line
+ * In arg:    n
+ * Ret val:   The storage:  free it with free
+ */
+double* Alloc_vector(int n) {
+   void* ptr;
+
+   if (posix_memalign(&ptr, CACHE_LINE,
+         (n > 0 ? n : 1)*sizeof(double)) != 0) {
+      fprintf(stderr, "Can't allocate %d doubles\n", n);
+      exit(1);
+   }
+   return ptr;
+}  /* Alloc_vector */
+
+/*------------------------------------------------------------------
+ * Function:  Run_benchmark
+ * Purpose:   Time an empty fork/join on the pool, starting and
+ *            joining thread_count threads, an allreduce of one
+ *            double, and each BLAS-1 operation on distributed
+ *            vectors of order n, and print CSV on process 0
+ * In args:   n, reps
+ */
+void Run_benchmark(int n, int reps) {
+   const char* names[] = {"fork_join", "create_join", "allreduce",
+         "axpy", "scal", "dot", "nrm2", "copy", "axpby", "axpy+dot",
+         "axpy_dot", "axpy+nrm2", "axpy_nrm2", "expr4_3_passes", "expr4"};
+   /* Words of memory traffic per element */
+   const int   words[] = {0, 0, 0, 3, 2, 2, 1, 2, 3, 5, 4, 4, 3, 11, 5};
+   const int   n_ops = sizeof(words)/sizeof(words[0]);
+   int first, local_n;
+   double* x;
+   double* y;
+   double* z;
+   double* u;
+   double* out;
+   const double* v[4];
+   double c[4] = {0.5, 0.25, -0.5, 1.0e-3};
+   pthread_t* handles = malloc(Pool.size*sizeof(pthread_t));
+   double start, elapsed, max_elapsed, check = 0.0;
+   long thread;
+   int op, r, i;
+
+   Block_range(n, proc_rank, comm_sz, &first, &local_n);
+   x = Alloc_vector(local_n);
+   y = Alloc_vector(local_n);
+   z = Alloc_vector(local_n);
+   u = Alloc_vector(local_n);
+   out = Alloc_vector(local_n);
+   v[0] = x; v[1] = y; v[2] = z; v[3] = u;
+   for (i = 0; i < local_n; i++) {
+      x[i] = 1.0/(first + i + 1);
+      y[i] = z[i] = u[i] = out[i] = 1.0;
+   }
+
+   if (proc_rank == 0)
+      printf("op,n,procs,threads,reps,usec_per_call,GB_per_s\n");
+   for (op = 0; op < n_ops; op++) {
+      if (comm_sz > 1) MPI_Barrier(MPI_COMM_WORLD);
+      start = Wtime();
+      for (r = 0; r < reps; r++) {
+         switch (op) {
+            case 0: Pool_run(Empty_job, NULL); break;
+            case 1:
+               for (thread = 0; thread < Pool.size; thread++)
+                  pthread_create(&handles[thread], NULL, Empty_thread,
+                        (void*) thread);
+               for (thread = 0; thread < Pool.size; thread++)
+                  pthread_join(handles[thread], NULL);
+               break;
+            case 2: check += Global_sum(1.0); break;
+            case 3: Daxpy(local_n, 1.0e-3, x, y); break;
+            case 4: Dscal(local_n, 0.999, y); break;
+            case 5: check += Ddot(local_n, x, y); break;
+            case 6: check += Dnrm2(local_n, y); break;
+            case 7: Dcopy(local_n, x, y); break;
+            case 8: Daxpby(local_n, 1.0e-3, x, 0.999, y); break;
+            case 9:
+               Daxpy(local_n, 1.0e-3, x, y);
+               check += Ddot(local_n, y, z);
+               break;
+            case 10: check += Daxpy_dot(local_n, 1.0e-3, x, y, z); break;
+            case 11:
+               Daxpy(local_n, 1.0e-3, x, y);
+               check += Dnrm2(local_n, y);
+               break;
+            case 12: check += Daxpy_nrm2(local_n, 1.0e-3, x, y); break;
+            case 13:
+               Dexpr(local_n, 1, c, v, out, NULL);
+               Daxpy(local_n, c[1], y, out);
+               Daxpy(local_n, c[2], z, out);
+               Daxpy(local_n, c[3], u, out);
+               break;
+            case 14: Dexpr(local_n, 4, c, v, out, NULL); break;
+         }
+      }
+      elapsed = (Wtime() - start)/reps;
+      max_elapsed = elapsed;
+      if (comm_sz > 1)
+         MPI_Reduce(&elapsed, &max_elapsed, 1, MPI_DOUBLE, MPI_MAX, 0,
+               MPI_COMM_WORLD);
+      if (proc_rank == 0)
+         printf("%s,%d,%d,%d,%d,%e,%f\n", names[op], op < 3 ? 0 : n,
+               comm_sz, Pool.size, reps, 1.0e6*max_elapsed,
+               op < 3 ? 0.0 : words[op]*sizeof(double)*(double) n
+                  /max_elapsed/1e9);
+   }
+   if (check == 0.0) printf("# check = %e\n", check);
+
+   free(x);
+   free(y);
+   free(z);
+   free(u);
+   free(out);
+   free(handles);
+}  /* Run_benchmark */
+
+/*------------------------------------------------------------------
+ * Function:  Empty_job, Empty_thread
+ * Purpose:   Do nothing, for timing the pool and pthread_create
+ */
+void Empty_job(long my_rank, void* args) {
+   (void) my_rank;
+   (void) args;
+}  /* Empty_job */
+
+void* Empty_thread(void* rank) {
+   (void) rank;
    return NULL;
-}  /*  Daxpys */
+}  /* Empty_thread */
+
+/*------------------------------------------------------------------
+ * Function:  Wtime
+ * Purpose:   Wall clock time in seconds
+ */
+double Wtime(void) {
+   struct timespec now;
+
+   clock_gettime(CLOCK_MONOTONIC, &now);
+   return now.tv_sec + 1.0e-9*now.tv_nsec;
+}  /* Wtime */
+
+
+
+/*------------------------------------------------------------------
+ * Function:        Get_input
+ * Purpose:         Read n, x, y and alpha on process 0, and then
+ *                  broadcast n and alpha in one message
+ * Out args:        input_p:  n and alpha, on every process
+ *                  x_p, y_p:  on process 0 all n elements of x and
+ *                     y, and NULL on the others
+ * Note:            If n isn't positive, every process quits.
+ */
+void Get_input(input_t* input_p, double** x_p, double** y_p) {
+   MPI_Datatype input_mpi_t;
 
+   *x_p = *y_p = NULL;
+   input_p->n = 0;
+   input_p->alpha = 0.0;
+   if (proc_rank == 0) {
+      printf("Enter n: \n");
+      scanf("%d", &input_p->n);
+      if (input_p->n > 0) {
+         *x_p = Alloc_vector(input_p->n);
+         *y_p = Alloc_vector(input_p->n);
+         Read_vector("Enter the x array: ", *x_p, input_p->n);
+         Read_vector("Enter the y array: ", *y_p, input_p->n);
+         printf("Enter Alpha: \n");
+         scanf("%lf", &input_p->alpha);
+      }
+   }
+
+   if (comm_sz > 1) {
+      Build_input_type(input_p, &input_mpi_t);
+      MPI_Bcast(input_p, 1, input_mpi_t, 0, MPI_COMM_WORLD);
+      MPI_Type_free(&input_mpi_t);
+   }
+
+   if (input_p->n < 1) {
+      if (proc_rank == 0)
+         fprintf(stderr, "n must be a positive int\n");
+      Pool_stop();
+      MPI_Op_free(&Nrm2_op);
+      MPI_Finalize();
+      exit(0);
+   }
+}  /* Get_input */
+
+/*------------------------------------------------------------------
+ * Function:        Build_input_type
+ * Purpose:         Build a derived datatype for an input_t, so n and
+ *                  alpha can be sent in one message
+ * In arg:          input_p:  any input_t, used to find the offsets
+ * Out arg:         input_mpi_t_p:  the committed datatype
+ */
+void Build_input_type(input_t* input_p, MPI_Datatype* input_mpi_t_p) {
+   int          blocklengths[2] = {1, 1};
+   MPI_Datatype types[2] = {MPI_DOUBLE, MPI_INT};
+   MPI_Aint     base, displacements[2];
 
+   MPI_Get_address(input_p, &base);
+   MPI_Get_address(&input_p->alpha, &displacements[0]);
+   MPI_Get_address(&input_p->n, &displacements[1]);
+   displacements[0] -= base;
+   displacements[1] -= base;
+   MPI_Type_create_struct(2, blocklengths, displacements, types,
+         input_mpi_t_p);
+   MPI_Type_commit(input_mpi_t_p);
+}  /* Build_input_type */
 
 /*------------------------------------------------------------------
  * Function:        Read_vector
- * Purpose:         Read in the vector x
+ * Purpose:         Read in the vector x on process 0
  * In arg:          prompt, n
  * Out arg:         x
  */
@@ -157,27 +1252,111 @@ void Read_vector(char* prompt, double x[], int n) {
    int   i;
 
    printf("%s\n", prompt);
-   for (i = 0; i < n; i++) 
+   for (i = 0; i < n; i++)
       scanf("%lf", &x[i]);
 }  /* Read_vector */
 
+/*------------------------------------------------------------------
+ * Function:        Scatter_vector
+ * Purpose:         Send each process its block of a vector read by
+ *                  process 0
+ * In args:         x:  all n elements on process 0, NULL on the
+ *                     others.  Freed, or with one process returned.
+ *                  local_n, n
+ * Ret val:         This process' block
+ */
+double* Scatter_vector(double x[], int local_n, int n) {
+   double* local_x;
+   int*  counts = NULL;
+   int*  displs = NULL;
+
+   if (comm_sz == 1) return x;
+
+   local_x = Alloc_vector(local_n);
+   if (proc_rank == 0) {
+      counts = malloc(comm_sz*sizeof(int));
+      displs = malloc(comm_sz*sizeof(int));
+      Block_counts(n, counts, displs);
+   }
+   MPI_Scatterv(x, counts, displs, MPI_DOUBLE, local_x, local_n,
+         MPI_DOUBLE, 0, MPI_COMM_WORLD);
+   free(x);
+   free(counts);
+   free(displs);
+   return local_x;
+}  /* Scatter_vector */
+
 
 
 
 /*------------------------------------------------------------------
  * Function:    Print_vector
- * Purpose:     Print a vector
- * In args:     title, y, m
+ * Purpose:     Gather a distributed vector on process 0 and print it
+ * In args:     title, local_y, local_n, n
  */
-void Print_vector(char* title, double y[], double m) {
+void Print_vector(char* title, double local_y[], int local_n, int n) {
+   double* y = local_y;
+   int*  counts = NULL;
+   int*  displs = NULL;
    int   i;
 
-   printf("%s\n", title);
-   for (i = 0; i < m; i++)
-      printf("%4.1f ", y[i]);
-   printf("\n");
+   if (comm_sz > 1) {
+      if (proc_rank == 0) {
+         y = Alloc_vector(n);
+         counts = malloc(comm_sz*sizeof(int));
+         displs = malloc(comm_sz*sizeof(int));
+         Block_counts(n, counts, displs);
+      }
+      MPI_Gatherv(local_y, local_n, MPI_DOUBLE, y, counts, displs,
+            MPI_DOUBLE, 0, MPI_COMM_WORLD);
+   }
+
+   if (proc_rank == 0) {
+      printf("%s\n", title);
+      for (i = 0; i < n; i++)
+         printf("%4.1f ", y[i]);
+      printf("\n");
+   }
+   if (y != local_y) free(y);
+   free(counts);
+   free(displs);
 }  /* Print_vector */
 
+/*------------------------------------------------------------------
+ * Function:     Block_range
+ * Purpose:      Find a process' block of 0, 1, ..., n-1 when n is
+ *               split as evenly as possible among p processes
+ * In args:      n, rank, p
+ * Out args:     first_p:  the block's first index
+ *               count_p:  the size of the block
+ */
+void Block_range(int n, int rank, int p, int* first_p, int* count_p) {
+   int quotient = n/p;
+   int remainder = n % p;
+
+   if (rank < remainder) {
+      *count_p = quotient + 1;
+      *first_p = rank*(quotient + 1);
+   } else {
+      *count_p = quotient;
+      *first_p = rank*quotient + remainder;
+   }
+}  /* Block_range */
+
+/*------------------------------------------------------------------
+ * Function:  Block_counts
+ * Purpose:   The sizes and offsets of every process' block, for
+ *            MPI_Scatterv and MPI_Gatherv
+ * In arg:    n
+ * Out args:  counts, displs:  comm_sz of each
+ */
+void Block_counts(int n, int counts[], int displs[]) {
+   int q;
+
+   for (q = 0; q < comm_sz; q++)
+      Block_range(n, q, comm_sz, &displs[q], &counts[q]);
+}  /* Block_counts */
+
 /*------------------------------------------------------------------
  * Function:  Usage
  * Purpose:   print a message showing what the command line should
@@ -185,7 +1364,11 @@ void Print_vector(char* title, double y[], double m) {
  * In arg :   prog_name
  */
 void Usage (char* prog_name) {
-   fprintf(stderr, "usage: %s <thread_count>\n", prog_name);
+   fprintf(stderr, "usage: %s [-b n] [-r reps] <thread_count>\n",
+         prog_name);
+   fprintf(stderr, "   -b times the BLAS-1 operations on vectors of "
+         "order n\n");
+   fprintf(stderr, "   -r calls per operation with -b (default 100)\n");
    exit(0);
 }  /* Usage */
 
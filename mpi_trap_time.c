@@ -3,48 +3,370 @@
  * Purpose: Implement parallel trapezoidal rule and determine its
  *          run-time vs. serial trap rule
  *
- * Input:   a, b, n
+ * Input:   a, b, n:  from the command line, a config file, or stdin
  * Output:  Estimate of the area from between x = a, x = b, x-axis, and
  *          the graph of f(x) using the trapezoidal rule and n trapezoids.
  *          Also output the elapsed time to run the parallel and
- *          serial versions of the trapezoidal rule, and the
+ *          serial versions of the trapezoidal rule, the min, average
+ *          and max time the processes spent in Trap, and the
  *          efficiency and speedup of the parallel versions.
  *
- * Compile: mpicc -g -Wall -o mpi_trap_time mpi_trap_time.c -lm
+ * Compile: mpicc -g -Wall -fopenmp -o mpi_trap_time mpi_trap_time.c -lm
+ *          (without -fopenmp each process uses one thread)
  * Run:     mpiexec -n <number of processes> ./mpi_trap_time
+ *             [-b] [-r <reps>] [-w <warmups>] [-m <method>] [-e <tol>]
+ *             [-f <integrand>[,<integrand>...]] [-t <threads>]
+ *             [-c <config file>] [<a> <b> <n>]
+ *          -b runs the scaling benchmark instead (see below)
+ *          -r is the number of timed repetitions (default 10)
+ *          -w is the number of untimed warm-up runs (default 2)
+ *          -m trap (default), adapt (adaptive Gauss-Kronrod),
+ *             simpson or romberg (see below)
+ *          -e is the absolute error tolerance for adapt, simpson
+ *             and romberg (default 1e-10)
+ *          -f is a comma separated list of integrands from the
+ *             registry, or all (default exp_sin).  Each one is
+ *             integrated in turn with the same a, b, n and method.
+ *          -t is the number of OpenMP threads per process (default
+ *             OMP_NUM_THREADS)
+ *          -c names a file with lines "a = <value>", "b = <value>" and
+ *             "n = <value>" (# starts a comment)
+ *          a, b and n on the command line take precedence over -c.
+ *          With neither, process 0 prompts for them on stdin.
  *
  * Algorithm:
- *    0.  Process 0 reads in a, b, and n, and distributes them
- *        among the processes.
+ *    0.  Process 0 gets a, b, and n, and broadcasts them in one
+ *        MPI_Bcast of a struct, using a derived datatype.
  *    1.  Barrier.
  *    2.  Start timer on each process.
  *    3.  Each process calculates "its" subinterval of
  *        integration.
  *    4.  Each process estimates the area of f(x)
- *        over its interval using the trapezoidal rule.
- *    5a. Each process != 0 sends its area to 0.
- *    5b. Process 0 sums the calculations received from
- *        the individual processes and prints the result.
- *    6.  Stop timer on each process.
- *    7.  Find max time, store on process 0.
+ *        over its interval using the trapezoidal rule, and
+ *        records how long that took.
+ *    5.  A tree-structured reduction carries the area and the
+ *        time in a single message per step:  process 0 gets the
+ *        total area and the sum, min and max of the times.
+ *    6.  Stop timer on process 0, which is the last to finish.
+ *    7.  Print the result and the load balance.
  *    8.  Time serial trap on process 0.
  *    9.  Print speedup, efficiency.
  *
- * Note:  f(x) is hardwired.
+ * Benchmark mode (-b):
+ *    The serial time above comes from a different code path run on
+ *    process 0 during the parallel job.  The benchmark instead runs
+ *    the parallel code on the first q processes, for q = 1, 2, 4,
+ *    ..., p, and uses q = 1 as the baseline.  For each q it does
+ *    the warm-up runs and then the timed runs, and prints one CSV
+ *    line with the median, 10th and 90th percentile, min and max
+ *    times, the speedup and the efficiency.
+ *       strong:  n trapezoids in all, speedup = T(1)/T(q),
+ *                efficiency = speedup/q
+ *       weak:    n trapezoids per process, efficiency = T(1)/T(q),
+ *                (scaled) speedup = q*efficiency
+ *    The times are medians, measured on process 0 of the q
+ *    processes from a barrier until the reduction is done.
+ *
+ * Adaptive mode (-m adapt):
+ *    n is the number of equal subintervals the work starts with.
+ *    Each subinterval is integrated with the 15 point Gauss-Kronrod
+ *    rule, using |K15 - G7| as the error estimate, and split in two
+ *    when the error is more than tol*(its length)/(b - a).  Process 0
+ *    is a manager that keeps a stack of the subintervals still to be
+ *    done and hands them out one at a time to whichever worker is
+ *    idle.  A worker refines its subinterval on its own stack, but
+ *    after ADAPT_TASK_MAX Gauss-Kronrod rules it stops and sends the
+ *    parts it hasn't finished back to the manager with its partial
+ *    area, so a spike can't tie up one worker while the rest wait.
+ *    With p = 1 process 0 does the work itself.
+ *
+ * Simpson and Romberg modes (-m simpson, -m romberg):
+ *    n is the number of trapezoids to start with.  Each level
+ *    halves h, so the processes only evaluate f at the midpoints of
+ *    the previous level's trapezoids, splitting them in blocks, and
+ *    an MPI_Allreduce of the midpoint sums gives
+ *       T(h/2) = T(h)/2 + (h/2)*(sum of f at the midpoints).
+ *    Richardson extrapolation of the T's gives the Romberg table;
+ *    its first column is Simpson's rule.  The run stops when the
+ *    latest Simpson estimate (or diagonal Romberg entry) differs
+ *    from the one before by at most tol, or after ROMBERG_MAX
+ *    levels.  No value of f is computed twice.
+ *
+ * Integrands:
+ *    The registry, Integrands, has exp_sin, which is f(x) = exp(sin(x))
+ *    below, plus the integrands in INTEGRAND_LIST.  For each of those,
+ *    DEFINE_INTEGRAND writes an inline f_<name> and scalar, AVX2 and
+ *    AVX-512 copies of a Sum_<name> loop that calls it, so the compiler
+ *    inlines the formula and vectorizes the loop.  Set_integrand picks
+ *    the copy for this CPU when an integrand is selected, so only
+ *    whole sums go through a function pointer.  To add an integrand,
+ *    add a line to INTEGRAND_LIST.
+ *
+ * Hybrid MPI+OpenMP:
+ *    Trap and the Simpson/Romberg levels split their points among
+ *    the threads of each process with Sum_threaded.  Each thread
+ *    leaves its sum in its own cache line of Partial, so no two
+ *    threads write the same line, and the master adds them up in
+ *    thread order.  The reduction across processes is done in two
+ *    steps:  first among the processes on each node (node_comm, from
+ *    MPI_Comm_split_type), then among one process per node
+ *    (leader_comm), so only one message per node crosses the
+ *    network at each step of the tree.  Run one process per node (or
+ *    per socket) with -t cores to use threads instead of processes.
+ *    The "serial" time is one process with all its threads.
+ *
+ * Notes:
+ *    1.  exp_sin, the original f(x), is the default integrand.
+ *    2.  Sum_f (exp_sin's sum) evaluates f at TRAP_BATCH points at a
+ *        time through F_batch, which is set the first time it's needed
+ *        to the AVX-512, AVX2/FMA or scalar version, depending on the
+ *        CPU.  The vector versions use their own polynomial sin and
+ *        exp, so they must be changed along with f.  Their values of
+ *        f are within 2 ulp of libm's exp(sin(x)), and about 2 ulp of
+ *        the exact value, for |x| up to 1e5.  Sum_f adds the values
+ *        using 4 accumulators.
  */
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 #include <math.h>
+#include <limits.h>
 
 /* We'll be using MPI routines, definitions, etc. */
 #include <mpi.h>
 
-void Get_data(int p, int my_rank, double* a_p, double* b_p, int* n_p);
+#ifdef _OPENMP
+#  include <omp.h>
+#endif
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#  define HAVE_X86_SIMD
+#  include <immintrin.h>
+#endif
+
+/* Number of points Trap passes to F_batch at once:  x and y take */
+/* 4 KB together, so they stay in L1                              */
+#define TRAP_BATCH 256
+
+/* The vector sin falls back to libm when |x| is bigger than this */
+#define SIN_MAX_ARG 1.0e5
+
+/* Integration methods */
+#define TRAP    0
+#define ADAPT   1
+#define SIMPSON 2
+#define ROMBERG 3
+
+/* Most levels of h halving in Simpson and Romberg modes */
+#define ROMBERG_MAX 30
+
+/* Most integrands in one run, and the number of accumulators in the */
+/* generated Sum_<name> loops:  8 doubles = 1 AVX-512 or 2 AVX regs  */
+#define MAX_BATCH 32
+#define SUM_LANES 8
+
+/* Per thread partial sums in Sum_threaded, one per cache line */
+#define CACHE_LINE  64
+#define MAX_THREADS 256
+typedef struct {
+    double sum;
+    char   pad[CACHE_LINE - sizeof(double)];
+} padded_sum_t;
+
+/* Adaptive mode:  most Gauss-Kronrod rules per task, most subintervals */
+/* on a worker's stack, layout of a worker's reply, and message tags    */
+#define ADAPT_TASK_MAX  128
+#define ADAPT_STACK_MAX 64
+#define R_AREA      0
+#define R_ERR       1
+#define R_RULES     2
+#define R_HDR       3
+#define REPLY_MAX   (R_HDR + 2*ADAPT_STACK_MAX)
+#define WORK_TAG    1
+#define STOP_TAG    2
+#define RESULT_TAG  3
+
+/* The input, broadcast by Get_data as one struct */
+typedef struct {
+    double a;
+    double b;
+    int    n;
+} trap_data_t;
+
+/* Entries of the array reduced by Reduce_results */
+#define AREA    0
+#define T_SUM   1
+#define T_MIN   2
+#define T_MAX   3
+#define N_STATS 4
+
+void Get_data(int argc, char* argv[], char* cfg_file, int my_rank,
+        double* a_p, double* b_p, int* n_p);
+void Build_mpi_type(trap_data_t* data_p, MPI_Datatype* data_mpi_t_p);
+int  Read_config(char* file_name, const char* keys[], double vals[],
+        int n_keys);
+int  Config_int(double val);
+int  Arg_int(const char* str);
+
+void Reduce_results(double stats[], int my_rank, int p, MPI_Comm comm);
+void Split_node_comms(MPI_Comm comm, MPI_Comm* node_comm_p,
+        MPI_Comm* leader_comm_p);
+void Node_reduce(double stats[], MPI_Comm node_comm, MPI_Comm leader_comm);
+void Free_node_comms(MPI_Comm* node_comm_p, MPI_Comm* leader_comm_p);
+
+void Usage(char* prog_name);
+void Get_args(int argc, char* argv[], int* bench_p, int* reps_p,
+        int* warmups_p, int* method_p, double* tol_p, int which[],
+        int* n_which_p, int* threads_p, char** cfg_file_p);
+void Run_trap(double a, double b, int n, int my_rank, int p,
+        MPI_Comm node_comm, MPI_Comm leader_comm);
+void Run_benchmark(double a, double b, int n, int reps, int warmups,
+        int my_rank, int p, int print_header);
+void Time_trap(double a, double b, long long n, int reps, int warmups,
+        double times[], MPI_Comm comm);
+int  Compare_double(const void* x_p, const void* y_p);
+double Percentile(double sorted[], int count, double pct);
 
 double Trap(double local_a, double local_b, int local_n,
            double h);    /* Calculate local area  */
+double Sum_f(double x0, double h, long long first, long long count);
+double Sum_threaded(double x0, double h, long long first,
+        long long count);
 
 double f(double x); /* function we're integrating */
 
+void Run_adaptive(double a, double b, int n, double tol, int my_rank,
+        int p, MPI_Comm comm);
+double Gauss_kronrod(double left, double right, double* err_p);
+int  Adapt_task(double left, double right, double tol_density,
+        double min_len, double reply[]);
+void Adapt_manager(double a, double b, int n, double tol_density,
+        double min_len, double* area_p, double* err_p, long rules[],
+        int p, MPI_Comm comm);
+void Adapt_worker(double tol_density, double min_len, MPI_Comm comm);
+
+void Run_extrapolated(double a, double b, int n, double tol, int method,
+        int my_rank, int p, MPI_Comm comm);
+void Block_range(long long total, int my_rank, int p, long long* first_p,
+        long long* count_p);
+
+typedef void (*F_batch_t)(const double x[], double y[], int count);
+void F_batch_ref(const double x[], double y[], int count);
+#ifdef HAVE_X86_SIMD
+void F_batch_avx2(const double x[], double y[], int count);
+void F_batch_avx512(const double x[], double y[], int count);
+#endif
+F_batch_t Select_f_batch(void);
+
+/* f on an array of points, set by Select_f_batch */
+F_batch_t F_batch = NULL;
+
+typedef double (*Sum_t)(double x0, double h, long long first,
+        long long count);
+#ifdef HAVE_X86_SIMD
+Sum_t Select_sum(Sum_t ref, Sum_t avx2, Sum_t avx512);
+#endif
+void  Batch_exp_sin(const double x[], double y[], int count);
+Sum_t Select_exp_sin(void);
+
+/* An entry in the registry of integrands */
+typedef struct {
+    const char* name;       /* for -f                         */
+    const char* formula;
+    double    (*f)(double x);
+    void      (*batch)(const double x[], double y[], int count);
+    Sum_t     (*select)(void);  /* the best Sum for this CPU  */
+} integrand_t;
+
+/* name and formula of each generated integrand (in terms of x) */
+#define INTEGRAND_LIST(X)                       \
+    X(x2,    x*x)                               \
+    X(x3,    x*x*x)                             \
+    X(pi,    4.0/(1.0 + x*x))                   \
+    X(runge, 1.0/(1.0 + 25.0*x*x))              \
+    X(peak,  1.0/(1.0e-4 + (x - 0.5)*(x - 0.5)))
+
+/* Body of Sum_<name>:  add up f_<name>(x0 + i*h) for i = first, ..., */
+/* first+count-1.  The inner loop over the SUM_LANES accumulators is   */
+/* what the compiler vectorizes.                                       */
+#define SUM_BODY(name)                                                  \
+    double    sum[SUM_LANES] = {0.0}, off[SUM_LANES], base, total = 0.0; \
+    long long i;                                                        \
+    int       j;                                                        \
+                                                                        \
+    for (j = 0; j < SUM_LANES; j++)                                     \
+        off[j] = j*h;                                                   \
+    for (i = first; i + SUM_LANES <= first + count; i += SUM_LANES) {   \
+        base = x0 + i*h;                                                \
+        for (j = 0; j < SUM_LANES; j++)                                 \
+            sum[j] += f_##name(base + off[j]);                          \
+    }                                                                   \
+    for (; i < first + count; i++)                                      \
+        sum[0] += f_##name(x0 + i*h);                                   \
+    for (j = 0; j < SUM_LANES; j++)                                     \
+        total += sum[j];                                                \
+    return total;
+
+#ifdef HAVE_X86_SIMD
+#  define DEFINE_SUM_SIMD(name)                                         \
+    __attribute__((target("avx2,fma")))                                 \
+    static double Sum_##name##_avx2(double x0, double h,                \
+            long long first, long long count) {                         \
+        SUM_BODY(name)                                                  \
+    }                                                                   \
+    __attribute__((target("avx512f")))                                  \
+    static double Sum_##name##_avx512(double x0, double h,              \
+            long long first, long long count) {                         \
+        SUM_BODY(name)                                                  \
+    }                                                                   \
+    static Sum_t Select_##name(void) {                                  \
+        return Select_sum(Sum_##name##_ref, Sum_##name##_avx2,          \
+            Sum_##name##_avx512);                                       \
+    }
+#else
+#  define DEFINE_SUM_SIMD(name)                                         \
+    static Sum_t Select_##name(void) {                                  \
+        return Sum_##name##_ref;                                        \
+    }
+#endif
+
+/* f_<name>, Batch_<name>, Sum_<name>_ref (and _avx2, _avx512), and */
+/* Select_<name> for one line of INTEGRAND_LIST                     */
+#define DEFINE_INTEGRAND(name, expr)                                    \
+    static inline double f_##name(double x) {                           \
+        return expr;                                                    \
+    }                                                                   \
+    static void Batch_##name(const double x[], double y[], int count) { \
+        int i;                                                          \
+        for (i = 0; i < count; i++)                                     \
+            y[i] = f_##name(x[i]);                                      \
+    }                                                                   \
+    static double Sum_##name##_ref(double x0, double h,                 \
+            long long first, long long count) {                         \
+        SUM_BODY(name)                                                  \
+    }                                                                   \
+    DEFINE_SUM_SIMD(name)
+
+#define INTEGRAND_ENTRY(name, expr) \
+    {#name, #expr, f_##name, Batch_##name, Select_##name},
+
+INTEGRAND_LIST(DEFINE_INTEGRAND)
+
+const integrand_t Integrands[] = {
+    {"exp_sin", "exp(sin(x))", f, Batch_exp_sin, Select_exp_sin},
+    INTEGRAND_LIST(INTEGRAND_ENTRY)
+};
+#define N_INTEGRANDS ((int) (sizeof(Integrands)/sizeof(Integrands[0])))
+
+/* Written by thread t of Sum_threaded in Partial[t] */
+padded_sum_t Partial[MAX_THREADS] __attribute__((aligned(CACHE_LINE)));
+
+/* The integrand in use and its sum, set by Set_integrand */
+const integrand_t* Integrand = &Integrands[0];
+Sum_t              Sum_integrand = NULL;
+void Set_integrand(int which);
+
 
 int main(int argc, char** argv) {
     int         my_rank;   /* My process rank           */
@@ -52,23 +374,16 @@ int main(int argc, char** argv) {
     double      a;         /* Left endpoint             */
     double      b;         /* Right endpoint            */
     int         n;         /* Number of trapezoids      */
-    double      h;         /* Trapezoid base length     */
-    double      local_a;   /* Left endpoint my process  */
-    double      local_b;   /* Right endpoint my process */
-    int         local_n;   /* Number of trapezoids for  */
-                           /* my calculation            */
-    double      area;      /* My subarea                */
-    double      total;     /* Total area                */
-    double      temp;      /* Receive elapsed time      */
-    int         source;    /* Process sending area      */
-    int         dest = 0;  /* All messages go to 0      */
-    int         tag = 0;
-    MPI_Status  status;
-    double      start, finish;
-    double      ser_elapsed, par_elapsed;
+    int         bench, reps, warmups, method;
+    double      tol;
+    int         which[MAX_BATCH];  /* Integrands to do  */
+    int         n_which, k, threads, provided;
+    char*       cfg_file;
+    MPI_Comm    node_comm, leader_comm;
 
-    /* Let the system do what it needs to start up MPI */
-    MPI_Init(&argc, &argv);
+    /* Let the system do what it needs to start up MPI.  Only the */
+    /* master thread makes MPI calls.                             */
+    MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &provided);
 
     /* Get my process rank */
     MPI_Comm_rank(MPI_COMM_WORLD, &my_rank);
@@ -76,7 +391,61 @@ int main(int argc, char** argv) {
     /* Find out how many processes are being used */
     MPI_Comm_size(MPI_COMM_WORLD, &p);
 
-    Get_data(p, my_rank, &a, &b, &n);
+    Get_args(argc, argv, &bench, &reps, &warmups, &method, &tol, which,
+        &n_which, &threads, &cfg_file);
+#   ifdef _OPENMP
+    if (threads > 0) omp_set_num_threads(threads);
+#   endif
+    Get_data(argc, argv, cfg_file, my_rank, &a, &b, &n);
+    Split_node_comms(MPI_COMM_WORLD, &node_comm, &leader_comm);
+
+    for (k = 0; k < n_which; k++) {
+        Set_integrand(which[k]);
+        if (my_rank == 0 && !bench) {
+            printf("%sIntegrand %s:  f(x) = %s\n", k > 0 ? "\n" : "",
+                Integrand->name, Integrand->formula);
+            fflush(stdout);
+        }
+
+        if (bench)
+            Run_benchmark(a, b, n, reps, warmups, my_rank, p, k == 0);
+        else if (method == ADAPT)
+            Run_adaptive(a, b, n, tol, my_rank, p, MPI_COMM_WORLD);
+        else if (method == SIMPSON || method == ROMBERG)
+            Run_extrapolated(a, b, n, tol, method, my_rank, p,
+                MPI_COMM_WORLD);
+        else
+            Run_trap(a, b, n, my_rank, p, node_comm, leader_comm);
+    }
+    Free_node_comms(&node_comm, &leader_comm);
+
+    /* Shut down MPI */
+    MPI_Finalize();
+
+    return 0;
+} /*  main  */
+
+
+/*------------------------------------------------------------------
+ * Function:     Run_trap
+ * Purpose:      Time the parallel and serial trapezoidal rule, and
+ *               print the result, times, speedup and efficiency on
+ *               process 0
+ * Input args:   a, b, n:  the interval and number of trapezoids
+ *               my_rank, p
+ *               node_comm, leader_comm:  from Split_node_comms
+ */
+void Run_trap(double a, double b, int n, int my_rank, int p,
+        MPI_Comm node_comm, MPI_Comm leader_comm) {
+    double      h;         /* Trapezoid base length     */
+    double      local_a;   /* Left endpoint my process  */
+    double      local_b;   /* Right endpoint my process */
+    int         local_n;   /* Number of trapezoids for  */
+                           /* my calculation            */
+    double      total;     /* Total area                */
+    double      stats[N_STATS]; /* Area and Trap times  */
+    double      start, finish, trap_start;
+    double      ser_elapsed, par_elapsed;
 
     MPI_Barrier(MPI_COMM_WORLD);
     start = MPI_Wtime();
@@ -88,41 +457,33 @@ int main(int argc, char** argv) {
      * starts at: */
     local_a = a + my_rank*local_n*h;
     local_b = local_a + local_n*h;
-    area = Trap(local_a, local_b, local_n, h);
+    trap_start = MPI_Wtime();
+    stats[AREA] = Trap(local_a, local_b, local_n, h);
+    stats[T_SUM] = stats[T_MIN] = stats[T_MAX] = MPI_Wtime() - trap_start;
 
-    /* Add up the areas calculated by each process */
-    if (my_rank == 0) {
-        total = area;
-        for (source = 1; source < p; source++) {
-            MPI_Recv(&area, 1, MPI_DOUBLE, source, tag,
-                MPI_COMM_WORLD, &status);
-            total = total + area;
-        }
-    } else {  
-        MPI_Send(&area, 1, MPI_DOUBLE, dest,
-            tag, MPI_COMM_WORLD);
-    }
+    /* Add up the areas and find the min/max times in one reduction */
+    /* on each node, and then one among the nodes                    */
+    Node_reduce(stats, node_comm, leader_comm);
     finish = MPI_Wtime();
 
+    /* Process 0 can't finish the reduction until everyone is done */
     par_elapsed = finish - start;
 
-    /* Get Max Time */
-    if (my_rank == 0) {
-       for (source = 1; source < p; source++) {
-          MPI_Recv(&temp, 1, MPI_DOUBLE, source, 0, MPI_COMM_WORLD, &status);
-          if (temp > par_elapsed) par_elapsed = temp;
-       }
-    } else {
-       MPI_Send(&par_elapsed, 1, MPI_DOUBLE, 0, 0, MPI_COMM_WORLD);
-    }
-
     /* Print the result */
     if (my_rank == 0) {
-//      printf("With n = %d trapezoids, our estimate\n",
-//          n);
-//      printf("of the area from %f to %f = %23.16e\n",
-//          a, b, total);
+        total = stats[AREA];
+        printf("With n = %d trapezoids, our estimate\n",
+            n);
+        printf("of the area from %f to %f = %23.16e\n",
+            a, b, total);
+#       ifdef _OPENMP
+        printf("Threads per process = %d\n", omp_get_max_threads());
+#       endif
         printf("Parallel elapsed time = %e seconds\n", par_elapsed);
+        printf("Trap time per process:  min = %e, avg = %e, max = %e\n",
+            stats[T_MIN], stats[T_SUM]/p, stats[T_MAX]);
+        printf("Load imbalance (max/avg) = %f\n",
+            stats[T_SUM] > 0.0 ? stats[T_MAX]/(stats[T_SUM]/p) : 1.0);
     }
 
     if (my_rank == 0) {
@@ -138,40 +499,493 @@ int main(int argc, char** argv) {
         printf("Speedup = %e\n", ser_elapsed/par_elapsed);
         printf("Effciency = %e\n", ser_elapsed/(par_elapsed*p));
     }
-
-    /* Shut down MPI */
-    MPI_Finalize();
-
-    return 0;
-} /*  main  */
+}  /* Run_trap */
 
 /*------------------------------------------------------------------
  * Function:     Get_data
- * Purpose:      Read in the data on process 0 and send to other
- *               processes
- * Input args:   p, my_rank
+ * Purpose:      Get a, b and n on process 0 and broadcast them
+ * Input args:   argc, argv:  a, b and n, if they're on the command
+ *                   line, start at argv[optind]
+ *               cfg_file:  config file from -c, or NULL
+ *               my_rank
  * Output args:  a_p, b_p, n_p
+ * Note:         If the input is bad, every process quits.
  */
-void Get_data(int p, int my_rank, double* a_p, double* b_p, int* n_p) {
-   int        q;
-   MPI_Status status;
+void Get_data(int argc, char* argv[], char* cfg_file, int my_rank,
+        double* a_p, double* b_p, int* n_p) {
+   const char*  keys[3] = {"a", "b", "n"};
+   double       vals[3];
+   trap_data_t  data;
+   MPI_Datatype data_mpi_t;
 
    if (my_rank == 0) {
-      printf("Enter a, b, and n\n");
-      scanf("%lf %lf %d", a_p, b_p, n_p);
-
-      for (q = 1; q < p; q++) {
-         MPI_Send(a_p, 1, MPI_DOUBLE, q, 0, MPI_COMM_WORLD);
-         MPI_Send(b_p, 1, MPI_DOUBLE, q, 0, MPI_COMM_WORLD);
-         MPI_Send(n_p, 1, MPI_INT, q, 0, MPI_COMM_WORLD);
+      data.n = 0;
+      if (argc - optind == 3) {
+         data.a = strtod(argv[optind], NULL);
+         data.b = strtod(argv[optind+1], NULL);
+         data.n = Arg_int(argv[optind+2]);
+      } else if (cfg_file != NULL) {
+         if (Read_config(cfg_file, keys, vals, 3) == 0) {
+            data.a = vals[0];
+            data.b = vals[1];
+            data.n = Config_int(vals[2]);
+         } else {
+            fprintf(stderr, "Can't get a, b and n from %s\n", cfg_file);
+         }
+      } else {
+         printf("Enter a, b, and n\n");
+         if (scanf("%lf %lf %d", &data.a, &data.b, &data.n) != 3)
+            data.n = 0;
       }
-   } else {
-      MPI_Recv(a_p, 1, MPI_DOUBLE, 0, 0, MPI_COMM_WORLD, &status);
-      MPI_Recv(b_p, 1, MPI_DOUBLE, 0, 0, MPI_COMM_WORLD, &status);
-      MPI_Recv(n_p, 1, MPI_INT, 0, 0, MPI_COMM_WORLD, &status);
    }
+
+   Build_mpi_type(&data, &data_mpi_t);
+   MPI_Bcast(&data, 1, data_mpi_t, 0, MPI_COMM_WORLD);
+   MPI_Type_free(&data_mpi_t);
+
+   if (data.n < 1) {
+      if (my_rank == 0)
+         fprintf(stderr, "n must be a positive int\n");
+      MPI_Finalize();
+      exit(0);
+   }
+   *a_p = data.a;
+   *b_p = data.b;
+   *n_p = data.n;
 }  /* Get_data */
 
+/*------------------------------------------------------------------
+ * Function:     Build_mpi_type
+ * Purpose:      Build a derived datatype for a trap_data_t, so a, b
+ *               and n can be sent in one message
+ * Input arg:    data_p:  any trap_data_t, used to find the offsets
+ * Output arg:   data_mpi_t_p:  the committed datatype
+ */
+void Build_mpi_type(trap_data_t* data_p, MPI_Datatype* data_mpi_t_p) {
+   int          blocklengths[2] = {2, 1};
+   MPI_Datatype types[2] = {MPI_DOUBLE, MPI_INT};
+   MPI_Aint     base, displacements[2];
+
+   MPI_Get_address(data_p, &base);
+   MPI_Get_address(&data_p->a, &displacements[0]);
+   MPI_Get_address(&data_p->n, &displacements[1]);
+   displacements[0] -= base;
+   displacements[1] -= base;
+   MPI_Type_create_struct(2, blocklengths, displacements, types,
+         data_mpi_t_p);
+   MPI_Type_commit(data_mpi_t_p);
+}  /* Build_mpi_type */
+
+/*------------------------------------------------------------------
+ * Function:     Read_config
+ * Purpose:      Read "key = value" lines from a file.  Blank lines
+ *               and anything after a # are ignored.
+ * Input args:   file_name
+ *               keys:  the keys to look for
+ *               n_keys:  how many there are
+ * Output arg:   vals:  vals[k] is the value given for keys[k]
+ * Return val:   0 if every key was given a value, -1 if not, or if
+ *               the file can't be read or has a line that isn't
+ *               "key = value" for one of the keys
+ */
+int Read_config(char* file_name, const char* keys[], double vals[],
+        int n_keys) {
+   FILE*  fp = fopen(file_name, "r");
+   char   line[256], key[64];
+   char*  hash;
+   double val;
+   int    k, found = 0, seen[16] = {0};
+
+   if (fp == NULL || n_keys > 16) {
+      if (fp != NULL) fclose(fp);
+      return -1;
+   }
+   while (fgets(line, sizeof(line), fp) != NULL) {
+      if ((hash = strchr(line, '#')) != NULL) *hash = '\0';
+      if (sscanf(line, " %63[^= \t] = %lf", key, &val) != 2) {
+         if (sscanf(line, " %63s", key) == 1) break;   /* Not blank */
+         continue;
+      }
+      for (k = 0; k < n_keys; k++)
+         if (strcmp(key, keys[k]) == 0) break;
+      if (k == n_keys) break;
+      vals[k] = val;
+      if (!seen[k]) found++;
+      seen[k] = 1;
+   }
+   if (!feof(fp)) found = -1;
+   fclose(fp);
+
+   return (found == n_keys) ? 0 : -1;
+}  /* Read_config */
+
+/*------------------------------------------------------------------
+ * Function:     Config_int
+ * Purpose:      Convert a value from Read_config to a positive int
+ * Input arg:    val
+ * Return val:   val, if it's a whole number from 1 to INT_MAX, and 0
+ *               (bad input) if it isn't
+ */
+int Config_int(double val) {
+   if (val >= 1.0 && val <= INT_MAX && val == floor(val))
+      return (int) val;
+   return 0;
+}  /* Config_int */
+
+/*------------------------------------------------------------------
+ * Function:     Arg_int
+ * Purpose:      Convert a command line argument to a positive int
+ *               with the same check as Config_int
+ * Input arg:    str
+ * Return val:   The value, if all of str is a whole number from 1 to
+ *               INT_MAX, and 0 (bad input) if it isn't
+ */
+int Arg_int(const char* str) {
+   char*  end;
+   double val = strtod(str, &end);
+
+   if (end == str || *end != '\0') return 0;
+   return Config_int(val);
+}  /* Arg_int */
+
+/*------------------------------------------------------------------
+ * Function:     Reduce_results
+ * Purpose:      Combine the areas and Trap times of all the
+ *               processes on process 0
+ * Input args:   my_rank, p, comm
+ * In/out arg:   stats:  in:  my area and my time in T_SUM, T_MIN
+ *                       and T_MAX.
+ *                       out:  on process 0, the total area, and the
+ *                       sum, min and max of the times.  Meaningless
+ *                       on the other processes.
+ *
+ * Notes:
+ *    1.  Uses tree structured communication, pairing processes with
+ *        bitwise exclusive or as in globalSum.c, so process 0 does
+ *        log2(p) receives instead of p-1.
+ *    2.  All N_STATS values go in one message at each step.
+ */
+void Reduce_results(double stats[], int my_rank, int p, MPI_Comm comm) {
+    double   temp[N_STATS];
+    int      partner;
+    unsigned bitmask = 1;
+
+    while (bitmask < (unsigned) p) {
+        partner = my_rank ^ bitmask;
+        if (my_rank < partner) {
+            if (partner < p) {
+                MPI_Recv(temp, N_STATS, MPI_DOUBLE, partner, 0, comm,
+                    MPI_STATUS_IGNORE);
+                stats[AREA] += temp[AREA];
+                stats[T_SUM] += temp[T_SUM];
+                if (temp[T_MIN] < stats[T_MIN]) stats[T_MIN] = temp[T_MIN];
+                if (temp[T_MAX] > stats[T_MAX]) stats[T_MAX] = temp[T_MAX];
+            }
+        } else {
+            MPI_Send(stats, N_STATS, MPI_DOUBLE, partner, 0, comm);
+            break;
+        }
+        bitmask <<= 1;
+    }
+}  /* Reduce_results */
+
+/*------------------------------------------------------------------
+ * Function:     Split_node_comms
+ * Purpose:      Split comm into one communicator per node, and one
+ *               with process 0 of each node's communicator
+ * Input arg:    comm
+ * Output args:  node_comm_p:  the processes on my node
+ *               leader_comm_p:  the node leaders, MPI_COMM_NULL on
+ *                   other processes
+ * Note:         Both keep the order of comm, so process 0 of comm is
+ *               process 0 of its node_comm and of leader_comm.
+ */
+void Split_node_comms(MPI_Comm comm, MPI_Comm* node_comm_p,
+        MPI_Comm* leader_comm_p) {
+    int my_rank, node_rank;
+
+    MPI_Comm_rank(comm, &my_rank);
+    MPI_Comm_split_type(comm, MPI_COMM_TYPE_SHARED, my_rank,
+        MPI_INFO_NULL, node_comm_p);
+    MPI_Comm_rank(*node_comm_p, &node_rank);
+    MPI_Comm_split(comm, node_rank == 0 ? 0 : MPI_UNDEFINED, my_rank,
+        leader_comm_p);
+}  /* Split_node_comms */
+
+/*------------------------------------------------------------------
+ * Function:     Node_reduce
+ * Purpose:      Reduce stats (see Reduce_results) to process 0,
+ *               first on each node and then among the node leaders
+ * In/out arg:   stats:  in:  my contribution, out:  on process 0 of
+ *                   the original comm, the result
+ * Input args:   node_comm, leader_comm:  from Split_node_comms
+ */
+void Node_reduce(double stats[], MPI_Comm node_comm, MPI_Comm leader_comm) {
+    int rank, size;
+
+    MPI_Comm_rank(node_comm, &rank);
+    MPI_Comm_size(node_comm, &size);
+    Reduce_results(stats, rank, size, node_comm);
+    if (leader_comm != MPI_COMM_NULL) {
+        MPI_Comm_rank(leader_comm, &rank);
+        MPI_Comm_size(leader_comm, &size);
+        Reduce_results(stats, rank, size, leader_comm);
+    }
+}  /* Node_reduce */
+
+/*------------------------------------------------------------------
+ * Function:     Free_node_comms
+ * Purpose:      Free the communicators made by Split_node_comms
+ */
+void Free_node_comms(MPI_Comm* node_comm_p, MPI_Comm* leader_comm_p) {
+    MPI_Comm_free(node_comm_p);
+    if (*leader_comm_p != MPI_COMM_NULL)
+        MPI_Comm_free(leader_comm_p);
+}  /* Free_node_comms */
+
+/*------------------------------------------------------------------
+ * Function:     Get_args
+ * Purpose:      Get the command line options
+ * Input args:   argc, argv
+ * Output args:  bench_p:  1 for benchmark mode
+ *               reps_p:  number of timed runs per configuration
+ *               warmups_p:  number of untimed runs first
+ *               method_p:  TRAP, ADAPT, SIMPSON or ROMBERG
+ *               tol_p:  error tolerance for all but TRAP
+ *               which:  indices in Integrands of the integrands to do
+ *               n_which_p:  how many there are
+ *               threads_p:  threads per process, 0 for the default
+ *               cfg_file_p:  config file from -c, or NULL
+ * Note:         a, b and n, if given, are left at argv[optind]
+ */
+void Get_args(int argc, char* argv[], int* bench_p, int* reps_p,
+        int* warmups_p, int* method_p, double* tol_p, int which[],
+        int* n_which_p, int* threads_p, char** cfg_file_p) {
+    int   c, k;
+    char* name;
+
+    *bench_p = 0;
+    *reps_p = 10;
+    *warmups_p = 2;
+    *method_p = TRAP;
+    *tol_p = 1.0e-10;
+    which[0] = 0;
+    *n_which_p = 1;
+    *threads_p = 0;
+    *cfg_file_p = NULL;
+    while ((c = getopt(argc, argv, "br:w:m:e:f:t:c:")) != -1) {
+        switch (c) {
+            case 'b':
+                *bench_p = 1;
+                break;
+            case 'r':
+                *reps_p = strtol(optarg, NULL, 10);
+                if (*reps_p < 1) Usage(argv[0]);
+                break;
+            case 'w':
+                *warmups_p = strtol(optarg, NULL, 10);
+                if (*warmups_p < 0) Usage(argv[0]);
+                break;
+            case 'm':
+                if (strcmp(optarg, "trap") == 0)
+                    *method_p = TRAP;
+                else if (strcmp(optarg, "adapt") == 0)
+                    *method_p = ADAPT;
+                else if (strcmp(optarg, "simpson") == 0)
+                    *method_p = SIMPSON;
+                else if (strcmp(optarg, "romberg") == 0)
+                    *method_p = ROMBERG;
+                else
+                    Usage(argv[0]);
+                break;
+            case 'e':
+                *tol_p = strtod(optarg, NULL);
+                if (*tol_p <= 0.0) Usage(argv[0]);
+                break;
+            case 'f':
+                *n_which_p = 0;
+                for (name = strtok(optarg, ","); name != NULL;
+                        name = strtok(NULL, ",")) {
+                    if (strcmp(name, "all") == 0) {
+                        for (k = 0; k < N_INTEGRANDS
+                                && *n_which_p < MAX_BATCH; k++)
+                            which[(*n_which_p)++] = k;
+                        continue;
+                    }
+                    for (k = 0; k < N_INTEGRANDS; k++)
+                        if (strcmp(name, Integrands[k].name) == 0) break;
+                    if (k == N_INTEGRANDS || *n_which_p == MAX_BATCH)
+                        Usage(argv[0]);
+                    which[(*n_which_p)++] = k;
+                }
+                if (*n_which_p == 0) Usage(argv[0]);
+                break;
+            case 't':
+                *threads_p = strtol(optarg, NULL, 10);
+                if (*threads_p < 1 || *threads_p > MAX_THREADS)
+                    Usage(argv[0]);
+                break;
+            case 'c':
+                *cfg_file_p = optarg;
+                break;
+            default:
+                Usage(argv[0]);
+        }
+    }
+    if (argc - optind != 0 && argc - optind != 3) Usage(argv[0]);
+    if (*bench_p && *method_p != TRAP) Usage(argv[0]);
+}  /* Get_args */
+
+/*------------------------------------------------------------------
+ * Function:     Usage
+ * Purpose:      Print a message explaining how to run the program
+ * Input arg:    prog_name
+ */
+void Usage(char* prog_name) {
+    int k;
+
+    fprintf(stderr, "usage: mpiexec -n <p> %s [-b] [-r <reps>] [-w <warmups>]\n",
+        prog_name);
+    fprintf(stderr, "          [-m <method>] [-e <tol>] [-f <integrand>,...]"
+        " [-t <threads>]\n");
+    fprintf(stderr, "          [-c <config file>] [<a> <b> <n>]\n");
+    fprintf(stderr, "   -b runs the strong/weak scaling benchmark\n");
+    fprintf(stderr, "   -r timed runs per configuration, -w warm-up runs\n");
+    fprintf(stderr, "   -m trap, adapt, simpson or romberg\n");
+    fprintf(stderr, "   -e tolerance for all methods but trap\n");
+    fprintf(stderr, "   -b only works with trap\n");
+    fprintf(stderr, "   -t OpenMP threads per process\n");
+    fprintf(stderr, "   -c file with a = ..., b = ..., n = ... lines\n");
+    fprintf(stderr, "   with neither -c nor a b n, process 0 prompts for them\n");
+    fprintf(stderr, "   -f integrands (or all):\n");
+    for (k = 0; k < N_INTEGRANDS; k++)
+        fprintf(stderr, "      %-8s f(x) = %s\n", Integrands[k].name,
+            Integrands[k].formula);
+    exit(0);
+}  /* Usage */
+
+/*------------------------------------------------------------------
+ * Function:     Run_benchmark
+ * Purpose:      Time the parallel trapezoidal rule on 1, 2, 4, ..., p
+ *               processes for strong and weak scaling, and print CSV
+ *               on process 0
+ * Input args:   a, b:  the interval
+ *               n:  the total (strong) or per process (weak) number
+ *                   of trapezoids
+ *               reps, warmups, my_rank, p
+ *               print_header:  print the CSV header line first
+ */
+void Run_benchmark(double a, double b, int n, int reps, int warmups,
+        int my_rank, int p, int print_header) {
+    int       mode, q, last;
+    long long n_total;
+    double*   times = malloc(reps*sizeof(double));
+    double    median, base = 0.0, speedup, eff;
+    MPI_Comm  comm_q;
+
+    if (my_rank == 0 && print_header)
+        printf("integrand,mode,p,n,reps,median_s,p10_s,p90_s,min_s,max_s,"
+               "speedup,efficiency\n");
+
+    for (mode = 0; mode < 2; mode++) {   /* 0 = strong, 1 = weak */
+        for (q = 1, last = 0; !last; q = (2*q < p) ? 2*q : p) {
+            last = (q == p);
+            n_total = (mode == 0) ? n : (long long) n*q;
+            MPI_Comm_split(MPI_COMM_WORLD, my_rank < q ? 0 : MPI_UNDEFINED,
+                my_rank, &comm_q);
+            if (comm_q != MPI_COMM_NULL) {
+                Time_trap(a, b, n_total, reps, warmups, times, comm_q);
+                MPI_Comm_free(&comm_q);
+            }
+
+            if (my_rank == 0) {
+                qsort(times, reps, sizeof(double), Compare_double);
+                median = Percentile(times, reps, 50.0);
+                if (q == 1) base = median;
+                if (mode == 0) {
+                    speedup = base/median;
+                    eff = speedup/q;
+                } else {
+                    eff = base/median;
+                    speedup = q*eff;
+                }
+                printf("%s,%s,%d,%lld,%d,%e,%e,%e,%e,%e,%f,%f\n",
+                    Integrand->name, mode == 0 ? "strong" : "weak", q,
+                    n_total, reps, median,
+                    Percentile(times, reps, 10.0),
+                    Percentile(times, reps, 90.0), times[0],
+                    times[reps-1], speedup, eff);
+                fflush(stdout);
+            }
+            MPI_Barrier(MPI_COMM_WORLD);
+        }
+    }
+    free(times);
+}  /* Run_benchmark */
+
+/*------------------------------------------------------------------
+ * Function:     Time_trap
+ * Purpose:      Run the parallel trapezoidal rule warmups + reps
+ *               times on the processes in comm
+ * Input args:   a, b:  the interval
+ *               n:  the total number of trapezoids
+ *               reps, warmups
+ *               comm:  the processes to use
+ * Output arg:   times:  on process 0 of comm, the elapsed time of
+ *                       each timed run
+ */
+void Time_trap(double a, double b, long long n, int reps, int warmups,
+        double times[], MPI_Comm comm) {
+    int      q, my_rank, r, local_n;
+    double   h, local_a, local_b, start, stats[N_STATS];
+    MPI_Comm node_comm, leader_comm;
+
+    MPI_Comm_size(comm, &q);
+    MPI_Comm_rank(comm, &my_rank);
+    Split_node_comms(comm, &node_comm, &leader_comm);
+    h = (b-a)/n;
+    local_n = (int) (n/q);
+    local_a = a + my_rank*local_n*h;
+    local_b = local_a + local_n*h;
+
+    for (r = 0; r < warmups + reps; r++) {
+        MPI_Barrier(comm);
+        start = MPI_Wtime();
+        stats[AREA] = Trap(local_a, local_b, local_n, h);
+        stats[T_SUM] = stats[T_MIN] = stats[T_MAX] = MPI_Wtime() - start;
+        Node_reduce(stats, node_comm, leader_comm);
+        if (my_rank == 0 && r >= warmups)
+            times[r - warmups] = MPI_Wtime() - start;
+    }
+    Free_node_comms(&node_comm, &leader_comm);
+}  /* Time_trap */
+
+/*------------------------------------------------------------------
+ * Function:     Compare_double
+ * Purpose:      Compare two doubles for qsort
+ */
+int Compare_double(const void* x_p, const void* y_p) {
+    double x = *((const double*) x_p);
+    double y = *((const double*) y_p);
+
+    return (x > y) - (x < y);
+}  /* Compare_double */
+
+/*------------------------------------------------------------------
+ * Function:     Percentile
+ * Purpose:      Linearly interpolated percentile of sorted data
+ * Input args:   sorted:  the data in increasing order
+ *               count:  the number of values
+ *               pct:  the percentile, 0 to 100
+ */
+double Percentile(double sorted[], int count, double pct) {
+    double pos = pct/100.0*(count - 1);
+    int    lo = (int) pos;
+
+    if (lo >= count - 1) return sorted[count - 1];
+    return sorted[lo] + (pos - lo)*(sorted[lo+1] - sorted[lo]);
+}  /* Percentile */
+
 /*------------------------------------------------------------------
  * Function:     Trap
  * Purpose:      Estimate a definite area using the trapezoidal
@@ -189,20 +1003,102 @@ double Trap(
           int     local_n   /* in */,
           double  h         /* in */) {
     double area;   /* Store result in area  */
-    double x;
-    int i;
 
-    area = (f(local_a) + f(local_b))/2.0;
-    x = local_a;
-    for (i = 1; i <= local_n-1; i++) {
-        x = local_a + i*h;
-        area = area + f(x);
-    }
+    area = (Integrand->f(local_a) + Integrand->f(local_b))/2.0;
+    if (local_n > 1)
+        area += Sum_threaded(local_a, h, 1, local_n-1);
     area = area*h;
 
     return area;
 } /*  Trap  */
 
+/*------------------------------------------------------------------
+ * Function:     Sum_f
+ * Purpose:      Add up f(x0 + i*h) for i = first, ..., first+count-1:
+ *               the Sum for exp_sin
+ * Input args:   x0, h, first, count
+ * Return val:   the sum
+ * Note:         The points go to F_batch TRAP_BATCH at a time, and
+ *               the values are added using 4 accumulators.
+ */
+double Sum_f(
+          double     x0     /* in */,
+          double     h      /* in */,
+          long long  first  /* in */,
+          long long  count  /* in */) {
+    double x[TRAP_BATCH], y[TRAP_BATCH];
+    double sum0 = 0.0, sum1 = 0.0, sum2 = 0.0, sum3 = 0.0;
+    long long i;
+    int j, batch;
+
+    if (F_batch == NULL)
+        F_batch = Select_f_batch();
+
+    for (i = first; i < first + count; i += TRAP_BATCH) {
+        batch = (first + count - i < TRAP_BATCH) ?
+            first + count - i : TRAP_BATCH;
+        for (j = 0; j < batch; j++)
+            x[j] = x0 + (i+j)*h;
+        F_batch(x, y, batch);
+        for (j = 0; j + 4 <= batch; j += 4) {
+            sum0 += y[j];
+            sum1 += y[j+1];
+            sum2 += y[j+2];
+            sum3 += y[j+3];
+        }
+        for (; j < batch; j++)
+            sum0 += y[j];
+    }
+
+    return (sum0 + sum1) + (sum2 + sum3);
+} /* Sum_f */
+
+/*------------------------------------------------------------------
+ * Function:     Sum_threaded
+ * Purpose:      Sum_integrand(x0, h, first, count), with the points
+ *               split in blocks among the OpenMP threads
+ * Input args:   x0, h, first, count
+ * Return val:   the sum
+ * Note:         Each thread writes its sum to its own padded entry
+ *               of Partial, and the master adds them in thread
+ *               order, so the result only depends on the number of
+ *               threads.  With one thread, too few points, or when
+ *               called from a parallel region, the calling thread
+ *               does all the work.
+ */
+double Sum_threaded(
+          double     x0     /* in */,
+          double     h      /* in */,
+          long long  first  /* in */,
+          long long  count  /* in */) {
+#   ifdef _OPENMP
+    int    thread_count = omp_get_max_threads();
+    int    t;
+    double total = 0.0;
+
+    if (thread_count > MAX_THREADS) thread_count = MAX_THREADS;
+    if (thread_count > 1 && count >= (long long) thread_count*TRAP_BATCH
+            && !omp_in_parallel()) {
+        for (t = 0; t < thread_count; t++)
+            Partial[t].sum = 0.0;
+#       pragma omp parallel num_threads(thread_count)
+        {
+            int       my_thread = omp_get_thread_num();
+            long long my_first, my_count;
+
+            Block_range(count, my_thread, omp_get_num_threads(),
+                &my_first, &my_count);
+            Partial[my_thread].sum = Sum_integrand(x0, h,
+                first + my_first, my_count);
+        }
+        for (t = 0; t < thread_count; t++)
+            total += Partial[t].sum;
+        return total;
+    }
+#   endif
+    return Sum_integrand(x0, h, first, count);
+} /* Sum_threaded */
+
 /*------------------------------------------------------------------
  * Function:    f
  * Purpose:     Compute value of function to be integrated
@@ -218,3 +1114,652 @@ double f(double x) {
 } /* f */
 
 
+
+/*------------------------------------------------------------------
+ * Function:     Run_adaptive
+ * Purpose:      Integrate f from a to b to within tol with adaptive
+ *               Gauss-Kronrod quadrature, process 0 acting as the
+ *               manager, and print the result on process 0
+ * Input args:   a, b:  the interval
+ *               n:  number of subintervals to start with
+ *               tol:  absolute error tolerance
+ *               my_rank, p, comm
+ */
+void Run_adaptive(double a, double b, int n, double tol, int my_rank,
+        int p, MPI_Comm comm) {
+    double tol_density = tol/(b - a);
+    double min_len = 1.0e-12*(b - a);
+    double area, err, start, elapsed;
+    long*  rules = NULL;
+    long   total = 0, min_rules, max_rules;
+    int    q;
+
+    MPI_Barrier(comm);
+    start = MPI_Wtime();
+    if (my_rank == 0) {
+        rules = calloc(p, sizeof(long));
+        Adapt_manager(a, b, n, tol_density, min_len, &area, &err, rules,
+            p, comm);
+    } else {
+        Adapt_worker(tol_density, min_len, comm);
+    }
+    elapsed = MPI_Wtime() - start;
+
+    if (my_rank == 0) {
+        min_rules = max_rules = rules[p > 1 ? 1 : 0];
+        for (q = (p > 1 ? 1 : 0); q < p; q++) {
+            total += rules[q];
+            if (rules[q] < min_rules) min_rules = rules[q];
+            if (rules[q] > max_rules) max_rules = rules[q];
+        }
+        printf("With tol = %e and %d starting subintervals, our estimate\n",
+            tol, n);
+        printf("of the area from %f to %f = %23.16e\n", a, b, area);
+        printf("Estimated error = %e\n", err);
+        printf("Gauss-Kronrod rules = %ld (%ld evaluations of f)\n",
+            total, 15*total);
+        printf("Rules per worker:  min = %ld, max = %ld\n", min_rules,
+            max_rules);
+        printf("Elapsed time = %e seconds\n", elapsed);
+        free(rules);
+    }
+}  /* Run_adaptive */
+
+/*------------------------------------------------------------------
+ * Function:     Gauss_kronrod
+ * Purpose:      Apply the 15 point Gauss-Kronrod rule to f on
+ *               [left, right]
+ * Input args:   left, right
+ * Output arg:   err_p:  |K15 - G7|
+ * Return val:   the K15 estimate
+ */
+double Gauss_kronrod(
+          double   left    /* in  */,
+          double   right   /* in  */,
+          double*  err_p   /* out */) {
+    /* Nodes in decreasing order, and their Kronrod weights; the     */
+    /* Gauss nodes are the odd numbered ones (and 0, the last)       */
+    static const double xgk[8] = {
+        0.991455371120812639206854697526329,
+        0.949107912342758524526189684047851,
+        0.864864423359769072789712788640926,
+        0.741531185599394439863864773280788,
+        0.586087235467691130294144845693013,
+        0.405845151377397166906606412076961,
+        0.207784955007898467600689403773245,
+        0.000000000000000000000000000000000};
+    static const double wgk[8] = {
+        0.022935322010529224963732008058970,
+        0.063092092629978553290700663189204,
+        0.104790010322250183839876322541518,
+        0.140653259715525918745189590510238,
+        0.169004726639267902826583426598550,
+        0.190350578064785409913256402421014,
+        0.204432940075298892414161999234649,
+        0.209482141084727828012999174891714};
+    static const double wg[4] = {
+        0.129484966168869693270611432679082,
+        0.279705391489276667901467771423780,
+        0.381830050505118944950369775488975,
+        0.417959183673469387755102040816327};
+    double center = 0.5*(left + right);
+    double half = 0.5*(right - left);
+    double x[15], y[15];
+    double kronrod, gauss;
+    int j;
+
+    /* x[j] and x[14-j] are the pair of points for node j */
+    for (j = 0; j < 7; j++) {
+        x[j] = center - half*xgk[j];
+        x[14-j] = center + half*xgk[j];
+    }
+    x[7] = center;
+    Integrand->batch(x, y, 15);
+
+    kronrod = wgk[7]*y[7];
+    gauss = wg[3]*y[7];
+    for (j = 0; j < 7; j++) {
+        kronrod += wgk[j]*(y[j] + y[14-j]);
+        if (j % 2 == 1)
+            gauss += wg[j/2]*(y[j] + y[14-j]);
+    }
+    *err_p = fabs((kronrod - gauss)*half);
+
+    return kronrod*half;
+}  /* Gauss_kronrod */
+
+/*------------------------------------------------------------------
+ * Function:     Adapt_task
+ * Purpose:      Refine [left, right] until each piece meets the
+ *               tolerance or ADAPT_TASK_MAX rules have been applied
+ * Input args:   left, right
+ *               tol_density:  a piece of length len is done when its
+ *                   error estimate is <= tol_density*len
+ *               min_len:  pieces shorter than this are done anyway
+ * Output arg:   reply:  reply[R_AREA] and reply[R_ERR] are the area and
+ *                   error of the finished pieces, reply[R_RULES] the
+ *                   number of rules applied, and starting at R_HDR the
+ *                   endpoints of the unfinished pieces
+ * Return val:   number of entries of reply used
+ */
+int Adapt_task(
+          double  left         /* in  */,
+          double  right        /* in  */,
+          double  tol_density  /* in  */,
+          double  min_len      /* in  */,
+          double  reply[]      /* out */) {
+    double stack[2*ADAPT_STACK_MAX];
+    double l, r, mid, area, err;
+    int    top = 0, rules = 0;
+
+    reply[R_AREA] = reply[R_ERR] = 0.0;
+    stack[top++] = left;
+    stack[top++] = right;
+    while (top > 0 && rules < ADAPT_TASK_MAX) {
+        r = stack[--top];
+        l = stack[--top];
+        area = Gauss_kronrod(l, r, &err);
+        rules++;
+        if (err <= tol_density*(r - l) || r - l <= min_len
+                || top + 4 > 2*ADAPT_STACK_MAX) {
+            reply[R_AREA] += area;
+            reply[R_ERR] += err;
+        } else {
+            mid = 0.5*(l + r);
+            stack[top++] = mid;
+            stack[top++] = r;
+            stack[top++] = l;
+            stack[top++] = mid;
+        }
+    }
+    reply[R_RULES] = rules;
+    memcpy(reply + R_HDR, stack, top*sizeof(double));
+
+    return R_HDR + top;
+}  /* Adapt_task */
+
+/*------------------------------------------------------------------
+ * Function:     Adapt_manager
+ * Purpose:      Hand out subintervals of [a, b] to idle workers until
+ *               none are left and every worker has reported back.  If
+ *               there are no workers, do the work here.
+ * Input args:   a, b, n:  start with n equal subintervals of [a, b]
+ *               tol_density, min_len:  see Adapt_task
+ *               p, comm
+ * Output args:  area_p, err_p:  the estimate and its error estimate
+ *               rules:  rules[q] is the number of Gauss-Kronrod rules
+ *                   process q applied
+ */
+void Adapt_manager(double a, double b, int n, double tol_density,
+        double min_len, double* area_p, double* err_p, long rules[],
+        int p, MPI_Comm comm) {
+    double*    queue;         /* endpoints of the pieces to do     */
+    int        q_len, q_max;  /* number of doubles in use/allocated */
+    int*       idle;
+    int        n_idle = 0, busy = 0, count, src, q, i;
+    double     reply[REPLY_MAX];
+    MPI_Status status;
+
+    q_max = 2*n + REPLY_MAX;
+    queue = malloc(q_max*sizeof(double));
+    for (i = 0; i < n; i++) {
+        queue[2*i] = a + i*(b - a)/n;
+        queue[2*i+1] = (i == n-1) ? b : a + (i+1)*(b - a)/n;
+    }
+    q_len = 2*n;
+    idle = malloc(p*sizeof(int));
+    for (q = p-1; q >= 1; q--)
+        idle[n_idle++] = q;
+
+    *area_p = *err_p = 0.0;
+    while (q_len > 0 || busy > 0) {
+        if (p == 1) {
+            q_len -= 2;
+            count = Adapt_task(queue[q_len], queue[q_len+1], tol_density,
+                min_len, reply);
+            src = 0;
+        } else {
+            while (q_len > 0 && n_idle > 0) {
+                q_len -= 2;
+                MPI_Send(queue + q_len, 2, MPI_DOUBLE, idle[--n_idle],
+                    WORK_TAG, comm);
+                busy++;
+            }
+            MPI_Recv(reply, REPLY_MAX, MPI_DOUBLE, MPI_ANY_SOURCE,
+                RESULT_TAG, comm, &status);
+            MPI_Get_count(&status, MPI_DOUBLE, &count);
+            src = status.MPI_SOURCE;
+            idle[n_idle++] = src;
+            busy--;
+        }
+        *area_p += reply[R_AREA];
+        *err_p += reply[R_ERR];
+        rules[src] += (long) reply[R_RULES];
+
+        if (q_len + count - R_HDR > q_max) {
+            q_max = 2*(q_len + count);
+            queue = realloc(queue, q_max*sizeof(double));
+        }
+        memcpy(queue + q_len, reply + R_HDR,
+            (count - R_HDR)*sizeof(double));
+        q_len += count - R_HDR;
+    }
+
+    for (q = 1; q < p; q++)
+        MPI_Send(NULL, 0, MPI_DOUBLE, q, STOP_TAG, comm);
+    free(idle);
+    free(queue);
+}  /* Adapt_manager */
+
+/*------------------------------------------------------------------
+ * Function:     Adapt_worker
+ * Purpose:      Refine the subintervals the manager (process 0) sends
+ *               until it says to stop
+ * Input args:   tol_density, min_len:  see Adapt_task
+ *               comm
+ */
+void Adapt_worker(double tol_density, double min_len, MPI_Comm comm) {
+    double     task[2], reply[REPLY_MAX];
+    int        count;
+    MPI_Status status;
+
+    while (1) {
+        MPI_Recv(task, 2, MPI_DOUBLE, 0, MPI_ANY_TAG, comm, &status);
+        if (status.MPI_TAG == STOP_TAG) break;
+        count = Adapt_task(task[0], task[1], tol_density, min_len, reply);
+        MPI_Send(reply, count, MPI_DOUBLE, 0, RESULT_TAG, comm);
+    }
+}  /* Adapt_worker */
+
+/*------------------------------------------------------------------
+ * Function:     Run_extrapolated
+ * Purpose:      Integrate f from a to b with Simpson's rule or
+ *               Romberg integration, halving h until the estimate
+ *               changes by at most tol, and print the result on
+ *               process 0
+ * Input args:   a, b:  the interval
+ *               n:  number of trapezoids to start with
+ *               tol:  absolute error tolerance
+ *               method:  SIMPSON or ROMBERG
+ *               my_rank, p, comm
+ */
+void Run_extrapolated(double a, double b, int n, double tol, int method,
+        int my_rank, int p, MPI_Comm comm) {
+    double    prev[ROMBERG_MAX+1], cur[ROMBERG_MAX+1];  /* Romberg rows */
+    double    h = (b - a)/n;
+    double    local_sum, sum, four_j, est, change = 0.0, start, elapsed;
+    long long n_k = n, first, count, evals;
+    int       k, j, done = 0;
+
+    MPI_Barrier(comm);
+    start = MPI_Wtime();
+
+    /* Level 0:  the trapezoidal rule with n trapezoids.  Process 0 */
+    /* adds the endpoints, and everyone does a block of the rest    */
+    Block_range(n_k - 1, my_rank, p, &first, &count);
+    local_sum = Sum_threaded(a, h, first + 1, count);
+    if (my_rank == 0)
+        local_sum += (Integrand->f(a) + Integrand->f(b))/2.0;
+    MPI_Allreduce(&local_sum, &sum, 1, MPI_DOUBLE, MPI_SUM, comm);
+    cur[0] = h*sum;
+    evals = n_k + 1;
+    if (my_rank == 0) {
+        printf("%5s %15s %23s %13s\n", "level", "n", "estimate", "change");
+        printf("%5d %15lld %23.16e\n", 0, n_k, cur[0]);
+    }
+
+    for (k = 1; k <= ROMBERG_MAX && !done; k++) {
+        memcpy(prev, cur, k*sizeof(double));
+
+        /* The new points are the midpoints of the current trapezoids */
+        Block_range(n_k, my_rank, p, &first, &count);
+        local_sum = Sum_threaded(a + h/2.0, h, first, count);
+        MPI_Allreduce(&local_sum, &sum, 1, MPI_DOUBLE, MPI_SUM, comm);
+        evals += n_k;
+        h /= 2.0;
+        n_k *= 2;
+        cur[0] = prev[0]/2.0 + h*sum;
+
+        /* Richardson extrapolation:  cur[1] is Simpson's rule */
+        four_j = 1.0;
+        for (j = 1; j <= k; j++) {
+            four_j *= 4.0;
+            cur[j] = cur[j-1] + (cur[j-1] - prev[j-1])/(four_j - 1.0);
+        }
+
+        if (method == SIMPSON) {
+            est = cur[1];
+            if (k >= 2) change = fabs(cur[1] - prev[1]);
+        } else {
+            est = cur[k];
+            if (k >= 2) change = fabs(cur[k] - prev[k-1]);
+        }
+        if (my_rank == 0) {
+            if (k >= 2)
+                printf("%5d %15lld %23.16e %13.6e\n", k, n_k, est, change);
+            else
+                printf("%5d %15lld %23.16e\n", k, n_k, est);
+        }
+        done = (k >= 2 && change <= tol);
+    }
+    elapsed = MPI_Wtime() - start;
+
+    if (my_rank == 0) {
+        printf("With %s and tol = %e, our estimate\n",
+            method == SIMPSON ? "Simpson's rule" : "Romberg integration",
+            tol);
+        printf("of the area from %f to %f = %23.16e\n", a, b, est);
+        if (!done)
+            printf("Did not reach the tolerance in %d levels\n",
+                ROMBERG_MAX);
+        printf("Evaluations of f = %lld\n", evals);
+        printf("Elapsed time = %e seconds\n", elapsed);
+    }
+}  /* Run_extrapolated */
+
+/*------------------------------------------------------------------
+ * Function:     Block_range
+ * Purpose:      Find my block of 0, 1, ..., total-1 when the total
+ *               is split as evenly as possible among p processes
+ * Input args:   total, my_rank, p
+ * Output args:  first_p:  my first index
+ *               count_p:  the size of my block
+ */
+void Block_range(long long total, int my_rank, int p, long long* first_p,
+        long long* count_p) {
+    long long quotient = total/p;
+    long long remainder = total % p;
+
+    if (my_rank < remainder) {
+        *count_p = quotient + 1;
+        *first_p = my_rank*(quotient + 1);
+    } else {
+        *count_p = quotient;
+        *first_p = my_rank*quotient + remainder;
+    }
+}  /* Block_range */
+
+/*------------------------------------------------------------------
+ * Function:    F_batch_ref
+ * Purpose:     Compute f at each of an array of points
+ * Input args:  x:  the points
+ *              count:  the number of points
+ * Output arg:  y:  y[i] = f(x[i])
+ */
+void F_batch_ref(
+          const double  x[]    /* in  */,
+          double        y[]    /* out */,
+          int           count  /* in  */) {
+    int i;
+
+    for (i = 0; i < count; i++)
+        y[i] = f(x[i]);
+} /* F_batch_ref */
+
+
+#ifdef HAVE_X86_SIMD
+/* sin:  x = k*pi/2 + r with |r| <= pi/4.  pi/2 is split in three so  */
+/* k*PIO2_1 and k*PIO2_2 are exact for |k| < 2^20.  The polynomials   */
+/* for sin(r) and cos(r) are the fdlibm ones.                         */
+#define PIO2_1  1.57079632673412561417e+00
+#define PIO2_2  6.07710050630396597660e-11
+#define PIO2_3  2.02226624871116645580e-21
+#define S1     -1.66666666666666324348e-01
+#define S2      8.33333333332248946124e-03
+#define S3     -1.98412698298579493134e-04
+#define S4      2.75573137070700676789e-06
+#define S5     -2.50507602534068634195e-08
+#define S6      1.58969099521155010221e-10
+#define C1      4.16666666666666019037e-02
+#define C2     -1.38888888888741095749e-03
+#define C3      2.48015872894767294178e-05
+#define C4     -2.75573143513906633035e-07
+#define C5      2.08757232129817482790e-09
+#define C6     -1.13596475577881948265e-11
+
+/* exp:  x = k*ln(2) + r with |r| <= ln(2)/2, exp(r) from its Taylor */
+/* series through r^13/13!, and 2^k put into the exponent bits.     */
+/* LN2_HI has enough trailing zeros that k*LN2_HI is exact.          */
+#define LN2_HI  6.93147180369123816490e-01
+#define LN2_LO  1.90821492927058770002e-10
+static const double Inv_fact[14] = {1.0, 1.0, 1.0/2, 1.0/6, 1.0/24,
+    1.0/120, 1.0/720, 1.0/5040, 1.0/40320, 1.0/362880, 1.0/3628800,
+    1.0/39916800, 1.0/479001600, 1.0/6227020800.0};
+
+/*------------------------------------------------------------------
+ * Function:    Sin_exp_avx2
+ * Purpose:     exp(sin(x)) on 4 doubles, |x| <= SIN_MAX_ARG
+ */
+__attribute__((target("avx2,fma")))
+static inline __m256d Sin_exp_avx2(__m256d x) {
+    __m256d k, r, z, ps, pc, s, c, e;
+    __m256i ki, odd, sign;
+    int     j;
+
+    /* sin */
+    k = _mm256_round_pd(_mm256_mul_pd(x, _mm256_set1_pd(M_2_PI)),
+            _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+    r = _mm256_fnmadd_pd(k, _mm256_set1_pd(PIO2_1), x);
+    r = _mm256_fnmadd_pd(k, _mm256_set1_pd(PIO2_2), r);
+    r = _mm256_fnmadd_pd(k, _mm256_set1_pd(PIO2_3), r);
+    z = _mm256_mul_pd(r, r);
+
+    ps = _mm256_fmadd_pd(_mm256_set1_pd(S6), z, _mm256_set1_pd(S5));
+    ps = _mm256_fmadd_pd(ps, z, _mm256_set1_pd(S4));
+    ps = _mm256_fmadd_pd(ps, z, _mm256_set1_pd(S3));
+    ps = _mm256_fmadd_pd(ps, z, _mm256_set1_pd(S2));
+    ps = _mm256_fmadd_pd(ps, z, _mm256_set1_pd(S1));
+    s = _mm256_fmadd_pd(_mm256_mul_pd(ps, z), r, r);
+
+    pc = _mm256_fmadd_pd(_mm256_set1_pd(C6), z, _mm256_set1_pd(C5));
+    pc = _mm256_fmadd_pd(pc, z, _mm256_set1_pd(C4));
+    pc = _mm256_fmadd_pd(pc, z, _mm256_set1_pd(C3));
+    pc = _mm256_fmadd_pd(pc, z, _mm256_set1_pd(C2));
+    pc = _mm256_fmadd_pd(pc, z, _mm256_set1_pd(C1));
+    c = _mm256_fmadd_pd(_mm256_mul_pd(pc, z), z,
+            _mm256_fnmadd_pd(_mm256_set1_pd(0.5), z, _mm256_set1_pd(1.0)));
+
+    /* Quadrant k mod 4:  sin r, cos r, -sin r, -cos r */
+    ki = _mm256_cvtepi32_epi64(_mm256_cvtpd_epi32(k));
+    odd = _mm256_cmpeq_epi64(_mm256_and_si256(ki, _mm256_set1_epi64x(1)),
+            _mm256_set1_epi64x(1));
+    sign = _mm256_slli_epi64(_mm256_and_si256(ki, _mm256_set1_epi64x(2)), 62);
+    s = _mm256_blendv_pd(s, c, _mm256_castsi256_pd(odd));
+    s = _mm256_xor_pd(s, _mm256_castsi256_pd(sign));
+
+    /* exp */
+    k = _mm256_round_pd(_mm256_mul_pd(s, _mm256_set1_pd(M_LOG2E)),
+            _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+    r = _mm256_fnmadd_pd(k, _mm256_set1_pd(LN2_HI), s);
+    r = _mm256_fnmadd_pd(k, _mm256_set1_pd(LN2_LO), r);
+    e = _mm256_set1_pd(Inv_fact[13]);
+    for (j = 12; j >= 0; j--)
+        e = _mm256_fmadd_pd(e, r, _mm256_set1_pd(Inv_fact[j]));
+    ki = _mm256_cvtepi32_epi64(_mm256_cvtpd_epi32(k));
+    ki = _mm256_slli_epi64(_mm256_add_epi64(ki, _mm256_set1_epi64x(1023)), 52);
+
+    return _mm256_mul_pd(e, _mm256_castsi256_pd(ki));
+}  /* Sin_exp_avx2 */
+
+
+/*------------------------------------------------------------------
+ * Function:    F_batch_avx2
+ * Purpose:     AVX2/FMA version of F_batch_ref, 4 points at a time.
+ *              Groups of points with an |x| too large for the vector
+ *              sin use libm.
+ * In args, out arg:  see F_batch_ref
+ */
+__attribute__((target("avx2,fma")))
+void F_batch_avx2(
+          const double  x[]    /* in  */,
+          double        y[]    /* out */,
+          int           count  /* in  */) {
+    __m256d xv, big;
+    __m256d abs_mask = _mm256_castsi256_pd(_mm256_set1_epi64x(0x7fffffffffffffffLL));
+    int i;
+
+    for (i = 0; i + 4 <= count; i += 4) {
+        xv = _mm256_loadu_pd(x + i);
+        big = _mm256_cmp_pd(_mm256_and_pd(xv, abs_mask),
+                _mm256_set1_pd(SIN_MAX_ARG), _CMP_GT_OQ);
+        if (_mm256_movemask_pd(big))
+            F_batch_ref(x + i, y + i, 4);
+        else
+            _mm256_storeu_pd(y + i, Sin_exp_avx2(xv));
+    }
+    F_batch_ref(x + i, y + i, count - i);
+} /* F_batch_avx2 */
+
+
+/*------------------------------------------------------------------
+ * Function:    Sin_exp_avx512
+ * Purpose:     exp(sin(x)) on 8 doubles, |x| <= SIN_MAX_ARG
+ */
+__attribute__((target("avx512f")))
+static inline __m512d Sin_exp_avx512(__m512d x) {
+    __m512d k, r, z, ps, pc, s, c, e;
+    __m512i ki, sign;
+    __mmask8 odd;
+    int     j;
+
+    /* sin */
+    k = _mm512_roundscale_pd(_mm512_mul_pd(x, _mm512_set1_pd(M_2_PI)),
+            _MM_FROUND_TO_NEAREST_INT);
+    r = _mm512_fnmadd_pd(k, _mm512_set1_pd(PIO2_1), x);
+    r = _mm512_fnmadd_pd(k, _mm512_set1_pd(PIO2_2), r);
+    r = _mm512_fnmadd_pd(k, _mm512_set1_pd(PIO2_3), r);
+    z = _mm512_mul_pd(r, r);
+
+    ps = _mm512_fmadd_pd(_mm512_set1_pd(S6), z, _mm512_set1_pd(S5));
+    ps = _mm512_fmadd_pd(ps, z, _mm512_set1_pd(S4));
+    ps = _mm512_fmadd_pd(ps, z, _mm512_set1_pd(S3));
+    ps = _mm512_fmadd_pd(ps, z, _mm512_set1_pd(S2));
+    ps = _mm512_fmadd_pd(ps, z, _mm512_set1_pd(S1));
+    s = _mm512_fmadd_pd(_mm512_mul_pd(ps, z), r, r);
+
+    pc = _mm512_fmadd_pd(_mm512_set1_pd(C6), z, _mm512_set1_pd(C5));
+    pc = _mm512_fmadd_pd(pc, z, _mm512_set1_pd(C4));
+    pc = _mm512_fmadd_pd(pc, z, _mm512_set1_pd(C3));
+    pc = _mm512_fmadd_pd(pc, z, _mm512_set1_pd(C2));
+    pc = _mm512_fmadd_pd(pc, z, _mm512_set1_pd(C1));
+    c = _mm512_fmadd_pd(_mm512_mul_pd(pc, z), z,
+            _mm512_fnmadd_pd(_mm512_set1_pd(0.5), z, _mm512_set1_pd(1.0)));
+
+    /* Quadrant k mod 4:  sin r, cos r, -sin r, -cos r */
+    ki = _mm512_cvtepi32_epi64(_mm512_cvtpd_epi32(k));
+    odd = _mm512_test_epi64_mask(ki, _mm512_set1_epi64(1));
+    sign = _mm512_slli_epi64(_mm512_and_si512(ki, _mm512_set1_epi64(2)), 62);
+    s = _mm512_mask_blend_pd(odd, s, c);
+    s = _mm512_castsi512_pd(_mm512_xor_si512(_mm512_castpd_si512(s), sign));
+
+    /* exp */
+    k = _mm512_roundscale_pd(_mm512_mul_pd(s, _mm512_set1_pd(M_LOG2E)),
+            _MM_FROUND_TO_NEAREST_INT);
+    r = _mm512_fnmadd_pd(k, _mm512_set1_pd(LN2_HI), s);
+    r = _mm512_fnmadd_pd(k, _mm512_set1_pd(LN2_LO), r);
+    e = _mm512_set1_pd(Inv_fact[13]);
+    for (j = 12; j >= 0; j--)
+        e = _mm512_fmadd_pd(e, r, _mm512_set1_pd(Inv_fact[j]));
+
+    return _mm512_scalef_pd(e, k);
+}  /* Sin_exp_avx512 */
+
+
+/*------------------------------------------------------------------
+ * Function:    F_batch_avx512
+ * Purpose:     AVX-512 version of F_batch_ref, 8 points at a time.
+ *              The last count % 8 points use a masked load and store.
+ * In args, out arg:  see F_batch_ref
+ */
+__attribute__((target("avx512f")))
+void F_batch_avx512(
+          const double  x[]    /* in  */,
+          double        y[]    /* out */,
+          int           count  /* in  */) {
+    __m512d  xv;
+    __mmask8 big, mask;
+    int i;
+
+    for (i = 0; i < count; i += 8) {
+        mask = (count - i >= 8) ? 0xff : (__mmask8) ((1u << (count - i)) - 1);
+        xv = _mm512_maskz_loadu_pd(mask, x + i);
+        big = _mm512_cmp_pd_mask(_mm512_abs_pd(xv),
+                _mm512_set1_pd(SIN_MAX_ARG), _CMP_GT_OQ);
+        if (big)
+            F_batch_ref(x + i, y + i, (count - i >= 8) ? 8 : count - i);
+        else
+            _mm512_mask_storeu_pd(y + i, mask, Sin_exp_avx512(xv));
+    }
+} /* F_batch_avx512 */
+#endif  /* HAVE_X86_SIMD */
+
+
+/*------------------------------------------------------------------
+ * Function:    Select_f_batch
+ * Purpose:     Choose the fastest version of F_batch the CPU supports
+ * Return val:  pointer to it
+ */
+F_batch_t Select_f_batch(void) {
+#   ifdef HAVE_X86_SIMD
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f"))
+        return F_batch_avx512;
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+        return F_batch_avx2;
+#   endif
+    return F_batch_ref;
+} /* Select_f_batch */
+
+
+/*------------------------------------------------------------------
+ * Function:    Set_integrand
+ * Purpose:     Make Integrands[which] the integrand in use, and set
+ *              Sum_integrand to its best sum for this CPU
+ * Input arg:   which
+ */
+void Set_integrand(int which) {
+    Integrand = &Integrands[which];
+    Sum_integrand = Integrand->select();
+} /* Set_integrand */
+
+
+/*------------------------------------------------------------------
+ * Function:    Batch_exp_sin
+ * Purpose:     exp_sin's batch:  f on an array of points with the
+ *              F_batch for this CPU
+ * In args, out arg:  see F_batch_ref
+ */
+void Batch_exp_sin(const double x[], double y[], int count) {
+    F_batch(x, y, count);
+} /* Batch_exp_sin */
+
+
+/*------------------------------------------------------------------
+ * Function:    Select_exp_sin
+ * Purpose:     Set F_batch for exp_sin, and return its sum
+ * Return val:  Sum_f
+ */
+Sum_t Select_exp_sin(void) {
+    if (F_batch == NULL)
+        F_batch = Select_f_batch();
+    return Sum_f;
+} /* Select_exp_sin */
+
+
+#ifdef HAVE_X86_SIMD
+/*------------------------------------------------------------------
+ * Function:    Select_sum
+ * Purpose:     Choose the version of a generated Sum_<name> to use
+ * Input args:  ref, avx2, avx512:  the scalar, AVX2/FMA and AVX-512
+ *                 versions
+ * Return val:  the fastest one the CPU supports
+ */
+Sum_t Select_sum(Sum_t ref, Sum_t avx2, Sum_t avx512) {
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f"))
+        return avx512;
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+        return avx2;
+    return ref;
+} /* Select_sum */
+#endif
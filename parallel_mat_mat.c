@@ -0,0 +1,661 @@
+/* File:     parallel_mat_mat.c
+ *
+ * Purpose:  Computes a parallel matrix-matrix product C = AB with the
+ *           SUMMA algorithm.  The processes form a pr x pc grid, and
+ *           each of A, B and C is distributed by 2D blocks.  The
+ *           blocks are generated with Gen_array, as in
+ *           parallel_mat_vect1.c.
+ *
+ * Input:
+ *     m, l, n:  A is m x l, B is l x n, C is m x n, from -d, a config
+ *               file (-c), or stdin on process 0
+ *
+ * Output:
+ *     The elapsed time, the GFLOP/s, and the sum of the entries of C
+ *
+ * Compile:  mpicc -g -Wall -O2 -o parallel_mat_mat parallel_mat_mat.c
+ * Run:      mpiexec -n <number of processes> parallel_mat_mat
+ *              [-d <m>,<l>,<n>] [-c <config file>] [nb]
+ *           -d gives m, l and n on the command line
+ *           -c names a file with lines "m = <value>", "l = <value>"
+ *              and "n = <value>" (# starts a comment)
+ *           nb is the panel width (default:  the largest width that
+ *           divides both local dimensions of the inner index, up to
+ *           256)
+ *
+ * Algorithm:
+ *     For each panel of nb columns of A (and nb rows of B):
+ *        1.  The grid column that owns the panel of A broadcasts it
+ *            along each grid row.
+ *        2.  The grid row that owns the panel of B broadcasts it
+ *            along each grid column.
+ *        3.  Each process adds (panel of A)*(panel of B) to its
+ *            block of C.
+ *     The broadcasts are nonblocking and the panels are double
+ *     buffered:  while the product for panel k is computed, the
+ *     broadcasts for panel k+1 are in progress.
+ *
+ * Notes:
+ *     1.  MPI_Dims_create picks the grid.  pr should evenly divide m
+ *         and l, and pc should evenly divide l and n.
+ *     2.  The local product is cache blocked, and on CPUs with
+ *         AVX2/FMA it uses a 4 x 16 register-blocked micro-kernel.
+ *     3.  Compile with -DDEBUG to gather A, B and C on process 0 and
+ *         check C against a serial product.
+ *     4.  Process 0 sends m, l and n with a single MPI_Bcast.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+#include <limits.h>
+#include <mpi.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#  define HAVE_X86_SIMD
+#  include <immintrin.h>
+#endif
+
+/* Cache blocking of the local product:  an MC x KC block of the A  */
+/* panel stays in L2 while it's multiplied by KC x NC of the B panel */
+#define MC 64
+#define KC 256
+#define NC 1024
+
+/* Largest default panel width */
+#define MAX_NB 256
+
+void Usage(char* prog_name);
+void Get_args(int argc, char* argv[], int sizes[], char** cfg_file_p,
+             int* nb_p);
+void Get_sizes(int sizes[], char* cfg_file, int my_rank, MPI_Comm comm);
+int  Read_config(char* file_name, const char* keys[], double vals[],
+             int n_keys);
+int  Config_int(double val);
+void Gen_array(float array[], int size, int seed);
+void Summa(float local_A[], float local_B[], float local_C[], int lm,
+             int la, int lb, int ln, int nb, int my_row, int my_col,
+             MPI_Comm row_comm, MPI_Comm col_comm);
+void Start_panels(float local_A[], float local_B[], float A_panel[],
+             float B_panel[], int k, int lm, int la, int lb, int ln,
+             int nb, int my_row, int my_col, MPI_Comm row_comm,
+             MPI_Comm col_comm, MPI_Request reqs[]);
+void Local_mat_mat(const float A[], const float B[], float C[], int mm,
+             int kk, int nn);
+void Micro_kernel_ref(const float A[], int lda, const float B[], int ldb,
+             float C[], int ldc, int mr, int kc, int nr);
+#ifdef HAVE_X86_SIMD
+void Micro_kernel_avx2(const float A[], int lda, const float B[], int ldb,
+             float C[], int ldc, int kc);
+#endif
+#ifdef DEBUG
+void Check_product(float local_A[], float local_B[], float local_C[],
+             int m, int l, int n, int pr, int pc, int my_rank,
+             MPI_Comm comm);
+#endif
+
+int main(int argc, char* argv[]) {
+    int         my_rank, p;
+    int         dims[2] = {0, 0}, periods[2] = {0, 0}, coords[2];
+    int         keep[2];
+    int         m, l, n, pr, pc, lm, la, lb, ln, nb;
+    int         sizes[3];
+    char*       cfg_file;
+    float*      local_A;
+    float*      local_B;
+    float*      local_C;
+    double      start, elapsed, local_sum, sum;
+    int         i;
+    MPI_Comm    grid_comm, row_comm, col_comm;
+
+    MPI_Init(&argc, &argv);
+    MPI_Comm_size(MPI_COMM_WORLD, &p);
+    Get_args(argc, argv, sizes, &cfg_file, &nb);
+
+    MPI_Dims_create(p, 2, dims);
+    MPI_Cart_create(MPI_COMM_WORLD, 2, dims, periods, 1, &grid_comm);
+    MPI_Comm_rank(grid_comm, &my_rank);
+    MPI_Cart_coords(grid_comm, my_rank, 2, coords);
+    keep[0] = 0; keep[1] = 1;
+    MPI_Cart_sub(grid_comm, keep, &row_comm);  /* rank = my column */
+    keep[0] = 1; keep[1] = 0;
+    MPI_Cart_sub(grid_comm, keep, &col_comm);  /* rank = my row    */
+    pr = dims[0];
+    pc = dims[1];
+
+    Get_sizes(sizes, cfg_file, my_rank, grid_comm);
+    m = sizes[0];
+    l = sizes[1];
+    n = sizes[2];
+    if (m % pr != 0 || l % pr != 0 || l % pc != 0 || n % pc != 0) {
+        if (my_rank == 0)
+            fprintf(stderr, "The %d x %d grid must evenly divide m, l and n\n",
+                pr, pc);
+        MPI_Finalize();
+        return 0;
+    }
+    lm = m/pr;   /* Local A is lm x la */
+    la = l/pc;
+    lb = l/pr;   /* Local B is lb x ln */
+    ln = n/pc;
+
+    /* Default panel width:  largest divisor of la and lb <= MAX_NB */
+    if (nb > 0) {
+        if (la % nb != 0 || lb % nb != 0) Usage(argv[0]);
+    } else {
+        for (nb = (la < MAX_NB) ? la : MAX_NB; nb > 1; nb--)
+            if (la % nb == 0 && lb % nb == 0) break;
+    }
+
+    local_A = malloc((size_t) lm*la*sizeof(float));
+    local_B = malloc((size_t) lb*ln*sizeof(float));
+    local_C = malloc((size_t) lm*ln*sizeof(float));
+    Gen_array(local_A, lm*la, my_rank);
+    Gen_array(local_B, lb*ln, p + my_rank);
+
+    MPI_Barrier(grid_comm);
+    start = MPI_Wtime();
+    Summa(local_A, local_B, local_C, lm, la, lb, ln, nb, coords[0],
+        coords[1], row_comm, col_comm);
+    elapsed = MPI_Wtime() - start;
+    MPI_Reduce(my_rank == 0 ? MPI_IN_PLACE : &elapsed, &elapsed, 1,
+        MPI_DOUBLE, MPI_MAX, 0, grid_comm);
+
+    local_sum = 0.0;
+    for (i = 0; i < lm*ln; i++)
+        local_sum += local_C[i];
+    MPI_Reduce(&local_sum, &sum, 1, MPI_DOUBLE, MPI_SUM, 0, grid_comm);
+
+    if (my_rank == 0) {
+        printf("%d x %d grid, panel width %d\n", pr, pc, nb);
+        printf("Elapsed time = %e seconds\n", elapsed);
+        printf("GFLOP/s = %f\n", 2.0*m*l*n/elapsed/1.0e9);
+        printf("Sum of the entries of C = %.8e\n", sum);
+    }
+
+#   ifdef DEBUG
+    Check_product(local_A, local_B, local_C, m, l, n, pr, pc, my_rank,
+        grid_comm);
+#   endif
+
+    free(local_A);
+    free(local_B);
+    free(local_C);
+    MPI_Comm_free(&row_comm);
+    MPI_Comm_free(&col_comm);
+    MPI_Comm_free(&grid_comm);
+
+    MPI_Finalize();
+
+    return 0;
+}  /* main */
+
+/*--------------------------------------------------------------------
+ * Function:  Gen_array
+ * Purpose:   Generate a random array of floats
+ * In args:   size:  the number of elements in the array
+ *            seed:  seed for the random number generator
+ * Out arg:   array:  the array of floats
+ */
+void Gen_array(float array[], int size, int seed) {
+   int i;
+
+   srandom(seed+1);
+   for (i = 0; i < size; i++)
+      array[i] = random()/((double) RAND_MAX);
+}  /* Gen_array */
+
+/*--------------------------------------------------------------------
+ * Function:  Summa
+ * Purpose:   Compute my block of C = AB
+ * In args:   local_A:  my lm x la block of A
+ *            local_B:  my lb x ln block of B
+ *            lm, la, lb, ln:  block dimensions
+ *            nb:  panel width, divides la and lb
+ *            my_row, my_col:  my coordinates in the grid
+ *            row_comm:  the processes in my grid row
+ *            col_comm:  the processes in my grid column
+ * Out arg:   local_C:  my lm x ln block of C
+ */
+void Summa(
+         float    local_A[]  /* in  */,
+         float    local_B[]  /* in  */,
+         float    local_C[]  /* out */,
+         int      lm         /* in  */,
+         int      la         /* in  */,
+         int      lb         /* in  */,
+         int      ln         /* in  */,
+         int      nb         /* in  */,
+         int      my_row     /* in  */,
+         int      my_col     /* in  */,
+         MPI_Comm row_comm   /* in  */,
+         MPI_Comm col_comm   /* in  */) {
+
+    int   k, n_panels, cur, pc;
+    float* A_panel[2];
+    float* B_panel[2];
+    MPI_Request reqs[2][2];
+
+    MPI_Comm_size(row_comm, &pc);
+    n_panels = (la*pc)/nb;
+    A_panel[0] = malloc(2*(size_t) lm*nb*sizeof(float));
+    A_panel[1] = A_panel[0] + (size_t) lm*nb;
+    B_panel[0] = malloc(2*(size_t) nb*ln*sizeof(float));
+    B_panel[1] = B_panel[0] + (size_t) nb*ln;
+    memset(local_C, 0, (size_t) lm*ln*sizeof(float));
+
+    Start_panels(local_A, local_B, A_panel[0], B_panel[0], 0, lm, la, lb,
+        ln, nb, my_row, my_col, row_comm, col_comm, reqs[0]);
+    for (k = 0; k < n_panels; k++) {
+        cur = k % 2;
+        /* The buffers for panel k+1 were used by panel k-1, which is done */
+        if (k + 1 < n_panels)
+            Start_panels(local_A, local_B, A_panel[1-cur], B_panel[1-cur],
+                k+1, lm, la, lb, ln, nb, my_row, my_col, row_comm,
+                col_comm, reqs[1-cur]);
+        MPI_Waitall(2, reqs[cur], MPI_STATUSES_IGNORE);
+        Local_mat_mat(A_panel[cur], B_panel[cur], local_C, lm, nb, ln);
+    }
+
+    free(A_panel[0]);
+    free(B_panel[0]);
+}  /* Summa */
+
+/*--------------------------------------------------------------------
+ * Function:  Start_panels
+ * Purpose:   Start the broadcasts of panel k of A along the grid rows
+ *            and panel k of B along the grid columns
+ * In args:   local_A, local_B:  my blocks of A and B
+ *            k:  the panel number
+ *            lm, la, lb, ln, nb, my_row, my_col, row_comm, col_comm:
+ *               see Summa
+ * Out args:  A_panel:  lm x nb panel of A, valid after reqs[0] is done
+ *            B_panel:  nb x ln panel of B, valid after reqs[1] is done
+ *            reqs:  the two broadcast requests
+ */
+void Start_panels(
+         float       local_A[]  /* in  */,
+         float       local_B[]  /* in  */,
+         float       A_panel[]  /* out */,
+         float       B_panel[]  /* out */,
+         int         k          /* in  */,
+         int         lm         /* in  */,
+         int         la         /* in  */,
+         int         lb         /* in  */,
+         int         ln         /* in  */,
+         int         nb         /* in  */,
+         int         my_row     /* in  */,
+         int         my_col     /* in  */,
+         MPI_Comm    row_comm   /* in  */,
+         MPI_Comm    col_comm   /* in  */,
+         MPI_Request reqs[]     /* out */) {
+
+    int i;
+    int first = k*nb;              /* First global column of A/row of B */
+    int a_root = first/la;         /* Grid column that owns the A panel */
+    int b_root = first/lb;         /* Grid row that owns the B panel    */
+
+    if (my_col == a_root)
+        for (i = 0; i < lm; i++)
+            memcpy(A_panel + (size_t) i*nb,
+                   local_A + (size_t) i*la + first % la, nb*sizeof(float));
+    MPI_Ibcast(A_panel, lm*nb, MPI_FLOAT, a_root, row_comm, &reqs[0]);
+
+    if (my_row == b_root)
+        memcpy(B_panel, local_B + (size_t) (first % lb)*ln,
+               (size_t) nb*ln*sizeof(float));
+    MPI_Ibcast(B_panel, nb*ln, MPI_FLOAT, b_root, col_comm, &reqs[1]);
+}  /* Start_panels */
+
+/*--------------------------------------------------------------------
+ * Function:  Local_mat_mat
+ * Purpose:   C += AB for row-major A (mm x kk), B (kk x nn), C (mm x nn)
+ *            The loops are blocked so that an MC x KC block of A and
+ *            a KC x NC block of B stay in cache, and the innermost
+ *            work is done by a 4 x 16 micro-kernel.
+ */
+void Local_mat_mat(
+         const float A[]  /* in     */,
+         const float B[]  /* in     */,
+         float       C[]  /* in/out */,
+         int         mm   /* in     */,
+         int         kk   /* in     */,
+         int         nn   /* in     */) {
+
+    int ic, pc, jc, ir, jr, mc, kc, nc, mr, nr;
+    int use_avx2 = 0;
+
+#   ifdef HAVE_X86_SIMD
+    use_avx2 = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#   endif
+
+    for (jc = 0; jc < nn; jc += NC) {
+        nc = (nn - jc < NC) ? nn - jc : NC;
+        for (pc = 0; pc < kk; pc += KC) {
+            kc = (kk - pc < KC) ? kk - pc : KC;
+            for (ic = 0; ic < mm; ic += MC) {
+                mc = (mm - ic < MC) ? mm - ic : MC;
+                for (ir = 0; ir < mc; ir += 4) {
+                    mr = (mc - ir < 4) ? mc - ir : 4;
+                    for (jr = 0; jr < nc; jr += 16) {
+                        nr = (nc - jr < 16) ? nc - jr : 16;
+#                       ifdef HAVE_X86_SIMD
+                        if (use_avx2 && mr == 4 && nr == 16) {
+                            Micro_kernel_avx2(
+                                A + (size_t) (ic+ir)*kk + pc, kk,
+                                B + (size_t) pc*nn + jc + jr, nn,
+                                C + (size_t) (ic+ir)*nn + jc + jr, nn, kc);
+                            continue;
+                        }
+#                       endif
+                        Micro_kernel_ref(A + (size_t) (ic+ir)*kk + pc, kk,
+                            B + (size_t) pc*nn + jc + jr, nn,
+                            C + (size_t) (ic+ir)*nn + jc + jr, nn,
+                            mr, kc, nr);
+                    }
+                }
+            }
+        }
+    }
+}  /* Local_mat_mat */
+
+/*--------------------------------------------------------------------
+ * Function:  Micro_kernel_ref
+ * Purpose:   C += AB for an mr x kc block of A and a kc x nr block of
+ *            B, mr <= 4, nr <= 16.  Used for the edges of the blocks
+ *            and on CPUs without AVX2.
+ */
+void Micro_kernel_ref(
+         const float A[]  /* in     */,
+         int         lda  /* in     */,
+         const float B[]  /* in     */,
+         int         ldb  /* in     */,
+         float       C[]  /* in/out */,
+         int         ldc  /* in     */,
+         int         mr   /* in     */,
+         int         kc   /* in     */,
+         int         nr   /* in     */) {
+
+    int   i, j, k;
+    float acc[4][16];
+    float a;
+
+    for (i = 0; i < mr; i++)
+        for (j = 0; j < nr; j++)
+            acc[i][j] = C[i*ldc + j];
+    for (k = 0; k < kc; k++)
+        for (i = 0; i < mr; i++) {
+            a = A[i*lda + k];
+            for (j = 0; j < nr; j++)
+                acc[i][j] += a*B[k*ldb + j];
+        }
+    for (i = 0; i < mr; i++)
+        for (j = 0; j < nr; j++)
+            C[i*ldc + j] = acc[i][j];
+}  /* Micro_kernel_ref */
+
+#ifdef HAVE_X86_SIMD
+/*--------------------------------------------------------------------
+ * Function:  Micro_kernel_avx2
+ * Purpose:   AVX2/FMA version of Micro_kernel_ref for a full 4 x 16
+ *            block of C, which is held in 8 registers for all kc
+ *            steps
+ */
+__attribute__((target("avx2,fma")))
+void Micro_kernel_avx2(
+         const float A[]  /* in     */,
+         int         lda  /* in     */,
+         const float B[]  /* in     */,
+         int         ldb  /* in     */,
+         float       C[]  /* in/out */,
+         int         ldc  /* in     */,
+         int         kc   /* in     */) {
+
+    int    i, k;
+    __m256 c[4][2], b0, b1, a;
+
+    for (i = 0; i < 4; i++) {
+        c[i][0] = _mm256_loadu_ps(C + i*ldc);
+        c[i][1] = _mm256_loadu_ps(C + i*ldc + 8);
+    }
+    for (k = 0; k < kc; k++) {
+        b0 = _mm256_loadu_ps(B + (size_t) k*ldb);
+        b1 = _mm256_loadu_ps(B + (size_t) k*ldb + 8);
+        for (i = 0; i < 4; i++) {
+            a = _mm256_broadcast_ss(A + i*lda + k);
+            c[i][0] = _mm256_fmadd_ps(a, b0, c[i][0]);
+            c[i][1] = _mm256_fmadd_ps(a, b1, c[i][1]);
+        }
+    }
+    for (i = 0; i < 4; i++) {
+        _mm256_storeu_ps(C + i*ldc, c[i][0]);
+        _mm256_storeu_ps(C + i*ldc + 8, c[i][1]);
+    }
+}  /* Micro_kernel_avx2 */
+#endif
+
+#ifdef DEBUG
+/*--------------------------------------------------------------------
+ * Function:  Gather_blocks
+ * Purpose:   Gather an r x c matrix distributed by 2D blocks on a
+ *            pr x pc grid onto process 0
+ */
+static float* Gather_blocks(float local[], int r, int c, int pr, int pc,
+        int my_rank, MPI_Comm comm) {
+    int    lr = r/pr, lc = c/pc, q, i, coords[2];
+    float* temp = NULL;
+    float* full = NULL;
+
+    if (my_rank == 0) {
+        temp = malloc((size_t) r*c*sizeof(float));
+        full = malloc((size_t) r*c*sizeof(float));
+    }
+    MPI_Gather(local, lr*lc, MPI_FLOAT, temp, lr*lc, MPI_FLOAT, 0, comm);
+    if (my_rank == 0) {
+        for (q = 0; q < pr*pc; q++) {
+            MPI_Cart_coords(comm, q, 2, coords);
+            for (i = 0; i < lr; i++)
+                memcpy(full + (size_t) (coords[0]*lr + i)*c + coords[1]*lc,
+                       temp + (size_t) q*lr*lc + (size_t) i*lc,
+                       lc*sizeof(float));
+        }
+        free(temp);
+    }
+    return full;
+}  /* Gather_blocks */
+
+/*--------------------------------------------------------------------
+ * Function:  Check_product
+ * Purpose:   Gather A, B and C on process 0 and print the largest
+ *            relative difference between C and a serial product
+ */
+void Check_product(float local_A[], float local_B[], float local_C[],
+        int m, int l, int n, int pr, int pc, int my_rank, MPI_Comm comm) {
+    float* A = Gather_blocks(local_A, m, l, pr, pc, my_rank, comm);
+    float* B = Gather_blocks(local_B, l, n, pr, pc, my_rank, comm);
+    float* C = Gather_blocks(local_C, m, n, pr, pc, my_rank, comm);
+    int    i, j, k;
+    double sum, err, max_err = 0.0;
+
+    if (my_rank == 0) {
+        for (i = 0; i < m; i++)
+            for (j = 0; j < n; j++) {
+                sum = 0.0;
+                for (k = 0; k < l; k++)
+                    sum += (double) A[(size_t) i*l + k]*B[(size_t) k*n + j];
+                err = fabs(C[(size_t) i*n + j] - sum);
+                if (sum != 0.0) err /= fabs(sum);
+                if (err > max_err) max_err = err;
+            }
+        printf("Max relative difference from serial product = %e\n",
+            max_err);
+        free(A);
+        free(B);
+        free(C);
+    }
+}  /* Check_product */
+#endif
+
+/*--------------------------------------------------------------------
+ * Function:  Usage
+ * Purpose:   Print a message explaining how to run the program
+ * In arg:    prog_name
+ */
+void Usage(char* prog_name) {
+    fprintf(stderr, "usage: mpiexec -n <p> %s [-d <m>,<l>,<n>]\n",
+        prog_name);
+    fprintf(stderr, "          [-c <config file>] [nb]\n");
+    fprintf(stderr, "   -d gives m, l and n, or -c a file with m = ...,\n");
+    fprintf(stderr, "      l = ... and n = ... lines (else they're read from stdin)\n");
+    fprintf(stderr, "   nb is the panel width and should divide l/pr and l/pc\n");
+    exit(0);
+}  /* Usage */
+
+
+/*--------------------------------------------------------------------
+ * Function:  Get_args
+ * Purpose:   Get the command line options and the panel width
+ * In args:   argc, argv
+ * Out args:  sizes:  m, l and n from -d, or 0, 0, 0
+ *            cfg_file_p:  config file from -c, or NULL
+ *            nb_p:  the panel width, or 0 for the default
+ */
+void Get_args(
+         int     argc        /* in  */,
+         char*   argv[]      /* in  */,
+         int     sizes[]     /* out */,
+         char**  cfg_file_p  /* out */,
+         int*    nb_p        /* out */) {
+    int c;
+
+    sizes[0] = sizes[1] = sizes[2] = 0;
+    *cfg_file_p = NULL;
+    *nb_p = 0;
+    while ((c = getopt(argc, argv, "d:c:")) != -1) {
+        switch (c) {
+            case 'd':
+                if (sscanf(optarg, "%d,%d,%d", &sizes[0], &sizes[1],
+                        &sizes[2]) != 3)
+                    Usage(argv[0]);
+                break;
+            case 'c':
+                *cfg_file_p = optarg;
+                break;
+            default:
+                Usage(argv[0]);
+        }
+    }
+    if (argc - optind > 1) Usage(argv[0]);
+    if (argc - optind == 1) {
+        *nb_p = strtol(argv[optind], NULL, 10);
+        if (*nb_p <= 0) Usage(argv[0]);
+    }
+}  /* Get_args */
+
+
+/*--------------------------------------------------------------------
+ * Function:  Get_sizes
+ * Purpose:   Get m, l and n on process 0, from -d, a config file, or
+ *            stdin, and broadcast them
+ * In args:   cfg_file:  config file from -c, or NULL
+ *            my_rank, comm
+ * In/out:    sizes:  in:  m, l and n from -d, or 0, 0, 0
+ *                    out:  m, l and n
+ * Note:      If the input is bad, every process quits.
+ */
+void Get_sizes(
+         int      sizes[]   /* in/out */,
+         char*    cfg_file  /* in     */,
+         int      my_rank   /* in     */,
+         MPI_Comm comm      /* in     */) {
+    const char* keys[3] = {"m", "l", "n"};
+    double      vals[3];
+    int         i;
+
+    if (my_rank == 0 && sizes[0] == 0) {
+        if (cfg_file != NULL) {
+            if (Read_config(cfg_file, keys, vals, 3) == 0) {
+                for (i = 0; i < 3; i++)
+                    sizes[i] = Config_int(vals[i]);
+            } else {
+                fprintf(stderr, "Can't get m, l and n from %s\n", cfg_file);
+            }
+        } else {
+            printf("Enter m, l, and n (A is m x l, B is l x n)\n");
+            if (scanf("%d %d %d", &sizes[0], &sizes[1], &sizes[2]) != 3)
+                sizes[0] = 0;
+        }
+    }
+    MPI_Bcast(sizes, 3, MPI_INT, 0, comm);
+
+    if (sizes[0] < 1 || sizes[1] < 1 || sizes[2] < 1) {
+        if (my_rank == 0)
+            fprintf(stderr, "m, l and n must be positive ints\n");
+        MPI_Finalize();
+        exit(0);
+    }
+}  /* Get_sizes */
+
+
+/*--------------------------------------------------------------------
+ * Function:  Read_config
+ * Purpose:   Read "key = value" lines from a file.  Blank lines and
+ *            anything after a # are ignored.
+ * In args:   file_name
+ *            keys:  the keys to look for
+ *            n_keys:  how many there are
+ * Out arg:   vals:  vals[k] is the value given for keys[k]
+ * Return:    0 if every key was given a value, -1 if not, or if the
+ *            file can't be read or has a line that isn't "key = value"
+ *            for one of the keys
+ */
+int Read_config(
+         char*       file_name  /* in  */,
+         const char* keys[]     /* in  */,
+         double      vals[]     /* out */,
+         int         n_keys     /* in  */) {
+    FILE*  fp = fopen(file_name, "r");
+    char   line[256], key[64];
+    char*  hash;
+    double val;
+    int    k, found = 0, seen[16] = {0};
+
+    if (fp == NULL || n_keys > 16) {
+        if (fp != NULL) fclose(fp);
+        return -1;
+    }
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        if ((hash = strchr(line, '#')) != NULL) *hash = '\0';
+        if (sscanf(line, " %63[^= \t] = %lf", key, &val) != 2) {
+            if (sscanf(line, " %63s", key) == 1) break;   /* Not blank */
+            continue;
+        }
+        for (k = 0; k < n_keys; k++)
+            if (strcmp(key, keys[k]) == 0) break;
+        if (k == n_keys) break;
+        vals[k] = val;
+        if (!seen[k]) found++;
+        seen[k] = 1;
+    }
+    if (!feof(fp)) found = -1;
+    fclose(fp);
+
+    return (found == n_keys) ? 0 : -1;
+}  /* Read_config */
+
+
+/*--------------------------------------------------------------------
+ * Function:  Config_int
+ * Purpose:   Convert a value from Read_config to a positive int
+ * In arg:    val
+ * Return:    val, if it's a whole number from 1 to INT_MAX, and 0
+ *            (bad input) if it isn't
+ */
+int Config_int(
+         double val  /* in  */) {
+    if (val >= 1.0 && val <= INT_MAX && val == floor(val))
+        return (int) val;
+    return 0;
+}  /* Config_int */
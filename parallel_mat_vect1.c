@@ -3,28 +3,176 @@
  * Purpose:  Computes a parallel matrix-vector product.  Matrix
  *           is distributed by block rows.  Vectors are distributed 
  *           by blocks.  This version generates a random matrix
- *           and a random vector.
+ *           and a random vector.  It can also multiply the matrix
+ *           by a block of k vectors at once, and it can store the
+ *           matrix in 16-bit floating point.  With -s it instead runs
+ *           an iterative solver built on the matrix-vector product.
+ *           With -r the random matrix and vectors come from a
+ *           counter-based generator, so they don't depend on p.
  *
  * Input:
- *     m, n: order of matrix
+ *     m, n: order of matrix (unless A is read from a file), from -d,
+ *           from a config file (-c), or from stdin on process 0
  *
  * Output:
- *     y:    the product vector
+ *     y:    the product vector (or the m x k block of products)
+ *     or, with -s, the number of iterations, the time per iteration,
+ *     and the residual (cg) or the dominant eigenvalue (power)
  *
- * Compile:  mpicc -g -Wall -o parallel_mat_vect parallel_mat_vect.c
+ * Compile:  mpicc -g -Wall -O2 -fopenmp -o parallel_mat_vect \
+ *              parallel_mat_vect1.c -lm
  * Run:      mpiexec -n <number of processes> parallel_mat_vect
+ *              [-t <fp32|bf16|fp16>] [-s <cg|power>] [-i <max_iter>]
+ *              [-e <tol>] [-r <seed>] [-f <A file>] [-x <x file>]
+ *              [-o <A file>] [-d <m>,<n>] [-c <config file>] [k]
+ *           -t is the storage type of the matrix (default fp32)
+ *           -s runs conjugate gradient or power iteration (m = n)
+ *           -i is the maximum number of solver iterations (1000)
+ *           -e is the solver's relative tolerance (1e-6)
+ *           -r generates A and x from seed with Philox (see note 8)
+ *           -f, -x read A and x from files, -o writes A in binary
+ *              (see note 9)
+ *           -d gives the order of the matrix on the command line
+ *           -c names a file with lines "m = <value>" and "n = <value>"
+ *              (# starts a comment)
+ *           k is the number of vectors to multiply by (default 1)
  *
  * Notes:  
  *     1.  Local storage for A, x, and y is dynamically allocated.
  *     2.  Number of processes (p) should evenly divide both m and n.
+ *     3.  The local product is computed by Local_mat_vect, which is
+ *         chosen at run time:  an AVX-512 kernel (8 rows at a time),
+ *         an AVX2/FMA kernel (4 rows at a time), or the scalar
+ *         reference Local_mat_vect_ref.  The vector kernels block
+ *         over the columns so that a chunk of global_x stays in L1.
+ *     4.  Compile with -DDEBUG to check the local product against
+ *         the scalar reference.
+ *     5.  With k > 1 the vectors are stored as an n x k block X,
+ *         row major, so row j holds component j of every vector.
+ *         The block is distributed by block rows, so a single
+ *         MPI_Allgather collects all of X, and Local_mat_block
+ *         streams local_A from memory once for all k vectors.
+ *     6.  With -t bf16 or -t fp16 the matrix is generated in fp32,
+ *         the fp32 product is computed for reference, and then the
+ *         matrix is converted to 16 bits and the fp32 copy is freed.
+ *         Local_mat_vect_half converts the entries back to fp32 in
+ *         registers and accumulates in fp32, so it reads half as many
+ *         bytes of A.  The program reports the error of the 16-bit
+ *         product relative to the fp32 product.  16-bit storage is
+ *         only used for a single vector (k = 1).
+ *     7.  The solvers allocate their vectors once and reuse them, and
+ *         with global_x, for every iteration.  Each iteration does
+ *         one matrix-vector product and one MPI_Allreduce:  power
+ *         iteration reduces x.y and y.y together, and CG uses the
+ *         Chronopoulos-Gear recurrences so that r.r and r.Ar are
+ *         reduced together.  CG runs on a generated symmetric,
+ *         diagonally dominant (so SPD) matrix, and power iteration
+ *         on the usual random matrix.
+ *     8.  Gen_array seeds random() separately on each process, so the
+ *         matrix depends on p.  With -r, Gen_array_cb instead computes
+ *         entry L of the row-major global array directly from the
+ *         seed:  the Philox4x32-10 block function maps the counter
+ *         (L/4, stream) and the key (seed) to 4 random words, and word
+ *         L%4 gives the entry.  Every p gives a bitwise identical
+ *         matrix and vector, and each process generates only its own
+ *         rows, 4 counters at a time with AVX2 and split among OpenMP
+ *         threads when compiled with -fopenmp.
+ *     9.  Read_matrix and Read_vector read all of A or x on process 0
+ *         and scatter it.  -f and -x use Read_array_mpiio instead,
+ *         where every process reads its own block of rows.  A binary
+ *         file is a header of 4 ints (BIN_MAGIC, rows, cols, 0)
+ *         followed by the rows*cols floats in row major order, and
+ *         each process reads its rows with one collective
+ *         MPI_File_read_at_all.  Any other file is parsed as text:
+ *         each process reads 1/p of the bytes, hands the partial line
+ *         at the start of its chunk to the previous process, parses
+ *         whole lines, and the values are sent to their owners.  A
+ *         text matrix has one row per line.  A vector (or n x k block
+ *         of vectors) file holds its values in row-major order, with
+ *         any line breaks.  -o writes A in binary, e.g., to convert a
+ *         text file.  test_mat_lines.txt is a 12 x 12 text matrix with
+ *         24-byte lines, so for p = 2, 3, 4, 6 and 12 every chunk ends
+ *         exactly on a line break;  the output of
+ *            mpiexec -n <p> parallel_mat_vect -f test_mat_lines.txt -r 1
+ *         should be the same for all of them.
+ *    10.  Process 0 gets m and n from -d, -c, or stdin, in that
+ *         order, and sends both with a single MPI_Bcast.
  *
  */
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <math.h>
+#include <limits.h>
 #include <mpi.h>
 
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#  define HAVE_X86_SIMD
+#  include <immintrin.h>
+#endif
+
+/* Number of columns of A (and entries of global_x) handled per block */
+/* 2048 floats = 8 KB, so a block of x stays in a 32 KB L1 along with */
+/* the streamed rows of A                                             */
+#define COL_BLOCK 2048
+
+/* Storage types for the matrix */
+#define STORE_FP32 0
+#define STORE_BF16 1
+#define STORE_FP16 2
+
+/* Solvers */
+#define SOLVER_NONE  0
+#define SOLVER_CG    1
+#define SOLVER_POWER 2
+
+/* Philox streams, so that A and x are independent */
+#define STREAM_A 0
+#define STREAM_X 1
+
+/* Binary array files start with 4 ints:  BIN_MAGIC, rows, cols, 0 */
+#define BIN_MAGIC  0x3156504d   /* "MPV1" read as a little-endian int */
+#define BIN_HEADER (4*sizeof(int))
+
+typedef void (*Local_mat_vect_t)(const float local_A[],
+             const float global_x[], float local_y[], int local_m, int n);
+typedef void (*Local_mat_block_t)(const float local_A[],
+             const float global_X[], float local_Y[], int local_m, int n,
+             int k);
+typedef void (*Local_mat_vect_half_t)(const uint16_t local_A[],
+             const float global_x[], float local_y[], int local_m, int n,
+             int store);
+
+void Usage(char* prog_name);
+void Get_args(int argc, char* argv[], int* k_p, int* store_p,
+             int* solver_p, int* max_iter_p, double* tol_p, long* seed_p,
+             char** mat_file_p, char** vec_file_p, char** out_file_p,
+             int dims[], char** cfg_file_p);
+void Get_dims(int dims[], char* cfg_file, int* m_p, int* n_p, int my_rank,
+             MPI_Comm comm);
+int  Read_config(char* file_name, const char* keys[], double vals[],
+             int n_keys);
+int  Config_int(double val);
+
 void Gen_array(float array[], int size, int seed);
+void Philox4x32(uint32_t ctr[], uint32_t key);
+void Gen_array_cb(float array[], long long first, int size, int stream,
+             uint32_t seed);
+#ifdef HAVE_X86_SIMD
+void Philox4x32_avx2(uint32_t out[], uint64_t first_ctr, int stream,
+             uint32_t key);
+#endif
+void Gen_local_array(float array[], long long first, int size, int stream,
+             int legacy_seed, long seed);
+float* Read_array_mpiio(char* file_name, int row_len, int* rows_p,
+             int* cols_p, int my_rank, int p, MPI_Comm comm);
+float* Read_text_mpiio(MPI_File fh, int row_len, int* rows_p,
+             int* cols_p, int my_rank, int p, MPI_Comm comm);
+void Write_array_mpiio(char* file_name, float local_A[], int local_rows,
+             int cols, int my_rank, int p, MPI_Comm comm);
 void Read_matrix(char* prompt, float local_A[], int local_m, int n,
              int my_rank, int p, MPI_Comm comm);
 void Read_vector(char* prompt, float local_x[], int local_n, int my_rank,
@@ -36,16 +184,87 @@ void Print_matrix(char* title, float local_A[], int local_m,
              int n, int my_rank, int p, MPI_Comm comm);
 void Print_vector(char* title, float local_y[], int local_m, int my_rank,
              int p, MPI_Comm comm);
+void Local_mat_vect_ref(const float local_A[], const float global_x[],
+             float local_y[], int local_m, int n);
+#ifdef HAVE_X86_SIMD
+void Local_mat_vect_avx2(const float local_A[], const float global_x[],
+             float local_y[], int local_m, int n);
+void Local_mat_vect_avx512(const float local_A[], const float global_x[],
+             float local_y[], int local_m, int n);
+#endif
+Local_mat_vect_t Select_local_mat_vect(void);
+void Parallel_matrix_block_prod(float local_A[], int m, int n,
+             float local_X[], float global_X[], float local_Y[],
+             int local_m, int local_n, int k, MPI_Comm comm);
+void Local_mat_block_ref(const float local_A[], const float global_X[],
+             float local_Y[], int local_m, int n, int k);
+#ifdef HAVE_X86_SIMD
+void Local_mat_block_avx2(const float local_A[], const float global_X[],
+             float local_Y[], int local_m, int n, int k);
+void Local_mat_block_avx512(const float local_A[], const float global_X[],
+             float local_Y[], int local_m, int n, int k);
+#endif
+Local_mat_block_t Select_local_mat_block(void);
+void Check_local_prod(float local_A[], float global_x[], float local_y[],
+             int local_m, int n, int k, int my_rank);
+uint16_t Float_to_bf16(float x);
+float    Bf16_to_float(uint16_t h);
+uint16_t Float_to_fp16(float x);
+float    Fp16_to_float(uint16_t h);
+void Convert_array(const float array[], uint16_t array16[], int size,
+             int store);
+void Parallel_matrix_vector_prod_half(uint16_t local_A[], int m, int n,
+             float local_x[], float global_x[], float local_y[],
+             int local_m, int local_n, int store, MPI_Comm comm);
+void Local_mat_vect_half_ref(const uint16_t local_A[],
+             const float global_x[], float local_y[], int local_m, int n,
+             int store);
+#ifdef HAVE_X86_SIMD
+void Local_mat_vect_half_avx2(const uint16_t local_A[],
+             const float global_x[], float local_y[], int local_m, int n,
+             int store);
+void Local_mat_vect_half_avx512(const uint16_t local_A[],
+             const float global_x[], float local_y[], int local_m, int n,
+             int store);
+#endif
+Local_mat_vect_half_t Select_local_mat_vect_half(int store);
+void Report_precision_error(float local_y[], float ref_y[], int local_m,
+             int store, int my_rank, MPI_Comm comm);
+void Gen_spd_matrix(float local_A[], int local_m, int n, int my_rank);
+int  Cg_solve(float local_A[], float local_b[], float local_x[],
+             float global_x[], int n, int local_n, int max_iter, double tol,
+             double* res_p, MPI_Comm comm);
+int  Power_iteration(float local_A[], float local_x[], float global_x[],
+             int n, int local_n, int max_iter, double tol,
+             double* lambda_p, MPI_Comm comm);
+
+/* Local kernels, set by Select_local_mat_vect, Select_local_mat_block, */
+/* and Select_local_mat_vect_half the first time they're needed        */
+Local_mat_vect_t      Local_mat_vect = NULL;
+Local_mat_block_t     Local_mat_block = NULL;
+Local_mat_vect_half_t Local_mat_vect_half = NULL;
 
 int main(int argc, char* argv[]) {
     int             my_rank;
     int             p;
     float*          local_A; 
+    uint16_t*       local_A16;
     float*          global_x;
     float*          local_x;
     float*          local_y;
+    float*          ref_y;
     int             m, n;
     int             local_m, local_n;
+    int             k, store;
+    int             solver, max_iter, iters;
+    double          tol, result, start, elapsed;
+    long            seed;
+    char*           mat_file;
+    char*           vec_file;
+    char*           out_file;
+    char*           cfg_file;
+    int             dims[2];
+    int             x_rows, x_cols;
     MPI_Comm        comm;
 
     MPI_Init(&argc, &argv);
@@ -53,30 +272,132 @@ int main(int argc, char* argv[]) {
     MPI_Comm_size(comm, &p);
     MPI_Comm_rank(comm, &my_rank);
 
-    if (my_rank == 0) {
-        printf("Enter the order of the matrix (m x n)\n");
-        scanf("%d %d", &m, &n);
-    }
-    MPI_Bcast(&m, 1, MPI_INT, 0, comm);
-    MPI_Bcast(&n, 1, MPI_INT, 0, comm);
+    Get_args(argc, argv, &k, &store, &solver, &max_iter, &tol, &seed,
+        &mat_file, &vec_file, &out_file, dims, &cfg_file);
 
-    local_m = m/p;
-    local_n = n/p;
+    if (mat_file != NULL) {
+        local_A = Read_array_mpiio(mat_file, 0, &m, &n, my_rank, p, comm);
+        /* The reader only needs p to divide the rows, but x and y are */
+        /* distributed by blocks of n/p                                */
+        if (n % p != 0) {
+            if (my_rank == 0)
+                fprintf(stderr, "%s:  %d columns can't be split into %d "
+                    "blocks of x\n", mat_file, n, p);
+            MPI_Abort(comm, 1);
+        }
+        local_m = m/p;
+        local_n = n/p;
+    } else {
+        Get_dims(dims, cfg_file, &m, &n, my_rank, comm);
+        local_m = m/p;
+        local_n = n/p;
 
-    local_A = malloc(local_m*n*sizeof(float));
-    Gen_array(local_A, local_m*n, my_rank);
+        local_A = malloc((size_t) local_m*n*sizeof(float));
+        if (solver == SOLVER_CG)
+            Gen_spd_matrix(local_A, local_m, n, my_rank);
+        else
+            Gen_local_array(local_A, (long long) my_rank*local_m*n,
+                local_m*n, STREAM_A, my_rank, seed);
+    }
 //  Print_matrix("We read", local_A, local_m, n, my_rank, p, comm);
+    if (out_file != NULL)
+        Write_array_mpiio(out_file, local_A, local_m, n, my_rank, p, comm);
+
+    if (solver != SOLVER_NONE && m != n) {
+        if (my_rank == 0)
+            fprintf(stderr, "The solvers need a square matrix\n");
+        free(local_A);
+        MPI_Finalize();
+        return 0;
+    }
 
-    local_x = malloc(local_n*sizeof(float));
-    Gen_array(local_x, local_n, 10*my_rank);
+    /* For the solvers x is the right-hand side (CG) or the start (power) */
+    if (vec_file != NULL) {
+        local_x = Read_array_mpiio(vec_file, k, &x_rows, &x_cols, my_rank,
+            p, comm);
+        if (x_rows != n) {
+            if (my_rank == 0)
+                fprintf(stderr, "%s has %d rows, the matrix has %d columns\n",
+                    vec_file, x_rows, n);
+            MPI_Abort(comm, 1);
+        }
+    } else {
+        local_x = malloc((size_t) local_n*k*sizeof(float));
+        Gen_local_array(local_x, (long long) my_rank*local_n*k, local_n*k,
+            STREAM_X, 10*my_rank, seed);
+    }
 //  Print_vector("We read", local_x, local_n, my_rank, p, comm);
 
-    local_y = malloc(local_m*sizeof(float));
-    global_x = malloc(n*sizeof(float));
+    if (solver != SOLVER_NONE) {
+        local_y = malloc(local_n*sizeof(float));
+        global_x = malloc(n*sizeof(float));
 
-    Parallel_matrix_vector_prod(local_A, m, n, local_x, global_x, 
-        local_y, local_m, local_n, comm);
-    Print_vector("The product is", local_y, local_m, my_rank, p, comm);
+        MPI_Barrier(comm);
+        start = MPI_Wtime();
+        if (solver == SOLVER_CG)
+            iters = Cg_solve(local_A, local_x, local_y, global_x, n,
+                local_n, max_iter, tol, &result, comm);
+        else
+            iters = Power_iteration(local_A, local_x, global_x, n, local_n,
+                max_iter, tol, &result, comm);
+        elapsed = MPI_Wtime() - start;
+        MPI_Reduce(my_rank == 0 ? MPI_IN_PLACE : &elapsed, &elapsed, 1,
+            MPI_DOUBLE, MPI_MAX, 0, comm);
+
+        if (my_rank == 0) {
+            printf("%s:  %d iterations, %e seconds per iteration\n",
+                solver == SOLVER_CG ? "CG" : "Power iteration", iters,
+                iters > 0 ? elapsed/iters : 0.0);
+            if (solver == SOLVER_CG)
+                printf("   relative residual ||b - Ax||/||b|| = %e\n",
+                    result);
+            else
+                printf("   dominant eigenvalue = %.8e\n", result);
+        }
+
+        free(local_A);
+        free(local_x);
+        free(local_y);
+        free(global_x);
+        MPI_Finalize();
+        return 0;
+    }
+
+    local_y = malloc(local_m*k*sizeof(float));
+    global_x = malloc(n*k*sizeof(float));
+
+    if (store != STORE_FP32) {
+        /* fp32 product for reference, then switch to 16-bit storage */
+        ref_y = malloc(local_m*sizeof(float));
+        Parallel_matrix_vector_prod(local_A, m, n, local_x, global_x, 
+            ref_y, local_m, local_n, comm);
+        local_A16 = malloc(local_m*n*sizeof(uint16_t));
+        Convert_array(local_A, local_A16, local_m*n, store);
+        free(local_A);
+        local_A = NULL;
+
+        Parallel_matrix_vector_prod_half(local_A16, m, n, local_x,
+            global_x, local_y, local_m, local_n, store, comm);
+        Report_precision_error(local_y, ref_y, local_m, store, my_rank,
+            comm);
+        free(local_A16);
+        free(ref_y);
+    } else if (k == 1) {
+        Parallel_matrix_vector_prod(local_A, m, n, local_x, global_x, 
+            local_y, local_m, local_n, comm);
+    } else {
+        Parallel_matrix_block_prod(local_A, m, n, local_x, global_x, 
+            local_y, local_m, local_n, k, comm);
+    }
+#   ifdef DEBUG
+    if (store == STORE_FP32)
+        Check_local_prod(local_A, global_x, local_y, local_m, n, k, my_rank);
+#   endif
+    if (k == 1)
+        Print_vector("The product is", local_y, local_m, my_rank, p, comm);
+    else
+        Print_matrix("The products are", local_y, local_m, k, my_rank,
+            p, comm);
 
     free(local_A);
     free(local_x); 
@@ -103,6 +424,457 @@ void Gen_array(float array[], int size, int seed) {
       array[i] = random()/((double) RAND_MAX);
 }  /* Gen_array */
 
+
+/*--------------------------------------------------------------------
+ * Function:  Philox4x32
+ * Purpose:   Philox4x32-10 block function (Salmon et al., SC11):  ten
+ *            rounds that turn a 4-word counter into 4 random words
+ * In arg:    key:  the seed
+ * In/out:    ctr:  in:  the counter, out:  the random words
+ */
+void Philox4x32(
+         uint32_t ctr[]  /* in/out */,
+         uint32_t key    /* in     */) {
+
+    uint32_t k0 = key, k1 = 0;
+    uint64_t p0, p1;
+    int      round;
+
+    for (round = 0; round < 10; round++) {
+        p0 = (uint64_t) 0xD2511F53 * ctr[0];
+        p1 = (uint64_t) 0xCD9E8D57 * ctr[2];
+        ctr[0] = (uint32_t) (p1 >> 32) ^ ctr[1] ^ k0;
+        ctr[1] = (uint32_t) p1;
+        ctr[2] = (uint32_t) (p0 >> 32) ^ ctr[3] ^ k1;
+        ctr[3] = (uint32_t) p0;
+        k0 += 0x9E3779B9;
+        k1 += 0xBB67AE85;
+    }
+}  /* Philox4x32 */
+
+
+#ifdef HAVE_X86_SIMD
+/*--------------------------------------------------------------------
+ * Function:  Philox4x32_avx2
+ * Purpose:   Run Philox4x32 on the 4 counters (first_ctr + l, stream)
+ *            l = 0, 1, 2, 3, at once.  Each 32-bit word lives in a
+ *            64-bit lane so that _mm256_mul_epu32 gives the full
+ *            product.
+ * In args:   first_ctr, stream, key
+ * Out arg:   out:  16 words, the 4 words of counter l in out[4l..4l+3]
+ */
+__attribute__((target("avx2")))
+void Philox4x32_avx2(
+         uint32_t out[]      /* out */,
+         uint64_t first_ctr  /* in  */,
+         int      stream     /* in  */,
+         uint32_t key        /* in  */) {
+
+    const __m256i lo_mask = _mm256_set1_epi64x(0xFFFFFFFF);
+    const __m256i m0 = _mm256_set1_epi64x(0xD2511F53);
+    const __m256i m1 = _mm256_set1_epi64x(0xCD9E8D57);
+    __m256i c0, c1, c2, c3, p0, p1, k0, k1;
+    uint64_t w[4][4];
+    int      round, l;
+
+    c0 = _mm256_and_si256(_mm256_add_epi64(_mm256_set1_epi64x(first_ctr),
+            _mm256_set_epi64x(3, 2, 1, 0)), lo_mask);
+    c1 = _mm256_srli_epi64(_mm256_add_epi64(_mm256_set1_epi64x(first_ctr),
+            _mm256_set_epi64x(3, 2, 1, 0)), 32);
+    c2 = _mm256_set1_epi64x((uint32_t) stream);
+    c3 = _mm256_setzero_si256();
+    k0 = _mm256_set1_epi64x(key);
+    k1 = _mm256_setzero_si256();
+
+    for (round = 0; round < 10; round++) {
+        p0 = _mm256_mul_epu32(c0, m0);
+        p1 = _mm256_mul_epu32(c2, m1);
+        c0 = _mm256_xor_si256(_mm256_xor_si256(_mm256_srli_epi64(p1, 32),
+                c1), k0);
+        c1 = _mm256_and_si256(p1, lo_mask);
+        c2 = _mm256_xor_si256(_mm256_xor_si256(_mm256_srli_epi64(p0, 32),
+                c3), k1);
+        c3 = _mm256_and_si256(p0, lo_mask);
+        k0 = _mm256_and_si256(_mm256_add_epi64(k0,
+                _mm256_set1_epi64x(0x9E3779B9)), lo_mask);
+        k1 = _mm256_and_si256(_mm256_add_epi64(k1,
+                _mm256_set1_epi64x(0xBB67AE85)), lo_mask);
+    }
+    _mm256_storeu_si256((__m256i*) w[0], c0);
+    _mm256_storeu_si256((__m256i*) w[1], c1);
+    _mm256_storeu_si256((__m256i*) w[2], c2);
+    _mm256_storeu_si256((__m256i*) w[3], c3);
+    for (l = 0; l < 4; l++) {
+        out[4*l]   = (uint32_t) w[0][l];
+        out[4*l+1] = (uint32_t) w[1][l];
+        out[4*l+2] = (uint32_t) w[2][l];
+        out[4*l+3] = (uint32_t) w[3][l];
+    }
+}  /* Philox4x32_avx2 */
+#endif  /* HAVE_X86_SIMD */
+
+
+/*--------------------------------------------------------------------
+ * Function:  Gen_array_cb
+ * Purpose:   Generate entries first, first+1, ..., first+size-1 of a
+ *            global random array with a counter-based generator.
+ *            Entry L only depends on L, stream and seed, so any
+ *            process can generate any part of the array.  Values are
+ *            in [0, 1) with 24 random bits.
+ * In args:   first:  global index of array[0]
+ *            size:  the number of entries to generate
+ *            stream:  which array (STREAM_A, STREAM_X)
+ *            seed:  the global seed
+ * Out arg:   array
+ */
+void Gen_array_cb(
+         float     array[]  /* out */,
+         long long first    /* in  */,
+         int       size     /* in  */,
+         int       stream   /* in  */,
+         uint32_t  seed     /* in  */) {
+
+    long long first_ctr = first/4;
+    long long last_ctr = (first + size - 1)/4;   /* inclusive */
+    long long ctr, L;
+    int       use_avx2 = 0;
+
+    if (size <= 0) return;
+#   ifdef HAVE_X86_SIMD
+    use_avx2 = __builtin_cpu_supports("avx2");
+#   endif
+
+#   ifdef _OPENMP
+#   pragma omp parallel for schedule(static) private(L)
+#   endif
+    for (ctr = first_ctr; ctr <= last_ctr; ctr += 4) {
+        uint32_t words[16], c[4];
+        int      l, w;
+        int      n_ctr = (last_ctr - ctr + 1 < 4) ? last_ctr - ctr + 1 : 4;
+
+#       ifdef HAVE_X86_SIMD
+        if (use_avx2) {
+            Philox4x32_avx2(words, ctr, stream, seed);
+        } else
+#       endif
+        {
+            for (l = 0; l < n_ctr; l++) {
+                c[0] = (uint32_t) (ctr + l);
+                c[1] = (uint32_t) ((uint64_t) (ctr + l) >> 32);
+                c[2] = (uint32_t) stream;
+                c[3] = 0;
+                Philox4x32(c, seed);
+                for (w = 0; w < 4; w++)
+                    words[4*l + w] = c[w];
+            }
+        }
+        for (l = 0; l < 4*n_ctr; l++) {
+            L = 4*ctr + l;
+            if (L >= first && L < first + size)
+                array[L - first] = (words[l] >> 8)*(1.0f/16777216.0f);
+        }
+    }
+}  /* Gen_array_cb */
+
+
+/*--------------------------------------------------------------------
+ * Function:  Gen_local_array
+ * Purpose:   Generate my part of a global random array, either with
+ *            Gen_array (seed < 0) or with Gen_array_cb
+ * In args:   first:  global index of array[0]
+ *            size:  the number of entries
+ *            stream:  which array, for Gen_array_cb
+ *            legacy_seed:  per-process seed for Gen_array
+ *            seed:  global seed for Gen_array_cb, or < 0
+ * Out arg:   array
+ */
+void Gen_local_array(
+         float     array[]      /* out */,
+         long long first        /* in  */,
+         int       size         /* in  */,
+         int       stream       /* in  */,
+         int       legacy_seed  /* in  */,
+         long      seed         /* in  */) {
+
+    if (seed < 0)
+        Gen_array(array, size, legacy_seed);
+    else
+        Gen_array_cb(array, first, size, stream, (uint32_t) seed);
+}  /* Gen_local_array */
+
+
+/*--------------------------------------------------------------------
+ * Function:  Read_array_mpiio
+ * Purpose:   Read a rows x cols array from a binary or text file and
+ *            distribute it by block rows.  Every process reads its
+ *            own block, so nothing goes through process 0.
+ * In args:   file_name
+ *            row_len:  the number of entries per row, or 0 to take
+ *               cols from the file.  Vector files use row_len = k,
+ *               so the layout of the lines in the file doesn't matter.
+ *            my_rank, p, comm
+ * Out args:  rows_p, cols_p:  the order of the array
+ * Return:    my rows/p x cols block, allocated here
+ */
+float* Read_array_mpiio(
+         char*    file_name  /* in  */,
+         int      row_len    /* in  */,
+         int*     rows_p     /* out */,
+         int*     cols_p     /* out */,
+         int      my_rank    /* in  */,
+         int      p          /* in  */,
+         MPI_Comm comm       /* in  */) {
+
+    MPI_File   fh;
+    MPI_Offset offset;
+    int        header[4] = {0, 0, 0, 0};
+    int        local_rows;
+    long long  total;
+    float*     local_A;
+
+    if (MPI_File_open(comm, file_name, MPI_MODE_RDONLY, MPI_INFO_NULL, &fh)
+            != MPI_SUCCESS) {
+        if (my_rank == 0)
+            fprintf(stderr, "Can't open %s\n", file_name);
+        MPI_Abort(comm, 1);
+    }
+    MPI_File_read_at_all(fh, 0, header, 4, MPI_INT, MPI_STATUS_IGNORE);
+
+    if (header[0] != BIN_MAGIC) {
+        local_A = Read_text_mpiio(fh, row_len, rows_p, cols_p, my_rank, p,
+            comm);
+        MPI_File_close(&fh);
+        return local_A;
+    }
+
+    total = (long long) header[1]*header[2];
+    *cols_p = (row_len > 0) ? row_len : header[2];
+    *rows_p = (int) (total / *cols_p);
+    if (total % *cols_p != 0 || *rows_p % p != 0) {
+        if (my_rank == 0)
+            fprintf(stderr, "%s:  %d x %d can't be split into blocks of rows\n",
+                file_name, *rows_p, *cols_p);
+        MPI_Abort(comm, 1);
+    }
+    local_rows = *rows_p/p;
+    local_A = malloc((size_t) local_rows * *cols_p * sizeof(float));
+    offset = BIN_HEADER + (MPI_Offset) my_rank*local_rows * *cols_p
+             * sizeof(float);
+    MPI_File_read_at_all(fh, offset, local_A, local_rows * *cols_p,
+        MPI_FLOAT, MPI_STATUS_IGNORE);
+    MPI_File_close(&fh);
+
+    return local_A;
+}  /* Read_array_mpiio */
+
+
+/*--------------------------------------------------------------------
+ * Function:  Read_text_mpiio
+ * Purpose:   Parse a text file of whitespace separated floats in
+ *            parallel and distribute it by block rows.  The file is
+ *            split at line boundaries:  each process reads 1/p of the
+ *            bytes and sends the partial line at the start of its
+ *            chunk to the previous process.
+ * In args:   fh:  the open file
+ *            row_len, my_rank, p, comm:  see Read_array_mpiio
+ * Out args:  rows_p, cols_p:  the order of the array.  If row_len is
+ *               0, cols is the number of values on the first line.
+ * Return:    my rows/p x cols block, allocated here
+ * Note:      A process whose chunk has no line break passes all of its
+ *            text back, so long lines work, but they serialize the
+ *            processes they span.
+ */
+float* Read_text_mpiio(
+         MPI_File fh         /* in  */,
+         int      row_len    /* in  */,
+         int*     rows_p     /* out */,
+         int*     cols_p     /* out */,
+         int      my_rank    /* in  */,
+         int      p          /* in  */,
+         MPI_Comm comm       /* in  */) {
+
+    MPI_Offset file_size, start, end;
+    int        chunk_len, frag_len, next_len = 0, text_len;
+    int        found_newline = 0;
+    int        i, q, count, max_count, first_line_vals, local_rows;
+    long long  my_first, total, block, g;
+    char*      text;
+    char*      more;
+    char*      ptr;
+    MPI_Request reqs[2];
+    int        n_req;
+    char*      end_ptr;
+    float*     vals;
+    float*     local_A;
+    int*       send_counts = calloc(p, sizeof(int));
+    int*       send_displs = malloc(p*sizeof(int));
+    int*       recv_counts = malloc(p*sizeof(int));
+    int*       recv_displs = malloc(p*sizeof(int));
+
+    MPI_File_get_size(fh, &file_size);
+    start = file_size*my_rank/p;
+    end = file_size*(my_rank+1)/p;
+    chunk_len = (int) (end - start);
+
+    /* Room for our chunk, the next process' fragment, and a '\0' */
+    text = malloc(chunk_len + 1);
+    MPI_File_read_at_all(fh, start, text, chunk_len, MPI_CHAR,
+        MPI_STATUS_IGNORE);
+
+    /* Bytes before the first line break belong to the previous process. */
+    /* If there's no line break, all of our text (including what we get   */
+    /* from the next process) does, and we have to wait for the next      */
+    /* process before sending.  Otherwise send right away.                */
+    frag_len = 0;
+    n_req = 0;
+    if (my_rank > 0) {
+        while (frag_len < chunk_len && text[frag_len] != '\n')
+            frag_len++;
+        /* frag_len == chunk_len after the ++ below doesn't mean "no  */
+        /* line break":  the break can be the chunk's last byte.      */
+        found_newline = (frag_len < chunk_len);
+        if (found_newline) {
+            frag_len++;
+            MPI_Isend(&frag_len, 1, MPI_INT, my_rank-1, 0, comm,
+                &reqs[n_req++]);
+            MPI_Isend(text, frag_len, MPI_CHAR, my_rank-1, 1, comm,
+                &reqs[n_req++]);
+        }
+    }
+    if (my_rank < p-1) {
+        MPI_Recv(&next_len, 1, MPI_INT, my_rank+1, 0, comm,
+            MPI_STATUS_IGNORE);
+        more = malloc(next_len > 0 ? next_len : 1);
+        MPI_Recv(more, next_len, MPI_CHAR, my_rank+1, 1, comm,
+            MPI_STATUS_IGNORE);
+        /* Don't touch text until the Isends are done */
+        MPI_Waitall(n_req, reqs, MPI_STATUSES_IGNORE);
+        n_req = 0;
+        text = realloc(text, chunk_len + next_len + 1);
+        memcpy(text + chunk_len, more, next_len);
+        free(more);
+    }
+    text_len = chunk_len + next_len;
+    if (my_rank > 0 && !found_newline) {
+        frag_len = text_len;
+        MPI_Send(&frag_len, 1, MPI_INT, my_rank-1, 0, comm);
+        MPI_Send(text, frag_len, MPI_CHAR, my_rank-1, 1, comm);
+    }
+    MPI_Waitall(n_req, reqs, MPI_STATUSES_IGNORE);
+    text[text_len] = '\0';
+
+    /* Parse my whole lines.  A float takes at least 2 bytes of text. */
+    vals = malloc(((text_len - frag_len)/2 + 1)*sizeof(float));
+    count = 0;
+    first_line_vals = 0;
+    ptr = text + frag_len;
+    for (;;) {
+        while (*ptr == ' ' || *ptr == '\t' || *ptr == '\r') ptr++;
+        if (*ptr == '\n' && my_rank == 0 && count > 0
+                && first_line_vals == 0)
+            first_line_vals = count;
+        if (*ptr == '\0') break;
+        if (*ptr == '\n') {
+            ptr++;
+            continue;
+        }
+        vals[count] = strtof(ptr, &end_ptr);
+        if (end_ptr == ptr) {
+            fprintf(stderr, "Proc %d > can't parse \"%.20s\"\n", my_rank, ptr);
+            MPI_Abort(comm, 1);
+        }
+        count++;
+        ptr = end_ptr;
+    }
+    if (my_rank == 0 && first_line_vals == 0) first_line_vals = count;
+    free(text);
+
+    /* Work out the shape and where my values start */
+    MPI_Bcast(&first_line_vals, 1, MPI_INT, 0, comm);
+    g = count;
+    MPI_Allreduce(&g, &total, 1, MPI_LONG_LONG, MPI_SUM, comm);
+    my_first = 0;
+    MPI_Exscan(&g, &my_first, 1, MPI_LONG_LONG, MPI_SUM, comm);
+    if (my_rank == 0) my_first = 0;
+
+    *cols_p = (row_len > 0) ? row_len : first_line_vals;
+    *rows_p = (*cols_p > 0) ? (int) (total / *cols_p) : 0;
+    if (*cols_p <= 0 || total % *cols_p != 0 || *rows_p % p != 0) {
+        if (my_rank == 0)
+            fprintf(stderr, "%lld values can't be split into %d blocks of "
+                "rows with %d columns\n", total, p, *cols_p);
+        MPI_Abort(comm, 1);
+    }
+    local_rows = *rows_p/p;
+    block = (long long) local_rows * *cols_p;
+
+    /* My values are contiguous, so they go to a range of processes */
+    for (i = 0; i < count; ) {
+        q = (int) ((my_first + i)/block);
+        max_count = (int) ((q+1)*block - (my_first + i));
+        send_counts[q] = (count - i < max_count) ? count - i : max_count;
+        i += send_counts[q];
+    }
+    MPI_Alltoall(send_counts, 1, MPI_INT, recv_counts, 1, MPI_INT, comm);
+    send_displs[0] = recv_displs[0] = 0;
+    for (q = 1; q < p; q++) {
+        send_displs[q] = send_displs[q-1] + send_counts[q-1];
+        recv_displs[q] = recv_displs[q-1] + recv_counts[q-1];
+    }
+    local_A = malloc(block*sizeof(float));
+    MPI_Alltoallv(vals, send_counts, send_displs, MPI_FLOAT,
+        local_A, recv_counts, recv_displs, MPI_FLOAT, comm);
+
+    free(vals);
+    free(send_counts);
+    free(send_displs);
+    free(recv_counts);
+    free(recv_displs);
+    return local_A;
+}  /* Read_text_mpiio */
+
+
+/*--------------------------------------------------------------------
+ * Function:  Write_array_mpiio
+ * Purpose:   Write an array distributed by block rows to a binary file
+ *            that Read_array_mpiio can read
+ * In args:   file_name
+ *            local_A:  my local_rows x cols block
+ *            local_rows, cols, my_rank, p, comm
+ */
+void Write_array_mpiio(
+         char*    file_name   /* in */,
+         float    local_A[]   /* in */,
+         int      local_rows  /* in */,
+         int      cols        /* in */,
+         int      my_rank     /* in */,
+         int      p           /* in */,
+         MPI_Comm comm        /* in */) {
+
+    MPI_File   fh;
+    MPI_Offset offset;
+    int        header[4];
+
+    if (MPI_File_open(comm, file_name, MPI_MODE_WRONLY | MPI_MODE_CREATE,
+            MPI_INFO_NULL, &fh) != MPI_SUCCESS) {
+        if (my_rank == 0)
+            fprintf(stderr, "Can't open %s\n", file_name);
+        MPI_Abort(comm, 1);
+    }
+    MPI_File_set_size(fh, 0);
+    if (my_rank == 0) {
+        header[0] = BIN_MAGIC;
+        header[1] = local_rows*p;
+        header[2] = cols;
+        header[3] = 0;
+        MPI_File_write_at(fh, 0, header, 4, MPI_INT, MPI_STATUS_IGNORE);
+    }
+    offset = BIN_HEADER + (MPI_Offset) my_rank*local_rows*cols*sizeof(float);
+    MPI_File_write_at_all(fh, offset, local_A, local_rows*cols, MPI_FLOAT,
+        MPI_STATUS_IGNORE);
+    MPI_File_close(&fh);
+}  /* Write_array_mpiio */
+
 /*--------------------------------------------------------------------
  * Function:  Read_matrix
  * Purpose:   Read an m x n matrix from stdin and distribute it by
@@ -217,17 +989,1070 @@ void Parallel_matrix_vector_prod(
 
     /* local_m = m/p, local_n = n/p */
 
-    int local_i, j;
+    if (Local_mat_vect == NULL)
+        Local_mat_vect = Select_local_mat_vect();
 
     MPI_Allgather(local_x, local_n, MPI_FLOAT,
                    global_x, local_n, MPI_FLOAT,
                    comm);
+    Local_mat_vect(local_A, global_x, local_y, local_m, n);
+}  /* Parallel_matrix_vector_prod */
+
+
+/*--------------------------------------------------------------------
+ * Function:  Local_mat_vect_ref
+ * Purpose:   Scalar reference version of the local product
+ *            local_y = local_A*global_x.  Used when no vector kernel
+ *            is available, and to validate the vector kernels.
+ * In args:   local_A:  my rows of A
+ *            global_x:  all of x
+ *            local_m:  the number of rows in local_A
+ *            n:  the number of columns in local_A
+ * Out arg:   local_y:  my components of Ax
+ */
+void Local_mat_vect_ref(
+         const float local_A[]   /* in  */,
+         const float global_x[]  /* in  */,
+         float       local_y[]   /* out */,
+         int         local_m     /* in  */,
+         int         n           /* in  */) {
+
+    int local_i, j;
+
     for (local_i = 0; local_i < local_m; local_i++) {
         local_y[local_i] = 0.0;
         for (j = 0; j < n; j++)
             local_y[local_i] += local_A[local_i*n+j]*global_x[j];
     }
-}  /* Parallel_matrix_vector_prod */
+}  /* Local_mat_vect_ref */
+
+
+#ifdef HAVE_X86_SIMD
+/*--------------------------------------------------------------------
+ * Function:  Hsum_256
+ * Purpose:   Add the 8 floats in an AVX register
+ */
+__attribute__((target("avx2,fma")))
+static inline float Hsum_256(__m256 v) {
+    __m128 lo = _mm_add_ps(_mm256_castps256_ps128(v),
+                           _mm256_extractf128_ps(v, 1));
+    lo = _mm_add_ps(lo, _mm_movehl_ps(lo, lo));
+    lo = _mm_add_ss(lo, _mm_movehdup_ps(lo));
+    return _mm_cvtss_f32(lo);
+}  /* Hsum_256 */
+
+
+/*--------------------------------------------------------------------
+ * Function:  Local_mat_vect_avx2
+ * Purpose:   AVX2/FMA version of Local_mat_vect_ref.  Works on 4 rows
+ *            at a time with one accumulator register per row, so each
+ *            8-float chunk of global_x is loaded once for 4 rows.
+ *            Columns are processed in blocks of COL_BLOCK.
+ * In args, out arg:  see Local_mat_vect_ref
+ */
+__attribute__((target("avx2,fma")))
+void Local_mat_vect_avx2(
+         const float local_A[]   /* in  */,
+         const float global_x[]  /* in  */,
+         float       local_y[]   /* out */,
+         int         local_m     /* in  */,
+         int         n           /* in  */) {
+
+    int local_i, j, jb, j_end;
+    const float *a0, *a1, *a2, *a3;
+    __m256 x, y0, y1, y2, y3;
+    float s0, s1, s2, s3;
+
+    for (local_i = 0; local_i < local_m; local_i++)
+        local_y[local_i] = 0.0;
+
+    for (jb = 0; jb < n; jb += COL_BLOCK) {
+        j_end = (jb + COL_BLOCK < n) ? jb + COL_BLOCK : n;
+        for (local_i = 0; local_i + 4 <= local_m; local_i += 4) {
+            a0 = local_A + (size_t) local_i*n;
+            a1 = a0 + n;
+            a2 = a1 + n;
+            a3 = a2 + n;
+            y0 = y1 = y2 = y3 = _mm256_setzero_ps();
+            for (j = jb; j + 8 <= j_end; j += 8) {
+                x = _mm256_loadu_ps(global_x + j);
+                y0 = _mm256_fmadd_ps(_mm256_loadu_ps(a0 + j), x, y0);
+                y1 = _mm256_fmadd_ps(_mm256_loadu_ps(a1 + j), x, y1);
+                y2 = _mm256_fmadd_ps(_mm256_loadu_ps(a2 + j), x, y2);
+                y3 = _mm256_fmadd_ps(_mm256_loadu_ps(a3 + j), x, y3);
+            }
+            s0 = Hsum_256(y0);
+            s1 = Hsum_256(y1);
+            s2 = Hsum_256(y2);
+            s3 = Hsum_256(y3);
+            for (; j < j_end; j++) {
+                s0 += a0[j]*global_x[j];
+                s1 += a1[j]*global_x[j];
+                s2 += a2[j]*global_x[j];
+                s3 += a3[j]*global_x[j];
+            }
+            local_y[local_i]   += s0;
+            local_y[local_i+1] += s1;
+            local_y[local_i+2] += s2;
+            local_y[local_i+3] += s3;
+        }
+        /* Leftover rows */
+        for (; local_i < local_m; local_i++) {
+            a0 = local_A + (size_t) local_i*n;
+            y0 = _mm256_setzero_ps();
+            for (j = jb; j + 8 <= j_end; j += 8)
+                y0 = _mm256_fmadd_ps(_mm256_loadu_ps(a0 + j),
+                        _mm256_loadu_ps(global_x + j), y0);
+            s0 = Hsum_256(y0);
+            for (; j < j_end; j++)
+                s0 += a0[j]*global_x[j];
+            local_y[local_i] += s0;
+        }
+    }
+}  /* Local_mat_vect_avx2 */
+
+
+/*--------------------------------------------------------------------
+ * Function:  Local_mat_vect_avx512
+ * Purpose:   AVX-512 version of Local_mat_vect_ref.  Works on 8 rows
+ *            at a time with one accumulator register per row.  The
+ *            ragged end of each column block is handled with a mask.
+ * In args, out arg:  see Local_mat_vect_ref
+ */
+__attribute__((target("avx512f")))
+void Local_mat_vect_avx512(
+         const float local_A[]   /* in  */,
+         const float global_x[]  /* in  */,
+         float       local_y[]   /* out */,
+         int         local_m     /* in  */,
+         int         n           /* in  */) {
+
+    int local_i, r, rows, j, jb, j_end;
+    const float* a[8];
+    __m512 x, acc[8];
+    __mmask16 mask;
+
+    for (local_i = 0; local_i < local_m; local_i++)
+        local_y[local_i] = 0.0;
+
+    for (jb = 0; jb < n; jb += COL_BLOCK) {
+        j_end = (jb + COL_BLOCK < n) ? jb + COL_BLOCK : n;
+        mask = (__mmask16) ((1u << ((j_end - jb) % 16)) - 1);
+        for (local_i = 0; local_i < local_m; local_i += rows) {
+            rows = (local_m - local_i < 8) ? local_m - local_i : 8;
+            for (r = 0; r < 8; r++) {
+                /* Unused rows just repeat the last real row */
+                a[r] = local_A + (size_t) (local_i + (r < rows ? r : rows-1))*n;
+                acc[r] = _mm512_setzero_ps();
+            }
+            for (j = jb; j + 16 <= j_end; j += 16) {
+                x = _mm512_loadu_ps(global_x + j);
+                for (r = 0; r < 8; r++)
+                    acc[r] = _mm512_fmadd_ps(_mm512_loadu_ps(a[r] + j),
+                            x, acc[r]);
+            }
+            if (j < j_end) {
+                x = _mm512_maskz_loadu_ps(mask, global_x + j);
+                for (r = 0; r < 8; r++)
+                    acc[r] = _mm512_fmadd_ps(
+                            _mm512_maskz_loadu_ps(mask, a[r] + j), x, acc[r]);
+            }
+            for (r = 0; r < rows; r++)
+                local_y[local_i + r] += _mm512_reduce_add_ps(acc[r]);
+        }
+    }
+}  /* Local_mat_vect_avx512 */
+#endif  /* HAVE_X86_SIMD */
+
+
+/*--------------------------------------------------------------------
+ * Function:  Select_local_mat_vect
+ * Purpose:   Choose the fastest local kernel the CPU supports
+ * Return:    pointer to the kernel
+ */
+Local_mat_vect_t Select_local_mat_vect(void) {
+#   ifdef HAVE_X86_SIMD
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f"))
+        return Local_mat_vect_avx512;
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+        return Local_mat_vect_avx2;
+#   endif
+    return Local_mat_vect_ref;
+}  /* Select_local_mat_vect */
+
+
+/*--------------------------------------------------------------------
+ * Function:  Parallel_matrix_block_prod
+ * Purpose:   Multiply a matrix distributed by block rows by a block
+ *            of k vectors distributed by block rows
+ * In args:   local_A:  my rows of the matrix A
+ *            m:  the number of rows in the global matrix A
+ *            n:  the number of columns in A
+ *            local_X:  my local_n x k rows of the block of vectors X
+ *            local_m:  the number of rows in my block of A
+ *            local_n:  the number of rows in my block of X
+ *            k:  the number of vectors
+ *            comm:  communicator for call to MPI_Allgather
+ * Out arg:   local_Y:  my local_m x k rows of the product AX
+ * Scratch:   global_X:  temporary storage for all of X (n x k)
+ * Note:      argument m is unused              
+ */
+void Parallel_matrix_block_prod(
+         float    local_A[]   /* in  */,
+         int      m           /* in  */,
+         int      n           /* in  */,
+         float    local_X[]   /* in  */,
+         float    global_X[]  /* in  */,
+         float    local_Y[]   /* out */,
+         int      local_m     /* in  */,
+         int      local_n     /* in  */,
+         int      k           /* in  */,
+         MPI_Comm comm        /* in  */) {
+
+    if (Local_mat_block == NULL)
+        Local_mat_block = Select_local_mat_block();
+
+    MPI_Allgather(local_X, local_n*k, MPI_FLOAT,
+                   global_X, local_n*k, MPI_FLOAT,
+                   comm);
+    Local_mat_block(local_A, global_X, local_Y, local_m, n, k);
+}  /* Parallel_matrix_block_prod */
+
+
+/*--------------------------------------------------------------------
+ * Function:  Local_mat_block_ref
+ * Purpose:   Scalar reference version of the local product
+ *            local_Y = local_A*global_X
+ * In args:   local_A:  my rows of A
+ *            global_X:  all of X, n x k
+ *            local_m:  the number of rows in local_A
+ *            n:  the number of columns in local_A
+ *            k:  the number of columns in X
+ * Out arg:   local_Y:  my local_m x k rows of AX
+ */
+void Local_mat_block_ref(
+         const float local_A[]   /* in  */,
+         const float global_X[]  /* in  */,
+         float       local_Y[]   /* out */,
+         int         local_m     /* in  */,
+         int         n           /* in  */,
+         int         k           /* in  */) {
+
+    int   local_i, j, c;
+    float a;
+
+    for (local_i = 0; local_i < local_m; local_i++) {
+        for (c = 0; c < k; c++)
+            local_Y[local_i*k+c] = 0.0;
+        for (j = 0; j < n; j++) {
+            a = local_A[local_i*n+j];
+            for (c = 0; c < k; c++)
+                local_Y[local_i*k+c] += a*global_X[j*k+c];
+        }
+    }
+}  /* Local_mat_block_ref */
+
+
+#ifdef HAVE_X86_SIMD
+/*--------------------------------------------------------------------
+ * Function:  Local_mat_block_avx2
+ * Purpose:   AVX2/FMA version of Local_mat_block_ref.  For 4 rows of
+ *            A and 8 columns of X at a time, the partial products stay
+ *            in 4 accumulator registers while we run down a block of
+ *            rows of X.  Each entry of A is broadcast and used for 8
+ *            vectors, so A is read from memory once per call.
+ * In args, out arg:  see Local_mat_block_ref
+ */
+__attribute__((target("avx2,fma")))
+void Local_mat_block_avx2(
+         const float local_A[]   /* in  */,
+         const float global_X[]  /* in  */,
+         float       local_Y[]   /* out */,
+         int         local_m     /* in  */,
+         int         n           /* in  */,
+         int         k           /* in  */) {
+
+    int local_i, r, rows, j, jb, j_end, c, x_rows;
+    const float* a[4];
+    float* y[4];
+    __m256 x, acc[4];
+    __m256i mask;
+    int lane[8];
+
+    /* Keep a block of x_rows rows of X (about COL_BLOCK floats) in L1 */
+    x_rows = COL_BLOCK/k > 0 ? COL_BLOCK/k : 1;
+    for (c = 0; c < 8; c++)
+        lane[c] = (c < k % 8) ? -1 : 0;
+    mask = _mm256_loadu_si256((__m256i*) lane);
+
+    for (local_i = 0; local_i < local_m*k; local_i++)
+        local_Y[local_i] = 0.0;
+
+    for (jb = 0; jb < n; jb += x_rows) {
+        j_end = (jb + x_rows < n) ? jb + x_rows : n;
+        for (local_i = 0; local_i < local_m; local_i += rows) {
+            rows = (local_m - local_i < 4) ? local_m - local_i : 4;
+            for (r = 0; r < 4; r++) {
+                /* Unused rows just repeat the last real row */
+                a[r] = local_A + (size_t) (local_i + (r < rows ? r : rows-1))*n;
+                y[r] = local_Y + (size_t) (local_i + (r < rows ? r : rows-1))*k;
+            }
+            for (c = 0; c < k; c += 8) {
+                if (c + 8 <= k) {
+                    for (r = 0; r < 4; r++)
+                        acc[r] = _mm256_loadu_ps(y[r] + c);
+                    for (j = jb; j < j_end; j++) {
+                        x = _mm256_loadu_ps(global_X + (size_t) j*k + c);
+                        for (r = 0; r < 4; r++)
+                            acc[r] = _mm256_fmadd_ps(
+                                    _mm256_broadcast_ss(a[r] + j), x, acc[r]);
+                    }
+                    for (r = 0; r < 4; r++)
+                        _mm256_storeu_ps(y[r] + c, acc[r]);
+                } else {
+                    for (r = 0; r < 4; r++)
+                        acc[r] = _mm256_maskload_ps(y[r] + c, mask);
+                    for (j = jb; j < j_end; j++) {
+                        x = _mm256_maskload_ps(global_X + (size_t) j*k + c,
+                                mask);
+                        for (r = 0; r < 4; r++)
+                            acc[r] = _mm256_fmadd_ps(
+                                    _mm256_broadcast_ss(a[r] + j), x, acc[r]);
+                    }
+                    for (r = 0; r < 4; r++)
+                        _mm256_maskstore_ps(y[r] + c, mask, acc[r]);
+                }
+            }
+        }
+    }
+}  /* Local_mat_block_avx2 */
+
+
+/*--------------------------------------------------------------------
+ * Function:  Local_mat_block_avx512
+ * Purpose:   AVX-512 version of Local_mat_block_ref.  Same scheme as
+ *            Local_mat_block_avx2, but 16 columns of X per register and
+ *            masked loads for the last few columns.
+ * In args, out arg:  see Local_mat_block_ref
+ */
+__attribute__((target("avx512f")))
+void Local_mat_block_avx512(
+         const float local_A[]   /* in  */,
+         const float global_X[]  /* in  */,
+         float       local_Y[]   /* out */,
+         int         local_m     /* in  */,
+         int         n           /* in  */,
+         int         k           /* in  */) {
+
+    int local_i, r, rows, j, jb, j_end, c, x_rows;
+    const float* a[4];
+    float* y[4];
+    __m512 x, acc[4];
+    __mmask16 mask;
+
+    x_rows = COL_BLOCK/k > 0 ? COL_BLOCK/k : 1;
+
+    for (local_i = 0; local_i < local_m*k; local_i++)
+        local_Y[local_i] = 0.0;
+
+    for (jb = 0; jb < n; jb += x_rows) {
+        j_end = (jb + x_rows < n) ? jb + x_rows : n;
+        for (local_i = 0; local_i < local_m; local_i += rows) {
+            rows = (local_m - local_i < 4) ? local_m - local_i : 4;
+            for (r = 0; r < 4; r++) {
+                /* Unused rows just repeat the last real row */
+                a[r] = local_A + (size_t) (local_i + (r < rows ? r : rows-1))*n;
+                y[r] = local_Y + (size_t) (local_i + (r < rows ? r : rows-1))*k;
+            }
+            for (c = 0; c < k; c += 16) {
+                mask = (k - c >= 16) ? (__mmask16) 0xFFFF
+                                     : (__mmask16) ((1u << (k - c)) - 1);
+                for (r = 0; r < 4; r++)
+                    acc[r] = _mm512_maskz_loadu_ps(mask, y[r] + c);
+                for (j = jb; j < j_end; j++) {
+                    x = _mm512_maskz_loadu_ps(mask,
+                            global_X + (size_t) j*k + c);
+                    for (r = 0; r < 4; r++)
+                        acc[r] = _mm512_fmadd_ps(
+                                _mm512_set1_ps(a[r][j]), x, acc[r]);
+                }
+                for (r = 0; r < 4; r++)
+                    _mm512_mask_storeu_ps(y[r] + c, mask, acc[r]);
+            }
+        }
+    }
+}  /* Local_mat_block_avx512 */
+#endif  /* HAVE_X86_SIMD */
+
+
+/*--------------------------------------------------------------------
+ * Function:  Select_local_mat_block
+ * Purpose:   Choose the fastest block kernel the CPU supports
+ * Return:    pointer to the kernel
+ */
+Local_mat_block_t Select_local_mat_block(void) {
+#   ifdef HAVE_X86_SIMD
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f"))
+        return Local_mat_block_avx512;
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+        return Local_mat_block_avx2;
+#   endif
+    return Local_mat_block_ref;
+}  /* Select_local_mat_block */
+
+
+/*--------------------------------------------------------------------
+ * Function:  Float_to_bf16
+ * Purpose:   Round a float to the nearest bfloat16 (ties to even)
+ */
+uint16_t Float_to_bf16(float x) {
+    uint32_t u;
+
+    memcpy(&u, &x, sizeof(u));
+    if ((u & 0x7fffffff) > 0x7f800000)  /* NaN:  keep it quiet */
+        return (uint16_t) ((u >> 16) | 0x40);
+    u += 0x7fff + ((u >> 16) & 1);
+    return (uint16_t) (u >> 16);
+}  /* Float_to_bf16 */
+
+
+/*--------------------------------------------------------------------
+ * Function:  Bf16_to_float
+ * Purpose:   Convert a bfloat16 to a float.  This is exact.
+ */
+float Bf16_to_float(uint16_t h) {
+    uint32_t u = (uint32_t) h << 16;
+    float    x;
+
+    memcpy(&x, &u, sizeof(x));
+    return x;
+}  /* Bf16_to_float */
+
+
+/*--------------------------------------------------------------------
+ * Function:  Float_to_fp16
+ * Purpose:   Round a float to the nearest IEEE half precision value
+ *            (ties to even).  Values too large become infinity.
+ */
+uint16_t Float_to_fp16(float x) {
+    uint32_t u, sign, mant, half, rem, halfway;
+    int      exp, shift;
+
+    memcpy(&u, &x, sizeof(u));
+    sign = (u >> 16) & 0x8000;
+    mant = u & 0x7fffff;
+    if (((u >> 23) & 0xff) == 0xff)     /* Inf or NaN */
+        return (uint16_t) (sign | 0x7c00 | (mant ? 0x200 : 0));
+    exp = (int) ((u >> 23) & 0xff) - 127 + 15;
+    if (exp >= 31)
+        return (uint16_t) (sign | 0x7c00);
+    if (exp <= 0) {                     /* Subnormal or zero */
+        if (exp < -10) return (uint16_t) sign;
+        mant |= 0x800000;
+        shift = 14 - exp;
+        half = mant >> shift;
+        rem = mant & ((1u << shift) - 1);
+        halfway = 1u << (shift - 1);
+    } else {
+        half = ((uint32_t) exp << 10) | (mant >> 13);
+        rem = mant & 0x1fff;
+        halfway = 0x1000;
+    }
+    /* A carry out of the mantissa correctly bumps the exponent */
+    if (rem > halfway || (rem == halfway && (half & 1)))
+        half++;
+    return (uint16_t) (sign | half);
+}  /* Float_to_fp16 */
+
+
+/*--------------------------------------------------------------------
+ * Function:  Fp16_to_float
+ * Purpose:   Convert an IEEE half precision value to a float.  This
+ *            is exact.
+ */
+float Fp16_to_float(uint16_t h) {
+    uint32_t sign = (uint32_t) (h & 0x8000) << 16;
+    uint32_t exp = (h >> 10) & 0x1f;
+    uint32_t mant = h & 0x3ff;
+    uint32_t u;
+    float    x;
+
+    if (exp == 0) {                     /* Subnormal or zero */
+        x = ldexpf((float) mant, -24);
+        return sign ? -x : x;
+    }
+    if (exp == 31)
+        u = sign | 0x7f800000 | (mant << 13);
+    else
+        u = sign | ((exp - 15 + 127) << 23) | (mant << 13);
+    memcpy(&x, &u, sizeof(x));
+    return x;
+}  /* Fp16_to_float */
+
+
+/*--------------------------------------------------------------------
+ * Function:  Convert_array
+ * Purpose:   Round an array of floats to 16-bit storage
+ * In args:   array:  the floats
+ *            size:  the number of elements
+ *            store:  STORE_BF16 or STORE_FP16
+ * Out arg:   array16:  the rounded values
+ */
+void Convert_array(
+         const float array[]    /* in  */,
+         uint16_t    array16[]  /* out */,
+         int         size       /* in  */,
+         int         store      /* in  */) {
+    int i;
+
+    if (store == STORE_BF16)
+        for (i = 0; i < size; i++)
+            array16[i] = Float_to_bf16(array[i]);
+    else
+        for (i = 0; i < size; i++)
+            array16[i] = Float_to_fp16(array[i]);
+}  /* Convert_array */
+
+
+/*--------------------------------------------------------------------
+ * Function:  Parallel_matrix_vector_prod_half
+ * Purpose:   Same as Parallel_matrix_vector_prod, but local_A is
+ *            stored in 16 bits
+ * In args:   see Parallel_matrix_vector_prod
+ *            store:  STORE_BF16 or STORE_FP16
+ * Out arg:   local_y:  my components of the product vector Ax
+ * Scratch:   global_x:  temporary storage for all of vector x
+ * Note:      argument m is unused              
+ */
+void Parallel_matrix_vector_prod_half(
+         uint16_t local_A[]   /* in  */,
+         int      m           /* in  */,
+         int      n           /* in  */,
+         float    local_x[]   /* in  */,
+         float    global_x[]  /* in  */,
+         float    local_y[]   /* out */,
+         int      local_m     /* in  */,
+         int      local_n     /* in  */,
+         int      store       /* in  */,
+         MPI_Comm comm        /* in  */) {
+
+    if (Local_mat_vect_half == NULL)
+        Local_mat_vect_half = Select_local_mat_vect_half(store);
+
+    MPI_Allgather(local_x, local_n, MPI_FLOAT,
+                   global_x, local_n, MPI_FLOAT,
+                   comm);
+    Local_mat_vect_half(local_A, global_x, local_y, local_m, n, store);
+}  /* Parallel_matrix_vector_prod_half */
+
+
+/*--------------------------------------------------------------------
+ * Function:  Local_mat_vect_half_ref
+ * Purpose:   Scalar version of the local product with local_A stored
+ *            in 16 bits.  Each entry is converted to fp32 and the sums
+ *            are accumulated in fp32.
+ * In args:   see Local_mat_vect_ref
+ *            store:  STORE_BF16 or STORE_FP16
+ * Out arg:   local_y:  my components of Ax
+ */
+void Local_mat_vect_half_ref(
+         const uint16_t local_A[]   /* in  */,
+         const float    global_x[]  /* in  */,
+         float          local_y[]   /* out */,
+         int            local_m     /* in  */,
+         int            n           /* in  */,
+         int            store       /* in  */) {
+
+    int   local_i, j;
+    float a;
+
+    for (local_i = 0; local_i < local_m; local_i++) {
+        local_y[local_i] = 0.0;
+        for (j = 0; j < n; j++) {
+            if (store == STORE_BF16)
+                a = Bf16_to_float(local_A[(size_t) local_i*n+j]);
+            else
+                a = Fp16_to_float(local_A[(size_t) local_i*n+j]);
+            local_y[local_i] += a*global_x[j];
+        }
+    }
+}  /* Local_mat_vect_half_ref */
+
+
+#ifdef HAVE_X86_SIMD
+/*--------------------------------------------------------------------
+ * Function:  Load_half_256
+ * Purpose:   Load 8 16-bit entries and widen them to fp32.  bf16 is
+ *            the top half of an fp32, so it only needs a shift.
+ *            Since store is a constant at each call site, the test
+ *            is resolved at compile time.
+ */
+__attribute__((target("avx2,fma,f16c"), always_inline))
+static inline __m256 Load_half_256(const uint16_t* a, int store) {
+    __m128i h = _mm_loadu_si128((const __m128i*) a);
+
+    if (store == STORE_BF16)
+        return _mm256_castsi256_ps(
+                _mm256_slli_epi32(_mm256_cvtepu16_epi32(h), 16));
+    return _mm256_cvtph_ps(h);
+}  /* Load_half_256 */
+
+
+/*--------------------------------------------------------------------
+ * Function:  Mat_vect_half_avx2
+ * Purpose:   Body of Local_mat_vect_half_avx2 for one storage type.
+ *            Same blocking as Local_mat_vect_avx2:  4 rows at a time,
+ *            columns in blocks of COL_BLOCK.
+ */
+__attribute__((target("avx2,fma,f16c"), always_inline))
+static inline void Mat_vect_half_avx2(const uint16_t local_A[],
+        const float global_x[], float local_y[], int local_m, int n,
+        int store) {
+
+    int local_i, r, rows, j, jb, j_end;
+    const uint16_t* a[4];
+    __m256 x, acc[4];
+    float s;
+
+    for (local_i = 0; local_i < local_m; local_i++)
+        local_y[local_i] = 0.0;
+
+    for (jb = 0; jb < n; jb += COL_BLOCK) {
+        j_end = (jb + COL_BLOCK < n) ? jb + COL_BLOCK : n;
+        for (local_i = 0; local_i < local_m; local_i += rows) {
+            rows = (local_m - local_i < 4) ? local_m - local_i : 4;
+            for (r = 0; r < 4; r++) {
+                /* Unused rows just repeat the last real row */
+                a[r] = local_A + (size_t) (local_i + (r < rows ? r : rows-1))*n;
+                acc[r] = _mm256_setzero_ps();
+            }
+            for (j = jb; j + 8 <= j_end; j += 8) {
+                x = _mm256_loadu_ps(global_x + j);
+                for (r = 0; r < 4; r++)
+                    acc[r] = _mm256_fmadd_ps(Load_half_256(a[r] + j, store),
+                            x, acc[r]);
+            }
+            for (r = 0; r < rows; r++) {
+                s = Hsum_256(acc[r]);
+                if (store == STORE_BF16)
+                    for (j = j_end - (j_end - jb) % 8; j < j_end; j++)
+                        s += Bf16_to_float(a[r][j])*global_x[j];
+                else
+                    for (j = j_end - (j_end - jb) % 8; j < j_end; j++)
+                        s += Fp16_to_float(a[r][j])*global_x[j];
+                local_y[local_i + r] += s;
+            }
+        }
+    }
+}  /* Mat_vect_half_avx2 */
+
+
+/*--------------------------------------------------------------------
+ * Function:  Local_mat_vect_half_avx2
+ * Purpose:   AVX2/FMA/F16C version of Local_mat_vect_half_ref
+ * In args, out arg:  see Local_mat_vect_half_ref
+ */
+__attribute__((target("avx2,fma,f16c")))
+void Local_mat_vect_half_avx2(
+         const uint16_t local_A[]   /* in  */,
+         const float    global_x[]  /* in  */,
+         float          local_y[]   /* out */,
+         int            local_m     /* in  */,
+         int            n           /* in  */,
+         int            store       /* in  */) {
+
+    if (store == STORE_BF16)
+        Mat_vect_half_avx2(local_A, global_x, local_y, local_m, n,
+                STORE_BF16);
+    else
+        Mat_vect_half_avx2(local_A, global_x, local_y, local_m, n,
+                STORE_FP16);
+}  /* Local_mat_vect_half_avx2 */
+
+
+/*--------------------------------------------------------------------
+ * Function:  Load_half_512
+ * Purpose:   Load 16 16-bit entries, or the entries selected by mask,
+ *            and widen them to fp32
+ */
+__attribute__((target("avx512f,avx512bw,avx512vl"), always_inline))
+static inline __m512 Load_half_512(const uint16_t* a, __mmask16 mask,
+        int store) {
+    __m256i h = _mm256_maskz_loadu_epi16(mask, a);
+
+    if (store == STORE_BF16)
+        return _mm512_castsi512_ps(
+                _mm512_slli_epi32(_mm512_cvtepu16_epi32(h), 16));
+    return _mm512_cvtph_ps(h);
+}  /* Load_half_512 */
+
+
+/*--------------------------------------------------------------------
+ * Function:  Mat_vect_half_avx512
+ * Purpose:   Body of Local_mat_vect_half_avx512 for one storage type.
+ *            Same blocking as Local_mat_vect_avx512:  8 rows at a
+ *            time, columns in blocks of COL_BLOCK.
+ */
+__attribute__((target("avx512f,avx512bw,avx512vl"), always_inline))
+static inline void Mat_vect_half_avx512(const uint16_t local_A[],
+        const float global_x[], float local_y[], int local_m, int n,
+        int store) {
+
+    int local_i, r, rows, j, jb, j_end;
+    const uint16_t* a[8];
+    __m512 x, acc[8];
+    __mmask16 mask;
+
+    for (local_i = 0; local_i < local_m; local_i++)
+        local_y[local_i] = 0.0;
+
+    for (jb = 0; jb < n; jb += COL_BLOCK) {
+        j_end = (jb + COL_BLOCK < n) ? jb + COL_BLOCK : n;
+        mask = (__mmask16) ((1u << ((j_end - jb) % 16)) - 1);
+        for (local_i = 0; local_i < local_m; local_i += rows) {
+            rows = (local_m - local_i < 8) ? local_m - local_i : 8;
+            for (r = 0; r < 8; r++) {
+                a[r] = local_A + (size_t) (local_i + (r < rows ? r : rows-1))*n;
+                acc[r] = _mm512_setzero_ps();
+            }
+            for (j = jb; j + 16 <= j_end; j += 16) {
+                x = _mm512_loadu_ps(global_x + j);
+                for (r = 0; r < 8; r++)
+                    acc[r] = _mm512_fmadd_ps(
+                            Load_half_512(a[r] + j, 0xFFFF, store), x, acc[r]);
+            }
+            if (j < j_end) {
+                x = _mm512_maskz_loadu_ps(mask, global_x + j);
+                for (r = 0; r < 8; r++)
+                    acc[r] = _mm512_fmadd_ps(
+                            Load_half_512(a[r] + j, mask, store), x, acc[r]);
+            }
+            for (r = 0; r < rows; r++)
+                local_y[local_i + r] += _mm512_reduce_add_ps(acc[r]);
+        }
+    }
+}  /* Mat_vect_half_avx512 */
+
+
+/*--------------------------------------------------------------------
+ * Function:  Local_mat_vect_half_avx512
+ * Purpose:   AVX-512 version of Local_mat_vect_half_ref
+ * In args, out arg:  see Local_mat_vect_half_ref
+ */
+__attribute__((target("avx512f,avx512bw,avx512vl")))
+void Local_mat_vect_half_avx512(
+         const uint16_t local_A[]   /* in  */,
+         const float    global_x[]  /* in  */,
+         float          local_y[]   /* out */,
+         int            local_m     /* in  */,
+         int            n           /* in  */,
+         int            store       /* in  */) {
+
+    if (store == STORE_BF16)
+        Mat_vect_half_avx512(local_A, global_x, local_y, local_m, n,
+                STORE_BF16);
+    else
+        Mat_vect_half_avx512(local_A, global_x, local_y, local_m, n,
+                STORE_FP16);
+}  /* Local_mat_vect_half_avx512 */
+#endif  /* HAVE_X86_SIMD */
+
+
+/*--------------------------------------------------------------------
+ * Function:  Select_local_mat_vect_half
+ * Purpose:   Choose the fastest 16-bit kernel the CPU supports
+ * In arg:    store:  STORE_BF16 or STORE_FP16
+ * Return:    pointer to the kernel
+ */
+Local_mat_vect_half_t Select_local_mat_vect_half(int store) {
+#   ifdef HAVE_X86_SIMD
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw")
+            && __builtin_cpu_supports("avx512vl"))
+        return Local_mat_vect_half_avx512;
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")
+            && __builtin_cpu_supports("f16c"))
+        return Local_mat_vect_half_avx2;
+#   endif
+    return Local_mat_vect_half_ref;
+}  /* Select_local_mat_vect_half */
+
+
+/*--------------------------------------------------------------------
+ * Function:  Report_precision_error
+ * Purpose:   Print the error of the product computed with 16-bit
+ *            storage relative to the fp32 product:  the largest
+ *            componentwise relative error and the relative 2-norm
+ *            error ||y16 - y32||/||y32||
+ * In args:   local_y:  my block of the 16-bit product
+ *            ref_y:  my block of the fp32 product
+ *            local_m, store, my_rank, comm
+ */
+void Report_precision_error(
+         float    local_y[]  /* in */,
+         float    ref_y[]    /* in */,
+         int      local_m    /* in */,
+         int      store      /* in */,
+         int      my_rank    /* in */,
+         MPI_Comm comm       /* in */) {
+
+    int    local_i;
+    double diff, rel;
+    double max_rel = 0.0, global_max_rel;
+    double sums[2] = {0.0, 0.0};   /* ||y16 - y32||^2, ||y32||^2 */
+    double global_sums[2];
+
+    for (local_i = 0; local_i < local_m; local_i++) {
+        diff = (double) local_y[local_i] - ref_y[local_i];
+        rel = (ref_y[local_i] != 0.0) ? fabs(diff/ref_y[local_i]) : fabs(diff);
+        if (rel > max_rel) max_rel = rel;
+        sums[0] += diff*diff;
+        sums[1] += (double) ref_y[local_i]*ref_y[local_i];
+    }
+    MPI_Reduce(&max_rel, &global_max_rel, 1, MPI_DOUBLE, MPI_MAX, 0, comm);
+    MPI_Reduce(sums, global_sums, 2, MPI_DOUBLE, MPI_SUM, 0, comm);
+
+    if (my_rank == 0) {
+        printf("%s storage vs fp32:  max relative error = %e\n",
+            store == STORE_BF16 ? "bf16" : "fp16", global_max_rel);
+        printf("   relative 2-norm error = %e\n",
+            global_sums[1] > 0.0 ? sqrt(global_sums[0]/global_sums[1])
+                                 : sqrt(global_sums[0]));
+    }
+}  /* Report_precision_error */
+
+
+/*--------------------------------------------------------------------
+ * Function:  Gen_spd_matrix
+ * Purpose:   Generate my block of rows of a symmetric positive
+ *            definite matrix:  a_ij = 1/(1 + |i-j|) off the diagonal,
+ *            and a diagonal larger than the sum of the rest of the row
+ * In args:   local_m:  the number of rows in my block
+ *            n:  the order of the matrix
+ *            my_rank
+ * Out arg:   local_A:  my rows of A
+ */
+void Gen_spd_matrix(
+         float local_A[]  /* out */,
+         int   local_m    /* in  */,
+         int   n          /* in  */,
+         int   my_rank    /* in  */) {
+
+    int    local_i, i, j;
+    double diag = 1.0;
+
+    /* Each off-diagonal row sum is at most 2*(1/2 + 1/3 + ... + 1/n) */
+    for (j = 1; j <= n; j++)
+        diag += 2.0/j;
+
+    for (local_i = 0; local_i < local_m; local_i++) {
+        i = my_rank*local_m + local_i;
+        for (j = 0; j < n; j++)
+            local_A[(size_t) local_i*n+j] =
+                (i == j) ? diag : 1.0/(1 + abs(i - j));
+    }
+}  /* Gen_spd_matrix */
+
+
+/*--------------------------------------------------------------------
+ * Function:  Cg_solve
+ * Purpose:   Solve Ax = b with the conjugate gradient method.  Uses
+ *            the Chronopoulos-Gear form of CG so that the two dot
+ *            products of each iteration are combined in one
+ *            MPI_Allreduce.
+ * In args:   local_A:  my rows of the SPD matrix A (n x n)
+ *            local_b:  my block of b
+ *            n:  the order of A
+ *            local_n:  the number of rows/components I own
+ *            max_iter:  the maximum number of iterations
+ *            tol:  stop when ||r|| <= tol*||b||
+ *            comm
+ * Out args:  local_x:  my block of the solution
+ *            res_p:  the relative residual ||b - Ax||/||b||, computed
+ *                    from scratch after the last iteration
+ * Scratch:   global_x
+ * Return:    the number of iterations
+ */
+int Cg_solve(
+         float    local_A[]   /* in  */,
+         float    local_b[]   /* in  */,
+         float    local_x[]   /* out */,
+         float    global_x[]  /* in  */,
+         int      n           /* in  */,
+         int      local_n     /* in  */,
+         int      max_iter    /* in  */,
+         double   tol         /* in  */,
+         double*  res_p       /* out */,
+         MPI_Comm comm        /* in  */) {
+
+    int    i, iter;
+    float* r = malloc(local_n*sizeof(float));
+    float* u = malloc(local_n*sizeof(float));   /* search direction p */
+    float* s = malloc(local_n*sizeof(float));   /* s = Ap             */
+    float* w = malloc(local_n*sizeof(float));   /* w = Ar             */
+    double dots[3], sums[3];  /* r.r, r.w, b.b */
+    double gamma, gamma_old = 1.0, delta, alpha = 1.0, beta, bb = 0.0;
+
+    /* x = 0, so r = b */
+    for (i = 0; i < local_n; i++) {
+        local_x[i] = 0.0;
+        r[i] = local_b[i];
+    }
+
+    for (iter = 0; ; iter++) {
+        Parallel_matrix_vector_prod(local_A, n, n, r, global_x, w,
+            local_n, local_n, comm);
+        dots[0] = dots[1] = dots[2] = 0.0;
+        for (i = 0; i < local_n; i++) {
+            dots[0] += (double) r[i]*r[i];
+            dots[1] += (double) r[i]*w[i];
+        }
+        if (iter == 0)
+            for (i = 0; i < local_n; i++)
+                dots[2] += (double) local_b[i]*local_b[i];
+        MPI_Allreduce(dots, sums, 3, MPI_DOUBLE, MPI_SUM, comm);
+        gamma = sums[0];
+        delta = sums[1];
+        if (iter == 0) bb = sums[2];
+
+        if (gamma <= tol*tol*bb || iter == max_iter) break;
+
+        if (iter == 0) {
+            beta = 0.0;
+            alpha = gamma/delta;
+        } else {
+            beta = gamma/gamma_old;
+            alpha = gamma/(delta - beta*gamma/alpha);
+        }
+        for (i = 0; i < local_n; i++) {
+            u[i] = r[i] + beta*(iter == 0 ? 0.0 : u[i]);
+            s[i] = w[i] + beta*(iter == 0 ? 0.0 : s[i]);
+            local_x[i] += alpha*u[i];
+            r[i] -= alpha*s[i];
+        }
+        gamma_old = gamma;
+    }
+
+    /* True residual */
+    Parallel_matrix_vector_prod(local_A, n, n, local_x, global_x, w,
+        local_n, local_n, comm);
+    dots[0] = 0.0;
+    for (i = 0; i < local_n; i++)
+        dots[0] += ((double) local_b[i] - w[i])*((double) local_b[i] - w[i]);
+    MPI_Allreduce(dots, sums, 1, MPI_DOUBLE, MPI_SUM, comm);
+    *res_p = (bb > 0.0) ? sqrt(sums[0]/bb) : sqrt(sums[0]);
+
+    free(r);
+    free(u);
+    free(s);
+    free(w);
+    return iter;
+}  /* Cg_solve */
+
+
+/*--------------------------------------------------------------------
+ * Function:  Power_iteration
+ * Purpose:   Estimate the eigenvalue of largest magnitude of A with
+ *            the power method.  With x normalized, y = Ax gives the
+ *            estimate lambda = x.y, and x.y and y.y are combined in
+ *            one MPI_Allreduce.
+ * In args:   local_A:  my rows of A (n x n)
+ *            n:  the order of A
+ *            local_n:  the number of rows/components I own
+ *            max_iter:  the maximum number of iterations
+ *            tol:  stop when lambda changes by at most tol*|lambda|
+ *            comm
+ * In/out:    local_x:  in:  my block of the starting vector
+ *                      out:  my block of the eigenvector estimate
+ * Out arg:   lambda_p:  the eigenvalue estimate
+ * Scratch:   global_x
+ * Return:    the number of iterations
+ */
+int Power_iteration(
+         float    local_A[]   /* in     */,
+         float    local_x[]   /* in/out */,
+         float    global_x[]  /* in     */,
+         int      n           /* in     */,
+         int      local_n     /* in     */,
+         int      max_iter    /* in     */,
+         double   tol         /* in     */,
+         double*  lambda_p    /* out    */,
+         MPI_Comm comm        /* in     */) {
+
+    int    i, iter;
+    float* y = malloc(local_n*sizeof(float));
+    double dots[2], sums[2];  /* x.x, y.y on the first pass, then x.y, y.y */
+    double lambda = 0.0, lambda_old, scale;
+
+    /* Normalize the starting vector */
+    dots[0] = 0.0;
+    for (i = 0; i < local_n; i++)
+        dots[0] += (double) local_x[i]*local_x[i];
+    MPI_Allreduce(dots, sums, 1, MPI_DOUBLE, MPI_SUM, comm);
+    scale = (sums[0] > 0.0) ? 1.0/sqrt(sums[0]) : 1.0;
+    for (i = 0; i < local_n; i++)
+        local_x[i] *= scale;
+
+    for (iter = 1; iter <= max_iter; iter++) {
+        Parallel_matrix_vector_prod(local_A, n, n, local_x, global_x, y,
+            local_n, local_n, comm);
+        dots[0] = dots[1] = 0.0;
+        for (i = 0; i < local_n; i++) {
+            dots[0] += (double) local_x[i]*y[i];
+            dots[1] += (double) y[i]*y[i];
+        }
+        MPI_Allreduce(dots, sums, 2, MPI_DOUBLE, MPI_SUM, comm);
+        lambda_old = lambda;
+        lambda = sums[0];
+        scale = (sums[1] > 0.0) ? 1.0/sqrt(sums[1]) : 1.0;
+        for (i = 0; i < local_n; i++)
+            local_x[i] = y[i]*scale;
+        if (fabs(lambda - lambda_old) <= tol*fabs(lambda)) break;
+    }
+    if (iter > max_iter) iter = max_iter;
+
+    *lambda_p = lambda;
+    free(y);
+    return iter;
+}  /* Power_iteration */
+
+
+/*--------------------------------------------------------------------
+ * Function:  Check_local_prod
+ * Purpose:   Compare local_y with the result of the scalar reference
+ *            kernel and print the largest relative difference
+ * In args:   local_A, global_x, local_y, local_m, n, my_rank
+ *            k:  the number of vectors in global_x and local_y
+ */
+void Check_local_prod(
+         float local_A[]   /* in */,
+         float global_x[]  /* in */,
+         float local_y[]   /* in */,
+         int   local_m     /* in */,
+         int   n           /* in */,
+         int   k           /* in */,
+         int   my_rank     /* in */) {
+
+    int    local_i;
+    double err, max_err = 0.0;
+    float* ref_y = malloc(local_m*k*sizeof(float));
+
+    if (k == 1)
+        Local_mat_vect_ref(local_A, global_x, ref_y, local_m, n);
+    else
+        Local_mat_block_ref(local_A, global_x, ref_y, local_m, n, k);
+    for (local_i = 0; local_i < local_m*k; local_i++) {
+        err = fabs(local_y[local_i] - ref_y[local_i]);
+        if (ref_y[local_i] != 0.0) err /= fabs(ref_y[local_i]);
+        if (err > max_err) max_err = err;
+    }
+    printf("Proc %d > max relative difference from scalar kernel = %e\n",
+          my_rank, max_err);
+    fflush(stdout);
+    free(ref_y);
+}  /* Check_local_prod */
 
 
 /*--------------------------------------------------------------------*/
@@ -288,3 +2113,239 @@ void Print_vector(
            0, MPI_COMM_WORLD);
     }
 }  /* Print_vector */
+
+
+/*--------------------------------------------------------------------
+ * Function:  Get_args
+ * Purpose:   Get the command line options and the number of vectors
+ * In args:   argc, argv
+ * Out args:  k_p:  the number of vectors
+ *            store_p:  the storage type of the matrix
+ *            solver_p:  SOLVER_NONE, SOLVER_CG or SOLVER_POWER
+ *            max_iter_p:  the maximum number of solver iterations
+ *            tol_p:  the solver's relative tolerance
+ *            seed_p:  the Philox seed, or -1 to use Gen_array
+ *            mat_file_p, vec_file_p:  files to read A and x from, or
+ *               NULL to generate them
+ *            out_file_p:  file to write A to, or NULL
+ *            dims:  m and n from -d, or 0 and 0
+ *            cfg_file_p:  config file from -c, or NULL
+ */
+void Get_args(
+         int     argc        /* in  */,
+         char*   argv[]      /* in  */,
+         int*    k_p         /* out */,
+         int*    store_p     /* out */,
+         int*    solver_p    /* out */,
+         int*    max_iter_p  /* out */,
+         double* tol_p       /* out */,
+         long*   seed_p      /* out */,
+         char**  mat_file_p  /* out */,
+         char**  vec_file_p  /* out */,
+         char**  out_file_p  /* out */,
+         int     dims[]      /* out */,
+         char**  cfg_file_p  /* out */) {
+    int c;
+
+    *k_p = 1;
+    *store_p = STORE_FP32;
+    *solver_p = SOLVER_NONE;
+    *max_iter_p = 1000;
+    *tol_p = 1.0e-6;
+    *seed_p = -1;
+    *mat_file_p = *vec_file_p = *out_file_p = *cfg_file_p = NULL;
+    dims[0] = dims[1] = 0;
+    while ((c = getopt(argc, argv, "t:s:i:e:r:f:x:o:d:c:")) != -1) {
+        switch (c) {
+            case 't':
+                if (strcmp(optarg, "fp32") == 0)
+                    *store_p = STORE_FP32;
+                else if (strcmp(optarg, "bf16") == 0)
+                    *store_p = STORE_BF16;
+                else if (strcmp(optarg, "fp16") == 0)
+                    *store_p = STORE_FP16;
+                else
+                    Usage(argv[0]);
+                break;
+            case 's':
+                if (strcmp(optarg, "cg") == 0)
+                    *solver_p = SOLVER_CG;
+                else if (strcmp(optarg, "power") == 0)
+                    *solver_p = SOLVER_POWER;
+                else
+                    Usage(argv[0]);
+                break;
+            case 'i':
+                *max_iter_p = strtol(optarg, NULL, 10);
+                if (*max_iter_p < 1) Usage(argv[0]);
+                break;
+            case 'e':
+                *tol_p = strtod(optarg, NULL);
+                if (*tol_p < 0.0) Usage(argv[0]);
+                break;
+            case 'r':
+                *seed_p = strtol(optarg, NULL, 10);
+                if (*seed_p < 0 || *seed_p > 0xFFFFFFFFL) Usage(argv[0]);
+                break;
+            case 'f':
+                *mat_file_p = optarg;
+                break;
+            case 'x':
+                *vec_file_p = optarg;
+                break;
+            case 'o':
+                *out_file_p = optarg;
+                break;
+            case 'd':
+                if (sscanf(optarg, "%d,%d", &dims[0], &dims[1]) != 2
+                        || dims[0] < 1 || dims[1] < 1)
+                    Usage(argv[0]);
+                break;
+            case 'c':
+                *cfg_file_p = optarg;
+                break;
+            default:
+                Usage(argv[0]);
+        }
+    }
+    if (argc - optind > 1) Usage(argv[0]);
+    if (argc - optind == 1) *k_p = strtol(argv[optind], NULL, 10);
+    if (*k_p <= 0) Usage(argv[0]);
+    if (*store_p != STORE_FP32 && *k_p != 1) Usage(argv[0]);
+    if (*solver_p != SOLVER_NONE && (*k_p != 1 || *store_p != STORE_FP32))
+        Usage(argv[0]);
+}  /* Get_args */
+
+/*--------------------------------------------------------------------
+ * Function:  Get_dims
+ * Purpose:   Get the order of the matrix on process 0, from -d, a
+ *            config file, or stdin, and broadcast it
+ * In args:   dims:  m and n from -d, or 0 and 0
+ *            cfg_file:  config file from -c, or NULL
+ *            my_rank, comm
+ * Out args:  m_p, n_p
+ * Note:      If the input is bad, every process quits.
+ */
+void Get_dims(
+         int      dims[]    /* in  */,
+         char*    cfg_file  /* in  */,
+         int*     m_p       /* out */,
+         int*     n_p       /* out */,
+         int      my_rank   /* in  */,
+         MPI_Comm comm      /* in  */) {
+    const char* keys[2] = {"m", "n"};
+    double      vals[2];
+
+    if (my_rank == 0 && dims[0] == 0) {
+        if (cfg_file != NULL) {
+            if (Read_config(cfg_file, keys, vals, 2) == 0) {
+                dims[0] = Config_int(vals[0]);
+                dims[1] = Config_int(vals[1]);
+            } else {
+                fprintf(stderr, "Can't get m and n from %s\n", cfg_file);
+            }
+        } else {
+            printf("Enter the order of the matrix (m x n)\n");
+            if (scanf("%d %d", &dims[0], &dims[1]) != 2)
+                dims[0] = dims[1] = 0;
+        }
+    }
+    MPI_Bcast(dims, 2, MPI_INT, 0, comm);
+
+    if (dims[0] < 1 || dims[1] < 1) {
+        if (my_rank == 0)
+            fprintf(stderr, "m and n must be positive ints\n");
+        MPI_Finalize();
+        exit(0);
+    }
+    *m_p = dims[0];
+    *n_p = dims[1];
+}  /* Get_dims */
+
+
+/*--------------------------------------------------------------------
+ * Function:  Read_config
+ * Purpose:   Read "key = value" lines from a file.  Blank lines and
+ *            anything after a # are ignored.
+ * In args:   file_name
+ *            keys:  the keys to look for
+ *            n_keys:  how many there are
+ * Out arg:   vals:  vals[k] is the value given for keys[k]
+ * Return:    0 if every key was given a value, -1 if not, or if the
+ *            file can't be read or has a line that isn't "key = value"
+ *            for one of the keys
+ */
+int Read_config(
+         char*       file_name  /* in  */,
+         const char* keys[]     /* in  */,
+         double      vals[]     /* out */,
+         int         n_keys     /* in  */) {
+    FILE*  fp = fopen(file_name, "r");
+    char   line[256], key[64];
+    char*  hash;
+    double val;
+    int    k, found = 0, seen[16] = {0};
+
+    if (fp == NULL || n_keys > 16) {
+        if (fp != NULL) fclose(fp);
+        return -1;
+    }
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        if ((hash = strchr(line, '#')) != NULL) *hash = '\0';
+        if (sscanf(line, " %63[^= \t] = %lf", key, &val) != 2) {
+            if (sscanf(line, " %63s", key) == 1) break;   /* Not blank */
+            continue;
+        }
+        for (k = 0; k < n_keys; k++)
+            if (strcmp(key, keys[k]) == 0) break;
+        if (k == n_keys) break;
+        vals[k] = val;
+        if (!seen[k]) found++;
+        seen[k] = 1;
+    }
+    if (!feof(fp)) found = -1;
+    fclose(fp);
+
+    return (found == n_keys) ? 0 : -1;
+}  /* Read_config */
+
+
+/*--------------------------------------------------------------------
+ * Function:  Config_int
+ * Purpose:   Convert a value from Read_config to a positive int
+ * In arg:    val
+ * Return:    val, if it's a whole number from 1 to INT_MAX, and 0
+ *            (bad input) if it isn't
+ */
+int Config_int(
+         double val  /* in  */) {
+    if (val >= 1.0 && val <= INT_MAX && val == floor(val))
+        return (int) val;
+    return 0;
+}  /* Config_int */
+
+
+/*--------------------------------------------------------------------
+ * Function:  Usage
+ * Purpose:   Print a message explaining how to run the program
+ * In arg:    prog_name
+ */
+void Usage(char* prog_name) {
+    fprintf(stderr, "usage: mpiexec -n <p> %s [-t <fp32|bf16|fp16>]\n",
+        prog_name);
+    fprintf(stderr, "          [-s <cg|power>] [-i <max_iter>] [-e <tol>]\n");
+    fprintf(stderr, "          [-r <seed>] [-f <A file>] [-x <x file>]\n");
+    fprintf(stderr, "          [-o <A file>] [-d <m>,<n>] [-c <config file>] [k]\n");
+    fprintf(stderr, "   -t is the storage type of the matrix\n");
+    fprintf(stderr, "   -s runs a solver instead of a single product\n");
+    fprintf(stderr, "   -i, -e are the solver's iteration limit and tolerance\n");
+    fprintf(stderr, "   -r uses the counter-based generator with this seed\n");
+    fprintf(stderr, "   -f, -x read A and x (binary or text) instead\n");
+    fprintf(stderr, "   -o writes A to a binary file\n");
+    fprintf(stderr, "   -d is the order of the matrix, or -c a file with\n");
+    fprintf(stderr, "      m = ... and n = ... lines (else it's read from stdin)\n");
+    fprintf(stderr, "   k is the number of vectors and should be >= 1\n");
+    fprintf(stderr, "   16-bit storage and the solvers need k = 1\n");
+    fprintf(stderr, "   the solvers use fp32 storage\n");
+    exit(0);
+}  /* Usage */
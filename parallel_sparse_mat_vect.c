@@ -0,0 +1,909 @@
+/* File:     parallel_sparse_mat_vect.c
+ *
+ * Purpose:  Computes a parallel sparse matrix-vector product.  As in
+ *           parallel_mat_vect1.c the n x n matrix is distributed by
+ *           block rows and the vectors are distributed by blocks, but
+ *           only the nonzeros of A are stored, either in CSR
+ *           (compressed sparse row) or in SELL-C-sigma format.  This
+ *           version generates a random sparse matrix and a random
+ *           vector.
+ *
+ * Input:
+ *     n:          order of matrix
+ *     row_nnz:    average number of nonzeros per row
+ *     sigma:      SELL-C-sigma sorting window (multiple of SELL_C)
+ *     from the command line, a config file, or stdin on process 0
+ *
+ * Output:
+ *     y:    the product vector, the number of ghost entries of x
+ *           each process receives, and the run-times of the CSR and
+ *           SELL-C-sigma kernels
+ *
+ * Compile:  mpicc -g -Wall -O2 -o parallel_sparse_mat_vect \
+ *              parallel_sparse_mat_vect.c -lm
+ * Run:      mpiexec -n <number of processes> parallel_sparse_mat_vect
+ *              [-c <config file>] [<n> <row_nnz> <sigma>]
+ *           -c names a file with lines "n = <value>", "row_nnz =
+ *              <value>" and "sigma = <value>" (# starts a comment)
+ *           With neither, process 0 prompts for them.
+ *
+ * Notes:
+ *     1.  Number of processes (p) should evenly divide n.
+ *     2.  Column indices are generated as global indices.  Setup_halo
+ *         finds the columns each process needs from other processes
+ *         (its "ghost" entries of x), exchanges the lists once, and
+ *         renumbers the columns so that entries 0..local_n-1 of the
+ *         extended vector x_ext are my block of x and the ghosts
+ *         follow.  Each product then sends only the ghost entries
+ *         instead of gathering all of x.
+ *     3.  SELL-C-sigma groups SELL_C rows into a chunk and stores the
+ *         chunk column by column, padded to its longest row.  Rows are
+ *         sorted by length within windows of sigma rows to reduce the
+ *         padding.  The kernel then works on SELL_C rows at once, and
+ *         on AVX2 it uses gathers for x.
+ *     4.  Compile with -DDEBUG to print the halo pattern, and to
+ *         check the CSR product against one that uses an allgathered
+ *         x and the global column indices A had before Setup_halo.
+ *         CSR and SELL read the same x_ext, so comparing them can't
+ *         catch a ghost that was put in the wrong slot.
+ *     5.  Process 0 sends n, row_nnz and sigma with a single
+ *         MPI_Bcast.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+#include <limits.h>
+#include <mpi.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#  define HAVE_X86_SIMD
+#  include <immintrin.h>
+#endif
+
+/* Rows per SELL chunk:  one AVX2 register of floats */
+#define SELL_C 8
+
+/* Local rows of A in CSR format */
+typedef struct {
+    int    local_m;     /* Number of rows I own                       */
+    int    nnz;         /* Number of stored entries                   */
+    int*   row_ptr;     /* Row i is entries row_ptr[i]..row_ptr[i+1]-1 */
+    int*   col_idx;     /* Column of each entry                       */
+    float* vals;        /* Value of each entry                        */
+} csr_mat_t;
+
+/* Local rows of A in SELL-C-sigma format */
+typedef struct {
+    int    local_m;     /* Number of rows I own                       */
+    int    n_chunks;    /* Number of chunks of SELL_C rows            */
+    int*   chunk_ptr;   /* Offset of each chunk in col_idx and vals   */
+    int*   chunk_len;   /* Length of longest row in each chunk        */
+    int*   col_idx;     /* Column of each entry, chunk column major   */
+    float* vals;        /* Value of each entry, 0 for padding         */
+    int*   perm;        /* Row r of the SELL matrix is local row      */
+                        /*    perm[r] of A                            */
+} sell_mat_t;
+
+/* Communication pattern for the ghost entries of x */
+typedef struct {
+    int    n_ghost;      /* Number of ghost entries                   */
+    int*   ghost_cols;   /* Global column of each ghost, increasing   */
+    int    n_recv;       /* Number of processes I receive from        */
+    int*   recv_procs;
+    int*   recv_counts;
+    int*   recv_displs;  /* Offsets into the ghost part of x_ext      */
+    int    n_send;       /* Number of processes I send to             */
+    int*   send_procs;
+    int*   send_counts;
+    int*   send_displs;
+    int*   send_idx;     /* Local indices of the entries to send      */
+    float* send_buf;
+    MPI_Request* reqs;
+} halo_t;
+
+void Usage(char* prog_name);
+void Get_input(int argc, char* argv[], int* n_p, int* row_nnz_p,
+             int* sigma_p, int my_rank, int p, MPI_Comm comm);
+int  Read_config(char* file_name, const char* keys[], double vals[],
+             int n_keys);
+int  Config_int(double val);
+int  Arg_int(const char* str);
+void Gen_array(float array[], int size, int seed);
+void Gen_sparse_matrix(csr_mat_t* A_p, int local_m, int n, int row_nnz,
+             int my_rank);
+int  Compare_int(const void* a_p, const void* b_p);
+int  Compare_pair(const void* a_p, const void* b_p);
+void Setup_halo(csr_mat_t* A_p, halo_t* halo_p, int local_n,
+             int my_rank, int p, MPI_Comm comm);
+void Halo_exchange(halo_t* halo_p, float x_ext[], int local_n,
+             MPI_Comm comm);
+void Csr_to_sell(csr_mat_t* A_p, sell_mat_t* S_p, int sigma);
+void Csr_mat_vect(csr_mat_t* A_p, float x_ext[], float local_y[]);
+void Sell_mat_vect_ref(sell_mat_t* S_p, float x_ext[], float local_y[]);
+#ifdef HAVE_X86_SIMD
+void Sell_mat_vect_avx2(sell_mat_t* S_p, float x_ext[], float local_y[]);
+#endif
+void Sell_mat_vect(sell_mat_t* S_p, float x_ext[], float local_y[]);
+void Free_csr(csr_mat_t* A_p);
+void Free_sell(sell_mat_t* S_p);
+void Free_halo(halo_t* halo_p);
+void Print_vector(char* title, float local_y[], int local_m, int my_rank,
+             int p, MPI_Comm comm);
+#ifdef DEBUG
+void Check_halo(csr_mat_t* A_p, int global_cols[], float x_ext[],
+             float local_y[], int n, int local_n, int my_rank,
+             MPI_Comm comm);
+#endif
+
+int main(int argc, char* argv[]) {
+    int             my_rank;
+    int             p;
+    csr_mat_t       A;
+    sell_mat_t      S;
+    halo_t          halo;
+    float*          x_ext;
+    float*          csr_y;
+    float*          sell_y;
+    int             n, row_nnz, sigma;
+    int             local_m, local_n, i;
+    int             total_ghosts;
+    double          start, csr_elapsed, sell_elapsed, max_diff, diff;
+    MPI_Comm        comm;
+#   ifdef DEBUG
+    int*            global_cols;
+#   endif
+
+    MPI_Init(&argc, &argv);
+    comm = MPI_COMM_WORLD;
+    MPI_Comm_size(comm, &p);
+    MPI_Comm_rank(comm, &my_rank);
+
+    Get_input(argc, argv, &n, &row_nnz, &sigma, my_rank, p, comm);
+    local_m = local_n = n/p;
+
+    Gen_sparse_matrix(&A, local_m, n, row_nnz, my_rank);
+#   ifdef DEBUG
+    global_cols = malloc((A.nnz > 0 ? A.nnz : 1)*sizeof(int));
+    memcpy(global_cols, A.col_idx, A.nnz*sizeof(int));
+#   endif
+    Setup_halo(&A, &halo, local_n, my_rank, p, comm);
+    Csr_to_sell(&A, &S, sigma);
+
+    /* My block of x followed by the ghosts */
+    x_ext = malloc((local_n + halo.n_ghost)*sizeof(float));
+    Gen_array(x_ext, local_n, 10*my_rank);
+    csr_y = malloc(local_m*sizeof(float));
+    sell_y = malloc(local_m*sizeof(float));
+
+    MPI_Barrier(comm);
+    start = MPI_Wtime();
+    Halo_exchange(&halo, x_ext, local_n, comm);
+    Csr_mat_vect(&A, x_ext, csr_y);
+    csr_elapsed = MPI_Wtime() - start;
+
+    MPI_Barrier(comm);
+    start = MPI_Wtime();
+    Halo_exchange(&halo, x_ext, local_n, comm);
+    Sell_mat_vect(&S, x_ext, sell_y);
+    sell_elapsed = MPI_Wtime() - start;
+
+    max_diff = 0.0;
+    for (i = 0; i < local_m; i++) {
+        diff = fabs(csr_y[i] - sell_y[i]);
+        if (diff > max_diff) max_diff = diff;
+    }
+    MPI_Reduce(&halo.n_ghost, &total_ghosts, 1, MPI_INT, MPI_SUM, 0, comm);
+    MPI_Reduce(my_rank == 0 ? MPI_IN_PLACE : &max_diff, &max_diff, 1,
+        MPI_DOUBLE, MPI_MAX, 0, comm);
+    MPI_Reduce(my_rank == 0 ? MPI_IN_PLACE : &csr_elapsed, &csr_elapsed, 1,
+        MPI_DOUBLE, MPI_MAX, 0, comm);
+    MPI_Reduce(my_rank == 0 ? MPI_IN_PLACE : &sell_elapsed, &sell_elapsed,
+        1, MPI_DOUBLE, MPI_MAX, 0, comm);
+
+    Print_vector("The product is", csr_y, local_m, my_rank, p, comm);
+    if (my_rank == 0) {
+        printf("Ghost entries received = %d (allgather would move %lld)\n",
+            total_ghosts, (long long) (p-1)*n);
+        printf("Max |CSR - SELL| = %e\n", max_diff);
+        printf("CSR elapsed time = %e seconds\n", csr_elapsed);
+        printf("SELL-%d-%d elapsed time = %e seconds\n", SELL_C, sigma,
+            sell_elapsed);
+    }
+
+#   ifdef DEBUG
+    Check_halo(&A, global_cols, x_ext, csr_y, n, local_n, my_rank, comm);
+    free(global_cols);
+#   endif
+
+    Free_csr(&A);
+    Free_sell(&S);
+    Free_halo(&halo);
+    free(x_ext);
+    free(csr_y);
+    free(sell_y);
+
+    MPI_Finalize();
+
+    return 0;
+}  /* main */
+
+/*--------------------------------------------------------------------
+ * Function:  Usage
+ * Purpose:   Print a message explaining how to run the program
+ * In arg:    prog_name
+ */
+void Usage(char* prog_name) {
+    fprintf(stderr, "usage: mpiexec -n <p> %s [-c <config file>]\n",
+        prog_name);
+    fprintf(stderr, "          [<n> <row_nnz> <sigma>]\n");
+    fprintf(stderr, "   -c names a file with n = ..., row_nnz = ... and\n");
+    fprintf(stderr, "      sigma = ... lines\n");
+    fprintf(stderr, "   with neither, process 0 prompts for them\n");
+    exit(0);
+}  /* Usage */
+
+/*--------------------------------------------------------------------
+ * Function:  Get_input
+ * Purpose:   Get n, row_nnz and sigma on process 0, from the command
+ *            line, a config file (-c), or stdin, and broadcast them
+ * In args:   argc, argv, my_rank, p, comm
+ * Out args:  n_p, row_nnz_p, sigma_p
+ * Note:      If the input is bad, or p doesn't divide n, every
+ *            process quits.
+ */
+void Get_input(
+         int      argc       /* in  */,
+         char*    argv[]     /* in  */,
+         int*     n_p        /* out */,
+         int*     row_nnz_p  /* out */,
+         int*     sigma_p    /* out */,
+         int      my_rank    /* in  */,
+         int      p          /* in  */,
+         MPI_Comm comm       /* in  */) {
+    const char* keys[3] = {"n", "row_nnz", "sigma"};
+    double      vals[3];
+    char*       cfg_file = NULL;
+    int         input[3] = {0, 0, 0};
+    int         c, i;
+
+    while ((c = getopt(argc, argv, "c:")) != -1) {
+        if (c == 'c')
+            cfg_file = optarg;
+        else
+            Usage(argv[0]);
+    }
+    if (argc - optind != 0 && argc - optind != 3) Usage(argv[0]);
+
+    if (my_rank == 0) {
+        if (argc - optind == 3) {
+            for (i = 0; i < 3; i++)
+                input[i] = Arg_int(argv[optind+i]);
+            if (input[1] == 0 || input[2] == 0)
+                input[0] = 0;
+        } else if (cfg_file != NULL) {
+            if (Read_config(cfg_file, keys, vals, 3) == 0) {
+                for (i = 0; i < 3; i++)
+                    input[i] = Config_int(vals[i]);
+                if (input[1] == 0 || input[2] == 0)
+                    input[0] = 0;
+            } else {
+                fprintf(stderr, "Can't get n, row_nnz and sigma from %s\n",
+                    cfg_file);
+            }
+        } else {
+            printf("Enter n, the nonzeros per row, and sigma\n");
+            if (scanf("%d %d %d", &input[0], &input[1], &input[2]) != 3)
+                input[0] = 0;
+        }
+        if (input[1] < 1) input[1] = 1;
+        if (input[2] < SELL_C) input[2] = SELL_C;
+        input[2] = (input[2]/SELL_C)*SELL_C;
+    }
+    MPI_Bcast(input, 3, MPI_INT, 0, comm);
+
+    if (input[0] < 1) {
+        if (my_rank == 0)
+            fprintf(stderr, "n, row_nnz and sigma must be positive ints\n");
+        MPI_Finalize();
+        exit(0);
+    }
+    /* Setup_halo finds a column's owner as col/local_n */
+    if (input[0] % p != 0) {
+        if (my_rank == 0)
+            fprintf(stderr, "p = %d must evenly divide n = %d\n", p,
+                input[0]);
+        MPI_Finalize();
+        exit(0);
+    }
+    *n_p = input[0];
+    *row_nnz_p = input[1];
+    *sigma_p = input[2];
+}  /* Get_input */
+
+/*--------------------------------------------------------------------
+ * Function:  Read_config
+ * Purpose:   Read "key = value" lines from a file.  Blank lines and
+ *            anything after a # are ignored.
+ * In args:   file_name
+ *            keys:  the keys to look for
+ *            n_keys:  how many there are
+ * Out arg:   vals:  vals[k] is the value given for keys[k]
+ * Return:    0 if every key was given a value, -1 if not, or if the
+ *            file can't be read or has a line that isn't "key = value"
+ *            for one of the keys
+ */
+int Read_config(
+         char*       file_name  /* in  */,
+         const char* keys[]     /* in  */,
+         double      vals[]     /* out */,
+         int         n_keys     /* in  */) {
+    FILE*  fp = fopen(file_name, "r");
+    char   line[256], key[64];
+    char*  hash;
+    double val;
+    int    k, found = 0, seen[16] = {0};
+
+    if (fp == NULL || n_keys > 16) {
+        if (fp != NULL) fclose(fp);
+        return -1;
+    }
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        if ((hash = strchr(line, '#')) != NULL) *hash = '\0';
+        if (sscanf(line, " %63[^= \t] = %lf", key, &val) != 2) {
+            if (sscanf(line, " %63s", key) == 1) break;   /* Not blank */
+            continue;
+        }
+        for (k = 0; k < n_keys; k++)
+            if (strcmp(key, keys[k]) == 0) break;
+        if (k == n_keys) break;
+        vals[k] = val;
+        if (!seen[k]) found++;
+        seen[k] = 1;
+    }
+    if (!feof(fp)) found = -1;
+    fclose(fp);
+
+    return (found == n_keys) ? 0 : -1;
+}  /* Read_config */
+
+
+/*--------------------------------------------------------------------
+ * Function:  Config_int
+ * Purpose:   Convert a value from Read_config to a positive int
+ * In arg:    val
+ * Return:    val, if it's a whole number from 1 to INT_MAX, and 0
+ *            (bad input) if it isn't
+ */
+int Config_int(
+         double val  /* in  */) {
+    if (val >= 1.0 && val <= INT_MAX && val == floor(val))
+        return (int) val;
+    return 0;
+}  /* Config_int */
+
+/*--------------------------------------------------------------------
+ * Function:  Arg_int
+ * Purpose:   Convert a command line argument to a positive int with
+ *            the same check as Config_int
+ * In arg:    str
+ * Return:    The value, if all of str is a whole number from 1 to
+ *            INT_MAX, and 0 (bad input) if it isn't
+ */
+int Arg_int(
+         const char* str  /* in  */) {
+    char*  end;
+    double val = strtod(str, &end);
+
+    if (end == str || *end != '\0') return 0;
+    return Config_int(val);
+}  /* Arg_int */
+
+/*--------------------------------------------------------------------
+ * Function:  Gen_array
+ * Purpose:   Generate a random array of floats
+ * In args:   size:  the number of elements in the array
+ *            seed:  seed for the random number generator
+ * Out arg:   array:  the array of floats
+ */
+void Gen_array(float array[], int size, int seed) {
+   int i;
+
+   srandom(seed+1);
+   for (i = 0; i < size; i++)
+      array[i] = random()/((double) RAND_MAX);
+}  /* Gen_array */
+
+/*--------------------------------------------------------------------
+ * Function:  Gen_sparse_matrix
+ * Purpose:   Generate my block of rows of a random sparse matrix.
+ *            Row lengths vary between 1 and 2*row_nnz-1.  Every row
+ *            has its diagonal entry, most other entries are close to
+ *            the diagonal, and about one in ten is anywhere in the row.
+ * In args:   local_m:  the number of rows I own
+ *            n:  the number of columns
+ *            row_nnz:  the average number of entries per row
+ *            my_rank
+ * Out arg:   A_p:  my rows in CSR format, with global column indices
+ */
+void Gen_sparse_matrix(
+         csr_mat_t* A_p      /* out */,
+         int        local_m  /* in  */,
+         int        n        /* in  */,
+         int        row_nnz  /* in  */,
+         int        my_rank  /* in  */) {
+
+    int i, k, len, row, col;
+    int band = (4*row_nnz > 16) ? 4*row_nnz : 16;
+
+    srandom(my_rank+1);
+    A_p->local_m = local_m;
+    A_p->row_ptr = malloc((local_m+1)*sizeof(int));
+    A_p->row_ptr[0] = 0;
+    for (i = 0; i < local_m; i++) {
+        len = 1 + random() % (2*row_nnz - 1);
+        if (len > n) len = n;
+        A_p->row_ptr[i+1] = A_p->row_ptr[i] + len;
+    }
+    A_p->nnz = A_p->row_ptr[local_m];
+    A_p->col_idx = malloc(A_p->nnz*sizeof(int));
+    A_p->vals = malloc(A_p->nnz*sizeof(float));
+
+    for (i = 0; i < local_m; i++) {
+        row = my_rank*local_m + i;
+        for (k = A_p->row_ptr[i]; k < A_p->row_ptr[i+1]; k++) {
+            if (k == A_p->row_ptr[i])
+                col = row;
+            else if (random() % 10 == 0)
+                col = random() % n;
+            else
+                /* band can be wider than n:  keep col in 0..n-1 */
+                col = ((row + random() % (2*band+1) - band) % n + n) % n;
+            A_p->col_idx[k] = col;
+            A_p->vals[k] = random()/((double) RAND_MAX);
+        }
+    }
+}  /* Gen_sparse_matrix */
+
+/*--------------------------------------------------------------------
+ * Function:  Compare_int
+ * Purpose:   Compare two ints for qsort
+ */
+int Compare_int(const void* a_p, const void* b_p) {
+    int a = *((const int*) a_p);
+    int b = *((const int*) b_p);
+
+    return (a > b) - (a < b);
+}  /* Compare_int */
+
+/*--------------------------------------------------------------------
+ * Function:  Compare_pair
+ * Purpose:   Compare two pairs of ints lexicographically for qsort
+ */
+int Compare_pair(const void* a_p, const void* b_p) {
+    const int* a = (const int*) a_p;
+    const int* b = (const int*) b_p;
+
+    if (a[0] != b[0]) return (a[0] > b[0]) - (a[0] < b[0]);
+    return (a[1] > b[1]) - (a[1] < b[1]);
+}  /* Compare_pair */
+
+/*--------------------------------------------------------------------
+ * Function:  Setup_halo
+ * Purpose:   Find the entries of x that my rows reference but other
+ *            processes own, tell the owners which entries to send,
+ *            and renumber the columns of A to index x_ext
+ * In args:   local_n:  the number of entries of x each process owns
+ *            my_rank, p, comm
+ * In/out:    A_p:  on input global column indices, on output indices
+ *                  into x_ext
+ * Out arg:   halo_p:  the communication pattern
+ */
+void Setup_halo(
+         csr_mat_t* A_p      /* in/out */,
+         halo_t*    halo_p   /* out    */,
+         int        local_n  /* in     */,
+         int        my_rank  /* in     */,
+         int        p        /* in     */,
+         MPI_Comm   comm     /* in     */) {
+
+    int  k, q, count, col, first = my_rank*local_n;
+    int* cols = malloc(A_p->nnz*sizeof(int));
+    int* recv_counts = calloc(p, sizeof(int));
+    int* recv_displs = malloc(p*sizeof(int));
+    int* send_counts = malloc(p*sizeof(int));
+    int* send_displs = malloc(p*sizeof(int));
+    int* found;
+    int  total_send;
+
+    /* Sorted list of distinct columns owned by other processes */
+    count = 0;
+    for (k = 0; k < A_p->nnz; k++) {
+        col = A_p->col_idx[k];
+        if (col < first || col >= first + local_n)
+            cols[count++] = col;
+    }
+    qsort(cols, count, sizeof(int), Compare_int);
+    halo_p->n_ghost = 0;
+    for (k = 0; k < count; k++)
+        if (k == 0 || cols[k] != cols[k-1])
+            cols[halo_p->n_ghost++] = cols[k];
+    halo_p->ghost_cols = realloc(cols,
+            (halo_p->n_ghost > 0 ? halo_p->n_ghost : 1)*sizeof(int));
+
+    /* Since the ghosts are sorted, they're grouped by owner */
+    for (k = 0; k < halo_p->n_ghost; k++)
+        recv_counts[halo_p->ghost_cols[k]/local_n]++;
+    MPI_Alltoall(recv_counts, 1, MPI_INT, send_counts, 1, MPI_INT, comm);
+    recv_displs[0] = send_displs[0] = 0;
+    for (q = 1; q < p; q++) {
+        recv_displs[q] = recv_displs[q-1] + recv_counts[q-1];
+        send_displs[q] = send_displs[q-1] + send_counts[q-1];
+    }
+    total_send = send_displs[p-1] + send_counts[p-1];
+    halo_p->send_idx = malloc((total_send > 0 ? total_send : 1)*sizeof(int));
+    MPI_Alltoallv(halo_p->ghost_cols, recv_counts, recv_displs, MPI_INT,
+        halo_p->send_idx, send_counts, send_displs, MPI_INT, comm);
+    for (k = 0; k < total_send; k++)
+        halo_p->send_idx[k] -= first;
+    halo_p->send_buf = malloc((total_send > 0 ? total_send : 1)
+            *sizeof(float));
+
+    /* Keep only the processes we actually talk to */
+    halo_p->recv_procs = malloc(p*sizeof(int));
+    halo_p->recv_counts = malloc(p*sizeof(int));
+    halo_p->recv_displs = malloc(p*sizeof(int));
+    halo_p->send_procs = malloc(p*sizeof(int));
+    halo_p->send_counts = malloc(p*sizeof(int));
+    halo_p->send_displs = malloc(p*sizeof(int));
+    halo_p->n_recv = halo_p->n_send = 0;
+    for (q = 0; q < p; q++) {
+        if (recv_counts[q] > 0) {
+            halo_p->recv_procs[halo_p->n_recv] = q;
+            halo_p->recv_counts[halo_p->n_recv] = recv_counts[q];
+            halo_p->recv_displs[halo_p->n_recv] = recv_displs[q];
+            halo_p->n_recv++;
+        }
+        if (send_counts[q] > 0) {
+            halo_p->send_procs[halo_p->n_send] = q;
+            halo_p->send_counts[halo_p->n_send] = send_counts[q];
+            halo_p->send_displs[halo_p->n_send] = send_displs[q];
+            halo_p->n_send++;
+        }
+    }
+    halo_p->reqs = malloc((halo_p->n_recv + halo_p->n_send + 1)
+            *sizeof(MPI_Request));
+
+    /* Renumber the columns of A */
+    for (k = 0; k < A_p->nnz; k++) {
+        col = A_p->col_idx[k];
+        if (col >= first && col < first + local_n) {
+            A_p->col_idx[k] = col - first;
+        } else {
+            found = bsearch(&col, halo_p->ghost_cols, halo_p->n_ghost,
+                    sizeof(int), Compare_int);
+            A_p->col_idx[k] = local_n + (int) (found - halo_p->ghost_cols);
+        }
+    }
+
+#   ifdef DEBUG
+    printf("Proc %d > %d ghosts from %d procs, %d entries to %d procs\n",
+          my_rank, halo_p->n_ghost, halo_p->n_recv, total_send,
+          halo_p->n_send);
+    fflush(stdout);
+#   endif
+
+    free(recv_counts);
+    free(recv_displs);
+    free(send_counts);
+    free(send_displs);
+}  /* Setup_halo */
+
+/*--------------------------------------------------------------------
+ * Function:  Halo_exchange
+ * Purpose:   Fill in the ghost entries of x_ext
+ * In args:   halo_p:  the communication pattern
+ *            local_n:  the number of entries of x I own
+ *            comm
+ * In/out:    x_ext:  in:  my block of x in entries 0..local_n-1
+ *                    out:  the ghosts in the entries after my block
+ */
+void Halo_exchange(
+         halo_t*  halo_p   /* in     */,
+         float    x_ext[]  /* in/out */,
+         int      local_n  /* in     */,
+         MPI_Comm comm     /* in     */) {
+
+    int i, k, n_req = 0;
+    float* ghosts = x_ext + local_n;
+
+    for (i = 0; i < halo_p->n_recv; i++)
+        MPI_Irecv(ghosts + halo_p->recv_displs[i], halo_p->recv_counts[i],
+            MPI_FLOAT, halo_p->recv_procs[i], 0, comm,
+            &halo_p->reqs[n_req++]);
+    for (i = 0; i < halo_p->n_send; i++) {
+        for (k = halo_p->send_displs[i];
+                k < halo_p->send_displs[i] + halo_p->send_counts[i]; k++)
+            halo_p->send_buf[k] = x_ext[halo_p->send_idx[k]];
+        MPI_Isend(halo_p->send_buf + halo_p->send_displs[i],
+            halo_p->send_counts[i], MPI_FLOAT, halo_p->send_procs[i], 0,
+            comm, &halo_p->reqs[n_req++]);
+    }
+    MPI_Waitall(n_req, halo_p->reqs, MPI_STATUSES_IGNORE);
+}  /* Halo_exchange */
+
+/*--------------------------------------------------------------------
+ * Function:  Csr_to_sell
+ * Purpose:   Build the SELL-C-sigma version of a CSR matrix
+ * In args:   A_p:  my rows in CSR format
+ *            sigma:  sorting window, a multiple of SELL_C
+ * Out arg:   S_p:  my rows in SELL-C-sigma format
+ */
+void Csr_to_sell(
+         csr_mat_t*  A_p    /* in  */,
+         sell_mat_t* S_p    /* out */,
+         int         sigma  /* in  */) {
+
+    int  i, j, r, c, row, len, start, end, total;
+    int* key = malloc(2*A_p->local_m*sizeof(int));
+
+    S_p->local_m = A_p->local_m;
+    S_p->n_chunks = (A_p->local_m + SELL_C - 1)/SELL_C;
+    S_p->perm = malloc(A_p->local_m*sizeof(int));
+
+    /* Sort rows by decreasing length within each window of sigma rows. */
+    /* Ties are broken by row number.                                    */
+    for (start = 0; start < A_p->local_m; start += sigma) {
+        end = (start + sigma < A_p->local_m) ? start + sigma : A_p->local_m;
+        for (i = start; i < end; i++) {
+            key[2*i] = -(A_p->row_ptr[i+1] - A_p->row_ptr[i]);
+            key[2*i+1] = i;
+        }
+        qsort(key + 2*start, end - start, 2*sizeof(int), Compare_pair);
+        for (i = start; i < end; i++)
+            S_p->perm[i] = key[2*i+1];
+    }
+    free(key);
+
+    S_p->chunk_ptr = malloc((S_p->n_chunks+1)*sizeof(int));
+    S_p->chunk_len = malloc(S_p->n_chunks*sizeof(int));
+    total = 0;
+    for (c = 0; c < S_p->n_chunks; c++) {
+        S_p->chunk_ptr[c] = total;
+        S_p->chunk_len[c] = 0;
+        for (r = 0; r < SELL_C && c*SELL_C + r < A_p->local_m; r++) {
+            row = S_p->perm[c*SELL_C + r];
+            len = A_p->row_ptr[row+1] - A_p->row_ptr[row];
+            if (len > S_p->chunk_len[c]) S_p->chunk_len[c] = len;
+        }
+        total += SELL_C*S_p->chunk_len[c];
+    }
+    S_p->chunk_ptr[S_p->n_chunks] = total;
+
+    /* Padding points at column 0 with value 0 */
+    S_p->col_idx = calloc(total > 0 ? total : 1, sizeof(int));
+    S_p->vals = calloc(total > 0 ? total : 1, sizeof(float));
+    for (c = 0; c < S_p->n_chunks; c++)
+        for (r = 0; r < SELL_C && c*SELL_C + r < A_p->local_m; r++) {
+            row = S_p->perm[c*SELL_C + r];
+            for (j = 0, i = A_p->row_ptr[row]; i < A_p->row_ptr[row+1];
+                    j++, i++) {
+                S_p->col_idx[S_p->chunk_ptr[c] + j*SELL_C + r] =
+                    A_p->col_idx[i];
+                S_p->vals[S_p->chunk_ptr[c] + j*SELL_C + r] = A_p->vals[i];
+            }
+        }
+}  /* Csr_to_sell */
+
+/*--------------------------------------------------------------------
+ * Function:  Csr_mat_vect
+ * Purpose:   Local product local_y = A*x_ext with A in CSR format
+ * In args:   A_p:  my rows, columns numbered as in x_ext
+ *            x_ext:  my block of x followed by the ghosts
+ * Out arg:   local_y:  my block of Ax
+ */
+void Csr_mat_vect(
+         csr_mat_t* A_p        /* in  */,
+         float      x_ext[]    /* in  */,
+         float      local_y[]  /* out */) {
+
+    int   i, k;
+    float sum;
+
+    for (i = 0; i < A_p->local_m; i++) {
+        sum = 0.0;
+        for (k = A_p->row_ptr[i]; k < A_p->row_ptr[i+1]; k++)
+            sum += A_p->vals[k]*x_ext[A_p->col_idx[k]];
+        local_y[i] = sum;
+    }
+}  /* Csr_mat_vect */
+
+#ifdef DEBUG
+/*--------------------------------------------------------------------
+ * Function:  Check_halo
+ * Purpose:   Allgather x, redo the CSR product with A's global column
+ *            indices, and print the largest difference from local_y
+ *            on process 0 (note 4)
+ * In args:   A_p, global_cols:  A's columns before Setup_halo
+ *            x_ext:  my block of x in entries 0..local_n-1
+ *            local_y:  the product from x_ext
+ *            n, local_n, my_rank, comm
+ */
+void Check_halo(
+         csr_mat_t* A_p            /* in  */,
+         int        global_cols[]  /* in  */,
+         float      x_ext[]        /* in  */,
+         float      local_y[]      /* in  */,
+         int        n              /* in  */,
+         int        local_n        /* in  */,
+         int        my_rank        /* in  */,
+         MPI_Comm   comm           /* in  */) {
+
+    float* x = malloc(n*sizeof(float));
+    int    i, k;
+    float  sum;
+    double diff, max_diff = 0.0;
+
+    MPI_Allgather(x_ext, local_n, MPI_FLOAT, x, local_n, MPI_FLOAT, comm);
+    for (i = 0; i < A_p->local_m; i++) {
+        sum = 0.0;
+        for (k = A_p->row_ptr[i]; k < A_p->row_ptr[i+1]; k++)
+            sum += A_p->vals[k]*x[global_cols[k]];
+        diff = fabs(sum - local_y[i]);
+        if (diff > max_diff) max_diff = diff;
+    }
+    MPI_Reduce(my_rank == 0 ? MPI_IN_PLACE : &max_diff, &max_diff, 1,
+        MPI_DOUBLE, MPI_MAX, 0, comm);
+    if (my_rank == 0)
+        printf("Max |CSR - CSR with allgathered x| = %e\n", max_diff);
+    free(x);
+}  /* Check_halo */
+#endif
+
+/*--------------------------------------------------------------------
+ * Function:  Sell_mat_vect_ref
+ * Purpose:   Local product local_y = A*x_ext with A in SELL-C-sigma
+ *            format.  The inner loop over the SELL_C rows of a chunk
+ *            is unit stride, so the compiler can vectorize it.
+ * In args:   S_p:  my rows, columns numbered as in x_ext
+ *            x_ext:  my block of x followed by the ghosts
+ * Out arg:   local_y:  my block of Ax, in the original row order
+ */
+void Sell_mat_vect_ref(
+         sell_mat_t* S_p        /* in  */,
+         float       x_ext[]    /* in  */,
+         float       local_y[]  /* out */) {
+
+    int    c, j, r;
+    float  sum[SELL_C];
+    int*   col;
+    float* val;
+
+    for (c = 0; c < S_p->n_chunks; c++) {
+        col = S_p->col_idx + S_p->chunk_ptr[c];
+        val = S_p->vals + S_p->chunk_ptr[c];
+        for (r = 0; r < SELL_C; r++)
+            sum[r] = 0.0;
+        for (j = 0; j < S_p->chunk_len[c]; j++)
+            for (r = 0; r < SELL_C; r++)
+                sum[r] += val[j*SELL_C + r]*x_ext[col[j*SELL_C + r]];
+        for (r = 0; r < SELL_C && c*SELL_C + r < S_p->local_m; r++)
+            local_y[S_p->perm[c*SELL_C + r]] = sum[r];
+    }
+}  /* Sell_mat_vect_ref */
+
+#ifdef HAVE_X86_SIMD
+/*--------------------------------------------------------------------
+ * Function:  Sell_mat_vect_avx2
+ * Purpose:   AVX2/FMA version of Sell_mat_vect_ref.  One register
+ *            holds the sums for the 8 rows of a chunk, and the entries
+ *            of x are fetched with a gather.
+ * In args, out arg:  see Sell_mat_vect_ref
+ */
+__attribute__((target("avx2,fma")))
+void Sell_mat_vect_avx2(
+         sell_mat_t* S_p        /* in  */,
+         float       x_ext[]    /* in  */,
+         float       local_y[]  /* out */) {
+
+    int    c, j, r;
+    float  sum[SELL_C];
+    int*   col;
+    float* val;
+    __m256 acc;
+
+    for (c = 0; c < S_p->n_chunks; c++) {
+        col = S_p->col_idx + S_p->chunk_ptr[c];
+        val = S_p->vals + S_p->chunk_ptr[c];
+        acc = _mm256_setzero_ps();
+        for (j = 0; j < S_p->chunk_len[c]; j++)
+            acc = _mm256_fmadd_ps(_mm256_loadu_ps(val + j*SELL_C),
+                    _mm256_i32gather_ps(x_ext,
+                        _mm256_loadu_si256((__m256i*) (col + j*SELL_C)), 4),
+                    acc);
+        _mm256_storeu_ps(sum, acc);
+        for (r = 0; r < SELL_C && c*SELL_C + r < S_p->local_m; r++)
+            local_y[S_p->perm[c*SELL_C + r]] = sum[r];
+    }
+}  /* Sell_mat_vect_avx2 */
+#endif
+
+/*--------------------------------------------------------------------
+ * Function:  Sell_mat_vect
+ * Purpose:   Call the fastest SELL-C-sigma kernel the CPU supports
+ * In args, out arg:  see Sell_mat_vect_ref
+ */
+void Sell_mat_vect(
+         sell_mat_t* S_p        /* in  */,
+         float       x_ext[]    /* in  */,
+         float       local_y[]  /* out */) {
+
+#   ifdef HAVE_X86_SIMD
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+        Sell_mat_vect_avx2(S_p, x_ext, local_y);
+        return;
+    }
+#   endif
+    Sell_mat_vect_ref(S_p, x_ext, local_y);
+}  /* Sell_mat_vect */
+
+/*--------------------------------------------------------------------*/
+void Free_csr(csr_mat_t* A_p) {
+    free(A_p->row_ptr);
+    free(A_p->col_idx);
+    free(A_p->vals);
+}  /* Free_csr */
+
+/*--------------------------------------------------------------------*/
+void Free_sell(sell_mat_t* S_p) {
+    free(S_p->chunk_ptr);
+    free(S_p->chunk_len);
+    free(S_p->col_idx);
+    free(S_p->vals);
+    free(S_p->perm);
+}  /* Free_sell */
+
+/*--------------------------------------------------------------------*/
+void Free_halo(halo_t* halo_p) {
+    free(halo_p->ghost_cols);
+    free(halo_p->recv_procs);
+    free(halo_p->recv_counts);
+    free(halo_p->recv_displs);
+    free(halo_p->send_procs);
+    free(halo_p->send_counts);
+    free(halo_p->send_displs);
+    free(halo_p->send_idx);
+    free(halo_p->send_buf);
+    free(halo_p->reqs);
+}  /* Free_halo */
+
+/*--------------------------------------------------------------------*/
+void Print_vector(
+         char*    title      /* in */,
+         float    local_y[]  /* in */,
+         int      local_m    /* in */,
+         int      my_rank    /* in */,
+         int      p          /* in */,
+         MPI_Comm comm       /* in */) {
+
+    int    i;
+    float* temp = NULL;
+
+
+    if (my_rank == 0) {
+        temp = malloc(local_m*p*sizeof(float));
+        MPI_Gather(local_y, local_m, MPI_FLOAT, temp, local_m, MPI_FLOAT,
+           0, comm);
+        printf("%s\n", title);
+        for (i = 0; i < p*local_m; i++)
+            printf("%4.1f ", temp[i]);
+        printf("\n");
+        free(temp);
+    } else {
+        MPI_Gather(local_y, local_m, MPI_FLOAT, temp, local_m, MPI_FLOAT,
+           0, comm);
+    }
+}  /* Print_vector */
@@ -0,0 +1,715 @@
+/* File:     pi_chudnovsky_mpi.c
+ * Purpose:  Compute pi to an arbitrary number of decimal digits with
+ *           the Chudnovsky series
+ *
+ *              1/pi = 12 sum (-1)^k (6k)! (13591409 + 545140134 k)
+ *                            / ((3k)! (k!)^3 640320^(3k+3/2))
+ *
+ *           using binary splitting over GMP integers.  The terms are
+ *           divided among the MPI processes, each process splits its
+ *           block with OpenMP tasks, and the blocks are combined with
+ *           a tree-structured reduction.  The final division, square
+ *           root and conversion to decimal are Newton iterations and
+ *           splittings whose large products are OpenMP tasks.
+ *
+ * Input:    none
+ * Output:   The number of terms, the first and last digits of pi,
+ *           and the time spent in each phase.  With -o, all of the
+ *           digits are written to a file.
+ *
+ * Compile:  mpicc -g -Wall -O2 -fopenmp -o pi_chudnovsky_mpi
+ *              pi_chudnovsky_mpi.c -lgmp
+ * Run:      mpiexec -n <p> pi_chudnovsky_mpi [-t threads] [-o file]
+ *              <digits>
+ *
+ * Notes:
+ *    1.  Each term adds about 14.18 digits, so n = digits/14.18 + 1
+ *        terms are used.  Process q gets the contiguous block of
+ *        terms [q*n/p, (q+1)*n/p).
+ *    2.  For a block of terms [a, b) the splitting computes integers
+ *        P(a,b), Q(a,b), T(a,b) with
+ *
+ *           P(a,c) = P(a,b) P(b,c),  Q(a,c) = Q(a,b) Q(b,c),
+ *           T(a,c) = T(a,b) Q(b,c) + P(a,b) T(b,c),
+ *
+ *        and pi = 426880 sqrt(10005) Q(0,n)/T(0,n).  The two halves
+ *        of a block are split by separate tasks down to Task_depth
+ *        levels, and the four products in a merge are also separate
+ *        tasks, so the large multiplications near the root of the
+ *        tree use more than one thread.  P isn't formed where it
+ *        isn't used:  along the right edge of the tree.
+ *    3.  Processes are paired as in globalSum.c:  at each stage the
+ *        process whose rank has the bit clear receives (P, Q, T) from
+ *        rank + bitmask, whose terms follow its own, so the result
+ *        ends on process 0.  The integers are sent as bytes from
+ *        mpz_export, with the byte counts and the sign of T in a
+ *        header message.
+ *    4.  The final stage runs on process 0 and uses binary fixed
+ *        point with B bits, B a little more than digits*log2(10).
+ *        The quotient (426880 Q << B)/T, the square root
+ *        isqrt(10005 << 2B) and 10^digits don't depend on each other,
+ *        so they're separate tasks.  None of them calls GMP's division
+ *        or square root:  1/T and 1/sqrt(10005) are Newton iterations
+ *        that double the precision at each step, 10^digits is formed
+ *        by squaring, and every large product goes through Par_mul.
+ *        The quotient and the root are then corrected to be exact with
+ *        one more product each.
+ *    5.  Par_mul splits a product a*b the Karatsuba way,
+ *           a = a1 2^h + a0,  b = b1 2^h + b0,
+ *           a*b = a1 b1 2^2h + ((a0+a1)(b0+b1) - a0 b0 - a1 b1) 2^h
+ *                 + a0 b0,
+ *        and runs the three half-size products as tasks, down to
+ *        Mul_depth levels and while the operands have at least
+ *        PAR_MUL_BITS bits.  If one operand is shorter than h only the
+ *        longer one is split, into two tasks.
+ *    6.  The digits are converted to decimal the same way:  the
+ *        integer is divided by 10^(d/2) with Div_qr, and the high and
+ *        low halves are converted by separate tasks, down to
+ *        Mul_depth levels.
+ *    7.  The last digit can be off by one if the digits past it are
+ *        a long run of 9s or 0s.
+ *    8.  GMP's integer routines are thread safe on distinct
+ *        variables; the byte counts sent in the header limit a single
+ *        message to 2^31 - 1 bytes, roughly 5 billion digits.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+#include <gmp.h>
+#include <mpi.h>
+#include <omp.h>
+
+#define DIGITS_PER_TERM 14.181647462725477
+#define C3_OVER_24 10939058860032000UL   /* 640320^3/24 */
+#define GUARD_BITS 64
+#define SHOW_DIGITS 50
+#define PAR_MUL_BITS 65536      /* smallest operand Par_mul splits      */
+#define NEWTON_BASE_BITS 16384  /* below this Newton starts from mpz    */
+#define PAR_CONV_DIGITS 20000   /* smallest number Get_digits splits    */
+
+int Task_depth;
+int Mul_depth;
+
+void Usage(char* prog_name);
+void Get_args(int argc, char* argv[], int* thread_count_p,
+      char** out_file_p, long* digits_p);
+void Split(long a, long b, int need_p, int depth, mpz_t P, mpz_t Q,
+      mpz_t T);
+void Merge(mpz_t P1, mpz_t Q1, mpz_t T1, mpz_t P2, mpz_t Q2, mpz_t T2,
+      int need_p, int parallel);
+void Reduce_blocks(mpz_t P, mpz_t Q, mpz_t T, int thread_count,
+      int my_rank, int p, MPI_Comm comm);
+void Send_block(mpz_t P, mpz_t Q, mpz_t T, int dest, MPI_Comm comm);
+void Recv_block(mpz_t P, mpz_t Q, mpz_t T, int source, MPI_Comm comm);
+char* Pi_digits(mpz_t Q, mpz_t T, mpz_t root, mpz_t pow10, long digits,
+      int thread_count);
+void Par_mul(mpz_t z, mpz_t a, mpz_t b, int depth);
+void Recip(mpz_t R, mpz_t T, unsigned long prec);
+void Div_qr(mpz_t quot, mpz_t rem, mpz_t N, mpz_t T);
+void Rsqrt_ui(mpz_t Y, unsigned long a, unsigned long prec);
+void Sqrt_fixed(mpz_t root, unsigned long a, unsigned long bits);
+void Pow10(mpz_t z, long d);
+void Get_digits(char* str, mpz_t x, long nd, int depth);
+void Print_digits(char* pi_str, long digits, char* out_file);
+
+/*-------------------------------------------------------------------*/
+int main(int argc, char* argv[]) {
+   int my_rank, p, provided, thread_count;
+   long digits, n, my_first, my_last;
+   char* out_file;
+   char* pi_str = NULL;
+   mpz_t P, Q, T, root, pow10;
+   double start, t_split, t_reduce, t_final, t_max;
+   MPI_Comm comm;
+
+   MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &provided);
+   comm = MPI_COMM_WORLD;
+   MPI_Comm_size(comm, &p);
+   MPI_Comm_rank(comm, &my_rank);
+
+   Get_args(argc, argv, &thread_count, &out_file, &digits);
+   n = (long) (digits/DIGITS_PER_TERM) + 1;
+   my_first = (long) ((double) n*my_rank/p);
+   my_last = (long) ((double) n*(my_rank + 1)/p);
+   for (Task_depth = 4; (1 << (Task_depth - 4)) < thread_count;
+         Task_depth++);
+   for (Mul_depth = 0; (1 << Mul_depth) < thread_count; Mul_depth++);
+
+   mpz_inits(P, Q, T, root, pow10, NULL);
+
+   MPI_Barrier(comm);
+   start = MPI_Wtime();
+   /* The rightmost block's P is never used */
+#  pragma omp parallel num_threads(thread_count)
+#  pragma omp single
+   {
+      if (my_first < my_last)
+         Split(my_first, my_last, my_rank < p - 1, 0, P, Q, T);
+      else {
+         mpz_set_ui(P, 1);
+         mpz_set_ui(Q, 1);
+         mpz_set_ui(T, 0);
+      }
+   }
+   t_split = MPI_Wtime() - start;
+
+   start = MPI_Wtime();
+   Reduce_blocks(P, Q, T, thread_count, my_rank, p, comm);
+   t_reduce = MPI_Wtime() - start;
+
+   start = MPI_Wtime();
+   if (my_rank == 0)
+      pi_str = Pi_digits(Q, T, root, pow10, digits, thread_count);
+   t_final = MPI_Wtime() - start;
+
+   MPI_Reduce(&t_split, &t_max, 1, MPI_DOUBLE, MPI_MAX, 0, comm);
+   if (my_rank == 0) {
+      Print_digits(pi_str, digits, out_file);
+      printf("p = %d, threads = %d, terms = %ld\n", p, thread_count, n);
+      printf("Splitting:  %e seconds (slowest process)\n", t_max);
+      printf("Reduction:  %e seconds\n", t_reduce);
+      printf("Final:      %e seconds\n", t_final);
+      printf("Total:      %e seconds\n", t_max + t_reduce + t_final);
+      free(pi_str);
+   }
+
+   mpz_clears(P, Q, T, root, pow10, NULL);
+   MPI_Finalize();
+   return 0;
+}  /* main */
+
+/*-------------------------------------------------------------------
+ * Function:  Usage
+ * Purpose:   Print a message explaining how to run the program
+ * In arg:    prog_name
+ */
+void Usage(char* prog_name) {
+   fprintf(stderr, "usage: mpiexec -n <p> %s [-t threads] [-o file] "
+         "<digits>\n", prog_name);
+   fprintf(stderr, "   -t:  number of OpenMP threads per process "
+         "(default OMP_NUM_THREADS)\n");
+   fprintf(stderr, "   -o:  write all the digits to file\n");
+   exit(0);
+}  /* Usage */
+
+/*-------------------------------------------------------------------
+ * Function:  Get_args
+ * Purpose:   Get the command line arguments.  Every process parses
+ *            its own copy of argv, so nothing needs to be broadcast.
+ * In args:   argc, argv
+ * Out args:  thread_count_p, out_file_p, digits_p
+ */
+void Get_args(int argc, char* argv[], int* thread_count_p,
+      char** out_file_p, long* digits_p) {
+   int c;
+
+   *thread_count_p = omp_get_max_threads();
+   *out_file_p = NULL;
+   while ((c = getopt(argc, argv, "t:o:")) != -1) {
+      switch (c) {
+         case 't':
+            *thread_count_p = strtol(optarg, NULL, 10);
+            if (*thread_count_p < 1) Usage(argv[0]);
+            break;
+         case 'o':
+            *out_file_p = optarg;
+            break;
+         default:
+            Usage(argv[0]);
+      }
+   }
+   if (optind != argc - 1) Usage(argv[0]);
+   *digits_p = strtol(argv[optind], NULL, 10);
+   if (*digits_p < 1) Usage(argv[0]);
+}  /* Get_args */
+
+/*-------------------------------------------------------------------
+ * Function:  Split
+ * Purpose:   Compute P(a,b), Q(a,b) and T(a,b) by binary splitting
+ * In args:   a, b:  the block of terms, a < b
+ *            need_p:  whether the caller uses P
+ *            depth:  depth in the splitting tree
+ * Out args:  P, Q, T:  initialized by the caller
+ *
+ * Note:      Must be called from inside a parallel region for the
+ *            tasks to run in parallel.
+ */
+void Split(long a, long b, int need_p, int depth, mpz_t P, mpz_t Q,
+      mpz_t T) {
+   long m;
+   mpz_t P2, Q2, T2;
+
+   if (b - a == 1) {
+      if (a == 0) {
+         mpz_set_ui(P, 1);
+         mpz_set_ui(Q, 1);
+      } else {
+         /* P = (6a-5)(2a-1)(6a-1), Q = a^3 640320^3/24 */
+         mpz_set_ui(P, 6*a - 5);
+         mpz_mul_ui(P, P, 2*a - 1);
+         mpz_mul_ui(P, P, 6*a - 1);
+         mpz_set_ui(Q, a);
+         mpz_mul_ui(Q, Q, a);
+         mpz_mul_ui(Q, Q, a);
+         mpz_mul_ui(Q, Q, C3_OVER_24);
+      }
+      mpz_mul_ui(T, P, 13591409 + 545140134UL*a);
+      if (a % 2 == 1) mpz_neg(T, T);
+      return;
+   }
+
+   m = a + (b - a)/2;
+   mpz_inits(P2, Q2, T2, NULL);
+   if (depth < Task_depth) {
+#     pragma omp task shared(P, Q, T)
+      Split(a, m, 1, depth + 1, P, Q, T);
+      Split(m, b, need_p, depth + 1, P2, Q2, T2);
+#     pragma omp taskwait
+   } else {
+      Split(a, m, 1, depth + 1, P, Q, T);
+      Split(m, b, need_p, depth + 1, P2, Q2, T2);
+   }
+   Merge(P, Q, T, P2, Q2, T2, need_p, depth < Task_depth);
+   mpz_clears(P2, Q2, T2, NULL);
+}  /* Split */
+
+/*-------------------------------------------------------------------
+ * Function:  Merge
+ * Purpose:   Combine the blocks [a,b) and [b,c):  T1 = T1 Q2 + P1 T2,
+ *            Q1 = Q1 Q2 and, if need_p, P1 = P1 P2
+ * In args:   P2, Q2, T2, need_p
+ *            parallel:  run the products as separate tasks
+ * In/out args:  P1, Q1, T1
+ */
+void Merge(mpz_t P1, mpz_t Q1, mpz_t T1, mpz_t P2, mpz_t Q2, mpz_t T2,
+      int need_p, int parallel) {
+   mpz_t PT, PP;
+
+   mpz_inits(PT, PP, NULL);
+#  pragma omp task shared(PT, P1, T2) if(parallel)
+   mpz_mul(PT, P1, T2);
+#  pragma omp task shared(T1, Q2) if(parallel)
+   mpz_mul(T1, T1, Q2);
+#  pragma omp task shared(Q1, Q2) if(parallel)
+   mpz_mul(Q1, Q1, Q2);
+   if (need_p) {
+#     pragma omp task shared(PP, P1, P2) if(parallel)
+      mpz_mul(PP, P1, P2);
+   }
+#  pragma omp taskwait
+
+   mpz_add(T1, T1, PT);
+   if (need_p) mpz_swap(P1, PP);
+   mpz_clears(PT, PP, NULL);
+}  /* Merge */
+
+/*-------------------------------------------------------------------
+ * Function:  Reduce_blocks
+ * Purpose:   Combine the processes' blocks with a tree-structured
+ *            reduction
+ * In args:   thread_count, my_rank, p, comm
+ * In/out args:  P, Q, T:  on process 0 Q and T are Q(0,n), T(0,n)
+ *            on return.  P isn't needed there and isn't formed.
+ */
+void Reduce_blocks(mpz_t P, mpz_t Q, mpz_t T, int thread_count,
+      int my_rank, int p, MPI_Comm comm) {
+   int bitmask = 1;
+   int partner;
+   mpz_t P2, Q2, T2;
+
+   mpz_inits(P2, Q2, T2, NULL);
+   while (bitmask < p) {
+      partner = my_rank ^ bitmask;
+      if (my_rank < partner) {
+         if (partner < p) {
+            Recv_block(P2, Q2, T2, partner, comm);
+#           pragma omp parallel num_threads(thread_count)
+#           pragma omp single
+            Merge(P, Q, T, P2, Q2, T2, my_rank > 0 || 2*bitmask < p,
+                  1);
+         }
+         bitmask <<= 1;
+      } else {
+         Send_block(P, Q, T, partner, comm);
+         break;
+      }
+   }
+   mpz_clears(P2, Q2, T2, NULL);
+}  /* Reduce_blocks */
+
+/*-------------------------------------------------------------------
+ * Function:  Send_block
+ * Purpose:   Send P, Q and T to dest:  a header with the byte count
+ *            of each and the sign of T, then the bytes
+ * In args:   P, Q, T, dest, comm
+ */
+void Send_block(mpz_t P, mpz_t Q, mpz_t T, int dest, MPI_Comm comm) {
+   long header[4];
+   size_t count[3];
+   char* buf[3];
+   int i;
+
+   buf[0] = mpz_export(NULL, &count[0], -1, 1, 0, 0, P);
+   buf[1] = mpz_export(NULL, &count[1], -1, 1, 0, 0, Q);
+   buf[2] = mpz_export(NULL, &count[2], -1, 1, 0, 0, T);
+   for (i = 0; i < 3; i++)
+      header[i] = count[i];
+   header[3] = mpz_sgn(T);
+
+   MPI_Send(header, 4, MPI_LONG, dest, 0, comm);
+   for (i = 0; i < 3; i++) {
+      MPI_Send(buf[i], (int) count[i], MPI_BYTE, dest, 1 + i, comm);
+      free(buf[i]);
+   }
+}  /* Send_block */
+
+/*-------------------------------------------------------------------
+ * Function:  Recv_block
+ * Purpose:   Receive P, Q and T sent by Send_block
+ * In args:   source, comm
+ * Out args:  P, Q, T
+ */
+void Recv_block(mpz_t P, mpz_t Q, mpz_t T, int source, MPI_Comm comm) {
+   long header[4];
+   char* buf;
+   mpz_ptr z[3];
+   int i;
+
+   z[0] = P; z[1] = Q; z[2] = T;
+   MPI_Recv(header, 4, MPI_LONG, source, 0, comm, MPI_STATUS_IGNORE);
+   for (i = 0; i < 3; i++) {
+      buf = malloc(header[i] > 0 ? header[i] : 1);
+      MPI_Recv(buf, (int) header[i], MPI_BYTE, source, 1 + i, comm,
+            MPI_STATUS_IGNORE);
+      mpz_import(z[i], header[i], -1, 1, 0, 0, buf);
+      free(buf);
+   }
+   if (header[3] < 0) mpz_neg(T, T);
+}  /* Recv_block */
+
+/*-------------------------------------------------------------------
+ * Function:  Pi_digits
+ * Purpose:   Form the decimal digits of pi from Q(0,n) and T(0,n)
+ * In args:   Q, T, digits, thread_count
+ * Scratch:   root, pow10
+ * Ret val:   String "31415..." with digits + 1 digits, allocated
+ *            with malloc
+ */
+char* Pi_digits(mpz_t Q, mpz_t T, mpz_t root, mpz_t pow10, long digits,
+      int thread_count) {
+   unsigned long bits = (unsigned long) (digits*log2(10.0)) + GUARD_BITS;
+   mpz_t quot, pi;
+   char* pi_str = malloc(digits + 2);
+
+   mpz_inits(quot, pi, NULL);
+#  pragma omp parallel num_threads(thread_count)
+#  pragma omp single
+   {
+#     pragma omp task shared(quot, Q, T)
+      {  /* quot = (426880 Q << bits)/T */
+         mpz_mul_ui(quot, Q, 426880);
+         mpz_mul_2exp(quot, quot, bits);
+         Div_qr(quot, NULL, quot, T);
+      }
+#     pragma omp task shared(root)
+      Sqrt_fixed(root, 10005, bits);
+#     pragma omp task shared(pow10)
+      Pow10(pow10, digits);
+#     pragma omp taskwait
+
+      /* pi << bits, then the integer part of pi 10^digits */
+      Par_mul(pi, quot, root, Mul_depth);
+      mpz_tdiv_q_2exp(pi, pi, bits);
+      Par_mul(pi, pi, pow10, Mul_depth);
+      mpz_tdiv_q_2exp(pi, pi, bits);
+
+      Get_digits(pi_str, pi, digits + 1, Mul_depth);
+   }
+   pi_str[digits + 1] = '\0';
+
+   mpz_clears(quot, pi, NULL);
+   return pi_str;
+}  /* Pi_digits */
+
+/*-------------------------------------------------------------------
+ * Function:  Par_mul
+ * Purpose:   z = a*b, with the product split into tasks (note 5)
+ * In args:   a, b
+ *            depth:  levels of splitting left
+ * Out arg:   z:  may be a or b
+ *
+ * Note:      Must be called from inside a parallel region for the
+ *            tasks to run in parallel.
+ */
+void Par_mul(mpz_t z, mpz_t a, mpz_t b, int depth) {
+   size_t na = mpz_sizeinbase(a, 2), nb = mpz_sizeinbase(b, 2);
+   size_t h = (na > nb ? na : nb)/2;
+   mpz_ptr x = na >= nb ? a : b;   /* the longer operand */
+   mpz_ptr y = na >= nb ? b : a;
+   mpz_t x0, x1, y0, y1, xs, ys, z0, z1, z2;
+
+   if (depth == 0 || (na < nb ? na : nb) < PAR_MUL_BITS) {
+      mpz_mul(z, a, b);
+      return;
+   }
+
+   mpz_inits(x0, x1, y0, y1, xs, ys, z0, z1, z2, NULL);
+   mpz_tdiv_r_2exp(x0, x, h);
+   mpz_tdiv_q_2exp(x1, x, h);
+   if (mpz_sizeinbase(y, 2) <= h) {
+      /* Only x is long:  x*y = x1 y 2^h + x0 y */
+#     pragma omp task shared(z0, x0, y)
+      Par_mul(z0, x0, y, depth - 1);
+      Par_mul(z1, x1, y, depth - 1);
+#     pragma omp taskwait
+      mpz_mul_2exp(z1, z1, h);
+      mpz_add(z, z1, z0);
+   } else {
+      mpz_tdiv_r_2exp(y0, y, h);
+      mpz_tdiv_q_2exp(y1, y, h);
+#     pragma omp task shared(z0, x0, y0)
+      Par_mul(z0, x0, y0, depth - 1);
+#     pragma omp task shared(z2, x1, y1)
+      Par_mul(z2, x1, y1, depth - 1);
+      mpz_add(xs, x0, x1);
+      mpz_add(ys, y0, y1);
+      Par_mul(z1, xs, ys, depth - 1);
+#     pragma omp taskwait
+      mpz_sub(z1, z1, z0);
+      mpz_sub(z1, z1, z2);
+      mpz_mul_2exp(z2, z2, 2*h);
+      mpz_mul_2exp(z1, z1, h);
+      mpz_add(z, z2, z1);
+      mpz_add(z, z, z0);
+   }
+   mpz_clears(x0, x1, y0, y1, xs, ys, z0, z1, z2, NULL);
+}  /* Par_mul */
+
+/*-------------------------------------------------------------------
+ * Function:  Recip
+ * Purpose:   Newton iteration for R = 2^(t + prec)/T, t the number of
+ *            bits in T.  Each step doubles the precision:  with R0
+ *            good to h = prec/2 + GUARD_BITS bits,
+ *               E = 2^(t+h) - T R0,
+ *               R = R0 2^(prec-h) + R0 E/2^(t+2h-prec),
+ *            where T is cut to its top prec + GUARD_BITS bits.
+ * In args:   T > 0, prec
+ * Out arg:   R:  within a few units of 2^(t + prec)/T
+ */
+void Recip(mpz_t R, mpz_t T, unsigned long prec) {
+   unsigned long t = mpz_sizeinbase(T, 2), s, h;
+   mpz_t Tt, E;
+
+   mpz_inits(Tt, E, NULL);
+   s = t > prec + GUARD_BITS ? t - prec - GUARD_BITS : 0;
+   mpz_tdiv_q_2exp(Tt, T, s);
+   t -= s;
+   if (prec <= NEWTON_BASE_BITS) {
+      mpz_set_ui(R, 0);
+      mpz_setbit(R, t + prec);
+      mpz_tdiv_q(R, R, Tt);
+   } else {
+      h = prec/2 + GUARD_BITS;
+      Recip(R, T, h);
+      Par_mul(E, Tt, R, Mul_depth);
+      mpz_set_ui(Tt, 0);
+      mpz_setbit(Tt, t + h);
+      mpz_sub(E, Tt, E);
+      Par_mul(E, E, R, Mul_depth);
+      mpz_fdiv_q_2exp(E, E, t + 2*h - prec);
+      mpz_mul_2exp(R, R, prec - h);
+      mpz_add(R, R, E);
+   }
+   mpz_clears(Tt, E, NULL);
+}  /* Recip */
+
+/*-------------------------------------------------------------------
+ * Function:  Div_qr
+ * Purpose:   quot = N/T and rem = N - quot T, exactly, from 1/T:
+ *            quot is formed from N times Recip(T) and then corrected
+ *            with the remainder
+ * In args:   N >= 0, T > 0
+ * Out args:  quot:  may be N
+ *            rem:  NULL if it isn't needed
+ */
+void Div_qr(mpz_t quot, mpz_t rem, mpz_t N, mpz_t T) {
+   unsigned long nn = mpz_sizeinbase(N, 2), t = mpz_sizeinbase(T, 2);
+   unsigned long prec, s;
+   mpz_t R, Nt, r;
+
+   mpz_inits(R, Nt, r, NULL);
+   if (mpz_cmp(N, T) < 0) {
+      mpz_set(r, N);
+      mpz_set_ui(quot, 0);
+   } else {
+      /* quot has at most nn - t + 1 bits;  only the top bits of N */
+      /* matter                                                    */
+      prec = nn - t + 1 + GUARD_BITS;
+      s = nn > prec + GUARD_BITS ? nn - prec - GUARD_BITS : 0;
+      Recip(R, T, prec);
+      mpz_tdiv_q_2exp(Nt, N, s);
+      Par_mul(R, Nt, R, Mul_depth);
+      mpz_tdiv_q_2exp(R, R, t + prec - s);
+
+      Par_mul(r, R, T, Mul_depth);
+      mpz_sub(r, N, r);
+      mpz_swap(quot, R);
+      while (mpz_sgn(r) < 0) {
+         mpz_sub_ui(quot, quot, 1);
+         mpz_add(r, r, T);
+      }
+      while (mpz_cmp(r, T) >= 0) {
+         mpz_add_ui(quot, quot, 1);
+         mpz_sub(r, r, T);
+      }
+   }
+   if (rem != NULL) mpz_swap(rem, r);
+   mpz_clears(R, Nt, r, NULL);
+}  /* Div_qr */
+
+/*-------------------------------------------------------------------
+ * Function:  Rsqrt_ui
+ * Purpose:   Newton iteration for Y = 2^prec/sqrt(a).  With Y0 good
+ *            to h = prec/2 + GUARD_BITS bits,
+ *               E = 2^2h - a Y0^2,  Y = Y0 2^(prec-h) + Y0 E/2^(3h+1-prec)
+ * In args:   a > 0, prec
+ * Out arg:   Y:  within a few units of 2^prec/sqrt(a)
+ */
+void Rsqrt_ui(mpz_t Y, unsigned long a, unsigned long prec) {
+   unsigned long h;
+   mpz_t E, pow2;
+
+   if (prec <= NEWTON_BASE_BITS) {
+      mpz_set_ui(Y, 0);
+      mpz_setbit(Y, 2*prec);
+      mpz_tdiv_q_ui(Y, Y, a);
+      mpz_sqrt(Y, Y);
+      return;
+   }
+
+   mpz_inits(E, pow2, NULL);
+   h = prec/2 + GUARD_BITS;
+   Rsqrt_ui(Y, a, h);
+   Par_mul(E, Y, Y, Mul_depth);
+   mpz_mul_ui(E, E, a);
+   mpz_setbit(pow2, 2*h);
+   mpz_sub(E, pow2, E);
+   Par_mul(E, E, Y, Mul_depth);
+   mpz_fdiv_q_2exp(E, E, 3*h + 1 - prec);
+   mpz_mul_2exp(Y, Y, prec - h);
+   mpz_add(Y, Y, E);
+   mpz_clears(E, pow2, NULL);
+}  /* Rsqrt_ui */
+
+/*-------------------------------------------------------------------
+ * Function:  Sqrt_fixed
+ * Purpose:   root = isqrt(a << 2 bits) = a/sqrt(a) << bits, from
+ *            Rsqrt_ui, then corrected with the remainder
+ * In args:   a > 0, bits
+ * Out arg:   root
+ */
+void Sqrt_fixed(mpz_t root, unsigned long a, unsigned long bits) {
+   mpz_t A, r, step;
+
+   mpz_inits(A, r, step, NULL);
+   Rsqrt_ui(root, a, bits + GUARD_BITS);
+   mpz_mul_ui(root, root, a);
+   mpz_tdiv_q_2exp(root, root, GUARD_BITS);
+
+   /* r = A - root^2 must be in [0, 2 root] */
+   mpz_set_ui(A, a);
+   mpz_mul_2exp(A, A, 2*bits);
+   Par_mul(r, root, root, Mul_depth);
+   mpz_sub(r, A, r);
+   while (mpz_sgn(r) < 0) {
+      mpz_sub_ui(root, root, 1);
+      mpz_mul_2exp(step, root, 1);
+      mpz_add_ui(step, step, 1);
+      mpz_add(r, r, step);
+   }
+   for (;;) {
+      mpz_mul_2exp(step, root, 1);
+      mpz_add_ui(step, step, 1);
+      if (mpz_cmp(r, step) < 0) break;
+      mpz_sub(r, r, step);
+      mpz_add_ui(root, root, 1);
+   }
+   mpz_clears(A, r, step, NULL);
+}  /* Sqrt_fixed */
+
+/*-------------------------------------------------------------------
+ * Function:  Pow10
+ * Purpose:   z = 10^d by repeated squaring with Par_mul
+ * In arg:    d >= 0
+ * Out arg:   z
+ */
+void Pow10(mpz_t z, long d) {
+   if (d*log2(10.0) < 2*PAR_MUL_BITS) {
+      mpz_ui_pow_ui(z, 10, d);
+      return;
+   }
+   Pow10(z, d/2);
+   Par_mul(z, z, z, Mul_depth);
+   if (d % 2 == 1) mpz_mul_ui(z, z, 10);
+}  /* Pow10 */
+
+/*-------------------------------------------------------------------
+ * Function:  Get_digits
+ * Purpose:   Write the nd low decimal digits of x to str, with
+ *            leading zeros (note 6).  No '\0' is stored.
+ * In args:   x:  0 <= x < 10^nd
+ *            nd, depth
+ * Out arg:   str
+ */
+void Get_digits(char* str, mpz_t x, long nd, int depth) {
+   long len, h;
+   char* buf;
+   mpz_t pw, hi, lo;
+
+   if (depth == 0 || nd < PAR_CONV_DIGITS) {
+      buf = mpz_get_str(NULL, 10, x);
+      len = strlen(buf);
+      memset(str, '0', nd - len);
+      memcpy(str + nd - len, buf, len);
+      free(buf);
+      return;
+   }
+
+   h = nd/2;
+   mpz_inits(pw, hi, lo, NULL);
+   Pow10(pw, h);
+   Div_qr(hi, lo, x, pw);
+#  pragma omp task shared(hi)
+   Get_digits(str, hi, nd - h, depth - 1);
+   Get_digits(str + nd - h, lo, h, depth - 1);
+#  pragma omp taskwait
+   mpz_clears(pw, hi, lo, NULL);
+}  /* Get_digits */
+
+/*-------------------------------------------------------------------
+ * Function:  Print_digits
+ * Purpose:   Print the first and last digits of pi, and write all of
+ *            them to out_file if it isn't NULL
+ * In args:   pi_str, digits, out_file
+ */
+void Print_digits(char* pi_str, long digits, char* out_file) {
+   FILE* fp;
+
+   if (digits <= 2*SHOW_DIGITS)
+      printf("pi = 3.%s\n", pi_str + 1);
+   else
+      printf("pi = 3.%.*s...%s\n", SHOW_DIGITS, pi_str + 1,
+            pi_str + 1 + digits - SHOW_DIGITS);
+
+   if (out_file != NULL) {
+      fp = fopen(out_file, "w");
+      if (fp == NULL) {
+         fprintf(stderr, "Can't open %s\n", out_file);
+         return;
+      }
+      fprintf(fp, "3.%s\n", pi_str + 1);
+      fclose(fp);
+   }
+}  /* Print_digits */
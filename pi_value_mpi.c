@@ -4,72 +4,163 @@
  *
  *              pi = 4*[1 - 1/3 + 1/5 - 1/7 + 1/9 - . . . ]
  *
- * Compile:  gcc -g -Wall -fopenmp -o pi_value_mpi pi_value_mpi.c -lm              
- * Run:      hw12 <threads> <n>
+ *           or one of two series that converge much faster (see
+ *           note 3).
+ *
+ * Compile:  gcc -g -Wall -fopenmp -o pi_value_mpi pi_value_mpi.c -lm
+ * Run:      hw12 [-b] [-d] [-r reps] [-w warmups] <threads> <n>
+ *              [leibniz|euler|machin]
  *           n is the number of terms of the Maclaurin series to use
+ *           (at most n for euler and machin, which stop once the
+ *           terms no longer change the sum)
+ *           -b benchmarks the Leibniz loop on up to <threads> threads
+ *           (see note 4)
+ *           -d makes the Leibniz sum the same, bit for bit, for any
+ *           number of threads and any schedule (see note 5)
  *
- * Input:    none            
+ * Input:    none
  * Output:   The estimate of pi and the value of pi computed by the
- *           arctan function in the math library
+ *           arctan function in the math library, or with -b a CSV
+ *           table of times
  *
  * Notes:
  *    1.  The radius of convergence is only 1.  So the series converges
  *        quite slowly.
- */        
+ *    2.  The Leibniz series is summed in pairs of terms,
+ *
+ *           1/(4k+1) - 1/(4k+3) = 2/((4k+1)(4k+3)),
+ *
+ *        so there's no sign to work out and one division per pair.
+ *        The pairs are split into blocks of PAIR_BLOCK, and the
+ *        threads divide up the blocks with schedule(runtime), so the
+ *        schedule is set by OMP_SCHEDULE (static if it isn't set).
+ *        Each block is summed with Leibniz_pairs, which is chosen at
+ *        run time:  an AVX-512 kernel (8 pairs at a
+ *        time), an AVX2/FMA kernel (4 pairs at a time), or the scalar
+ *        Leibniz_pairs_ref.  The vector kernels keep two accumulator
+ *        registers so the divisions overlap.
+ *    3.  euler is the Euler transform of the Leibniz series,
+ *
+ *           pi = 2*[1 + 1/3 + (1*2)/(3*5) + (1*2*3)/(3*5*7) + . . . ],
+ *
+ *        which gains a bit per term, and machin is Machin's formula
+ *
+ *           pi = 16*arctan(1/5) - 4*arctan(1/239),
+ *
+ *        with the arctangents from their Maclaurin series, which
+ *        gains about 1.4 digits per term.  Both reach the limit of
+ *        double precision in about 50 and 11 terms, so they're
+ *        computed by a single thread.
+ *    4.  With -b, the Leibniz loop is run warmups + reps times for
+ *        each combination of proc_bind (none, close or spread),
+ *        schedule (static, dynamic or guided), chunk size (the
+ *        default, or 1, 16 or 256 blocks) and thread count (1, 2,
+ *        4, ..., threads).  Each line of the output gives the median
+ *        and minimum time, the throughput in terms/second, and the
+ *        parallel efficiency:  the 1-thread median for the same
+ *        bind, schedule and chunk over threads*median.  The places
+ *        can't be changed inside a run, so the OMP_PLACES and
+ *        OMP_PROC_BIND settings and the number of places are printed
+ *        on the first line; run again with other settings, e.g.
+ *        OMP_PLACES=cores and OMP_PLACES=threads, to compare them.
+ *        With -d, the reproducible sum of note 5 is timed.
+ *    5.  With reduction(+:sum) the blocks are added in an order that
+ *        depends on the number of threads and the schedule, so the
+ *        last digits change with them.  With -d, the loop runs over
+ *        superblocks of SUPER_BLOCKS blocks instead.  Each superblock
+ *        adds up its blocks in a fixed order in double-double
+ *        (compensated) arithmetic and stores the result in an array,
+ *        and the superblock sums are then added in a fixed pairwise
+ *        tree, also in double-double, by one thread.  Every value is
+ *        computed from the same operands in the same order whichever
+ *        thread does it, so the estimate doesn't depend on the
+ *        thread count or schedule.  It can differ in the last bit
+ *        between a machine that uses the AVX-512 kernel and one that
+ *        uses the AVX2 or scalar kernel, and it relies on the
+ *        compiler not reassociating:  don't build with -ffast-math.
+ */
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <float.h>
 #include <math.h>
 #include <omp.h>
 
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#  define HAVE_X86_SIMD
+#  include <immintrin.h>
+#endif
+
+#define PAIR_BLOCK 1024   /* pairs of terms per loop iteration */
+#define SUPER_BLOCKS 64   /* blocks per loop iteration with -d  */
+
+/* proc_bind clause for Leibniz */
+#define BIND_NONE   0
+#define BIND_CLOSE  1
+#define BIND_SPREAD 2
+
 //global variable, although could be placed in main here
 int thread_count;
 
+typedef double (*Leibniz_pairs_t)(long long first, long long last);
 
 void Usage(char* prog_name);
+void Get_args(int argc, char* argv[], int* bench_p, int* repro_p,
+      int* reps_p, int* warmups_p, long long* n_p, char** method_p);
+double Leibniz(long long n, int threads, int bind, int repro);
+double Leibniz_blocks(long long pairs, Leibniz_pairs_t kernel,
+      double super[]);
+void Two_sum(double a, double b, double* s_p, double* e_p);
+void Dd_add(double* hi_p, double* lo_p, double hi, double lo);
+double Tree_sum(double super[], long long count);
+void Run_benchmark(long long n, int max_threads, int repro, int reps,
+      int warmups);
+int Compare_double(const void* x_p, const void* y_p);
+double Leibniz_pairs_ref(long long first, long long last);
+#ifdef HAVE_X86_SIMD
+double Leibniz_pairs_avx2(long long first, long long last);
+double Leibniz_pairs_avx512(long long first, long long last);
+#endif
+Leibniz_pairs_t Select_leibniz_pairs(void);
+double Euler(long long n, long long* terms_p);
+double Arctan_inv(double x, long long n, long long* terms_p);
+double Machin(long long n, long long* terms_p);
 
 int main(int argc, char* argv[]) {
-   long long i, n;
-   double factor = 1.0;
-   double sum = 0.0;
-
-   //check if initial inputs are valid
-   if (argc != 3) Usage(argv[0]);
-
-   //saves the amount of threads
-   thread_count = strtol(argv[1], NULL, 10);
+   long long n, terms;
+   double sum, start, elapsed;
+   int bench, repro, reps, warmups;
+   char* method;
 
-   n = strtoll(argv[2], NULL, 10);
-   if (n <= 0) Usage(argv[0]);
+   //check if initial inputs are valid, and save the amount of threads
+   Get_args(argc, argv, &bench, &repro, &reps, &warmups, &n, &method);
+   if (getenv("OMP_SCHEDULE") == NULL)
+      omp_set_schedule(omp_sched_static, 0);
 
-//declares pragma
-#  pragma omp parallel for num_threads(thread_count) \
-      reduction (+:sum)  default(none) private(i, factor)\
-      shared(n)
-
-
-   for (i = 0; i < n; i++) {
-
-   //Factor moved into if-else block to run 
-   //with multiple thread  s 
-   if( i%2 ==0){
-         factor = 1.0;
-      }else{
-         factor = -1.0;
-      }
-
-
-
-      sum += factor/(2*i+1);
-#     ifdef DEBUG
-      printf("i = %lld, sum = %.15f\n", i, sum);
-#     endif
+   if (bench) {
+      Run_benchmark(n, thread_count, repro, reps, warmups);
+      return 0;
    }
 
-   sum = 4.0*sum;
-   printf("With n = %lld terms,\n", n);
+   start = omp_get_wtime();
+   terms = n;
+   if (strcmp(method, "leibniz") == 0)
+      sum = Leibniz(n, thread_count, BIND_NONE, repro);
+   else if (strcmp(method, "euler") == 0)
+      sum = Euler(n, &terms);
+   else if (strcmp(method, "machin") == 0)
+      sum = Machin(n, &terms);
+   else
+      Usage(argv[0]);
+   elapsed = omp_get_wtime() - start;
+
+   printf("With n = %lld terms,\n", terms);
    printf("   Our estimate of pi = %.15f\n", sum);
    printf("                   pi = %.15f\n", 4.0*atan(1.0));
+   printf("   Error = %e, elapsed time = %e seconds\n",
+         fabs(sum - 4.0*atan(1.0)), elapsed);
    return 0;
 }  /* main */
 
@@ -79,8 +170,443 @@ int main(int argc, char* argv[]) {
  * In arg:    prog_name
  */
 void Usage(char* prog_name) {
-   fprintf(stderr, "usage: %s <threads> <n>\n", prog_name);
+   fprintf(stderr, "usage: %s [-b] [-d] [-r reps] [-w warmups] <threads>"
+         " <n> [leibniz|euler|machin]\n", prog_name);
    fprintf(stderr, "   n is the number of terms and should be >= 1\n");
+   fprintf(stderr, "   the series is leibniz (default), euler or machin\n");
+   fprintf(stderr, "   -b benchmarks the leibniz loop on 1, 2, 4, ..., "
+         "threads threads\n");
+   fprintf(stderr, "   -d gives the same leibniz sum for any number of "
+         "threads\n");
+   fprintf(stderr, "   -r timed runs per configuration (default 5), "
+         "-w warm-up runs (default 1)\n");
    exit(0);
 }  /* Usage */
 
+/*------------------------------------------------------------------
+ * Function:  Get_args
+ * Purpose:   Get the command line arguments, and set thread_count
+ * In args:   argc, argv
+ * Out args:  bench_p:  1 for benchmark mode
+ *            repro_p:  1 for the reproducible Leibniz sum
+ *            reps_p, warmups_p:  timed and untimed runs for -b
+ *            n_p:  number of terms
+ *            method_p:  leibniz, euler or machin
+ */
+void Get_args(int argc, char* argv[], int* bench_p, int* repro_p,
+      int* reps_p, int* warmups_p, long long* n_p, char** method_p) {
+   int c;
+
+   *bench_p = 0;
+   *repro_p = 0;
+   *reps_p = 5;
+   *warmups_p = 1;
+   *method_p = "leibniz";
+   while ((c = getopt(argc, argv, "bdr:w:")) != -1) {
+      switch (c) {
+         case 'b':
+            *bench_p = 1;
+            break;
+         case 'd':
+            *repro_p = 1;
+            break;
+         case 'r':
+            *reps_p = strtol(optarg, NULL, 10);
+            if (*reps_p < 1) Usage(argv[0]);
+            break;
+         case 'w':
+            *warmups_p = strtol(optarg, NULL, 10);
+            if (*warmups_p < 0) Usage(argv[0]);
+            break;
+         default:
+            Usage(argv[0]);
+      }
+   }
+   if (argc - optind != 2 && argc - optind != 3) Usage(argv[0]);
+
+   thread_count = strtol(argv[optind], NULL, 10);
+   if (thread_count <= 0) Usage(argv[0]);
+   *n_p = strtoll(argv[optind + 1], NULL, 10);
+   if (*n_p <= 0) Usage(argv[0]);
+   if (argc - optind == 3) *method_p = argv[optind + 2];
+   if (*bench_p && strcmp(*method_p, "leibniz") != 0) Usage(argv[0]);
+}  /* Get_args */
+
+/*------------------------------------------------------------------
+ * Function:  Leibniz
+ * Purpose:   Estimate pi with n terms of the Leibniz series, split
+ *            among threads threads
+ * In args:   n, threads
+ *            bind:  BIND_NONE (no proc_bind clause), BIND_CLOSE or
+ *               BIND_SPREAD
+ *            repro:  make the sum independent of threads (note 5)
+ * Ret val:   The estimate
+ */
+double Leibniz(long long n, int threads, int bind, int repro) {
+   long long pairs = n/2;
+   long long supers = (pairs + (long long) PAIR_BLOCK*SUPER_BLOCKS - 1)
+         /((long long) PAIR_BLOCK*SUPER_BLOCKS);
+   double sum = 0.0, lo = 0.0;
+   double* super = NULL;
+   Leibniz_pairs_t kernel = Select_leibniz_pairs();
+
+   if (repro) super = malloc(2*(supers > 0 ? supers : 1)*sizeof(double));
+
+   /* proc_bind takes a constant, so there's a region for each */
+   switch (bind) {
+      case BIND_CLOSE:
+#        pragma omp parallel num_threads(threads) proc_bind(close) \
+            reduction(+:sum) default(none) shared(pairs, kernel, super)
+         sum += Leibniz_blocks(pairs, kernel, super);
+         break;
+      case BIND_SPREAD:
+#        pragma omp parallel num_threads(threads) proc_bind(spread) \
+            reduction(+:sum) default(none) shared(pairs, kernel, super)
+         sum += Leibniz_blocks(pairs, kernel, super);
+         break;
+      default:
+#        pragma omp parallel num_threads(threads) \
+            reduction(+:sum) default(none) shared(pairs, kernel, super)
+         sum += Leibniz_blocks(pairs, kernel, super);
+   }
+
+   /* With n odd, the last term, 1/(2(n-1)+1), is positive */
+   if (repro) {
+      sum = Tree_sum(super, supers);
+      free(super);
+      if (n % 2 == 1) {
+         Two_sum(sum, 1.0/(2*(n-1)+1), &sum, &lo);
+         sum += lo;
+      }
+   } else if (n % 2 == 1) {
+      sum += 1.0/(2*(n-1)+1);
+   }
+
+   return 4.0*sum;
+}  /* Leibniz */
+
+/*------------------------------------------------------------------
+ * Function:  Leibniz_blocks
+ * Purpose:   Add up the calling thread's share of the blocks of
+ *            PAIR_BLOCK pairs, with the schedule set by
+ *            omp_set_schedule or OMP_SCHEDULE
+ * In args:   pairs:  the total number of pairs
+ *            kernel:  from Select_leibniz_pairs
+ * Out arg:   super:  NULL, or for -d room for the double-double sum
+ *               (hi, lo) of each superblock of SUPER_BLOCKS blocks
+ * Ret val:   The thread's sum, or 0 if super isn't NULL
+ * Note:      Called by every thread in a parallel region.  Block 0 is
+ *            the last one, so with a static schedule each thread adds
+ *            its smallest pairs first.
+ */
+double Leibniz_blocks(long long pairs, Leibniz_pairs_t kernel,
+      double super[]) {
+   long long blocks = (pairs + PAIR_BLOCK - 1)/PAIR_BLOCK;
+   long long supers = (blocks + SUPER_BLOCKS - 1)/SUPER_BLOCKS;
+   long long blk, last, sb;
+   double my_sum = 0.0, hi, lo;
+
+   if (super == NULL) {
+#     pragma omp for schedule(runtime) nowait
+      for (blk = 0; blk < blocks; blk++) {
+         last = pairs - blk*PAIR_BLOCK;
+         my_sum += kernel(last > PAIR_BLOCK ? last - PAIR_BLOCK : 0, last);
+      }
+   } else {
+#     pragma omp for schedule(runtime) nowait
+      for (sb = 0; sb < supers; sb++) {
+         hi = lo = 0.0;
+         for (blk = sb*SUPER_BLOCKS;
+               blk < blocks && blk < (sb + 1)*SUPER_BLOCKS; blk++) {
+            last = pairs - blk*PAIR_BLOCK;
+            Dd_add(&hi, &lo,
+                  kernel(last > PAIR_BLOCK ? last - PAIR_BLOCK : 0, last),
+                  0.0);
+         }
+         super[2*sb] = hi;
+         super[2*sb + 1] = lo;
+      }
+   }
+   return my_sum;
+}  /* Leibniz_blocks */
+
+/*------------------------------------------------------------------
+ * Function:  Two_sum
+ * Purpose:   Find s = fl(a + b) and the rounding error e, so that
+ *            a + b = s + e exactly
+ * In args:   a, b
+ * Out args:  s_p, e_p
+ */
+void Two_sum(double a, double b, double* s_p, double* e_p) {
+   double s = a + b;
+   double bb = s - a;
+
+   *e_p = (a - (s - bb)) + (b - bb);
+   *s_p = s;
+}  /* Two_sum */
+
+/*------------------------------------------------------------------
+ * Function:  Dd_add
+ * Purpose:   Add the double-double hi + lo to the double-double
+ *            *hi_p + *lo_p
+ * In args:   hi, lo
+ * In/out args:  hi_p, lo_p
+ */
+void Dd_add(double* hi_p, double* lo_p, double hi, double lo) {
+   double s, e;
+
+   Two_sum(*hi_p, hi, &s, &e);
+   e += *lo_p + lo;
+   Two_sum(s, e, hi_p, lo_p);
+}  /* Dd_add */
+
+/*------------------------------------------------------------------
+ * Function:  Tree_sum
+ * Purpose:   Add up count double-doubles in a fixed pairwise order:
+ *            1 into 0, 3 into 2, ..., then 2 into 0, 6 into 4, ...
+ * In arg:    count
+ * In/out arg:  super:  (hi, lo) pairs; overwritten
+ * Ret val:   The sum, rounded to a double
+ */
+double Tree_sum(double super[], long long count) {
+   long long stride, i;
+
+   if (count == 0) return 0.0;
+   for (stride = 1; stride < count; stride *= 2)
+      for (i = 0; i + stride < count; i += 2*stride)
+         Dd_add(&super[2*i], &super[2*i + 1], super[2*(i + stride)],
+               super[2*(i + stride) + 1]);
+   return super[0] + super[1];
+}  /* Tree_sum */
+
+/*------------------------------------------------------------------
+ * Function:  Run_benchmark
+ * Purpose:   Time Leibniz for each proc_bind, schedule, chunk size
+ *            and thread count, and print CSV (see note 4)
+ * In args:   n, max_threads, repro, reps, warmups
+ */
+void Run_benchmark(long long n, int max_threads, int repro, int reps,
+      int warmups) {
+   const char* bind_names[] = {"none", "close", "spread"};
+   const char* sched_names[] = {"static", "dynamic", "guided"};
+   omp_sched_t scheds[] = {omp_sched_static, omp_sched_dynamic,
+         omp_sched_guided};
+   int chunks[] = {0, 1, 16, 256};   /* in blocks (superblocks for */
+                                     /* -d), 0 = default           */
+   int bind, s, c, q, r, last;
+   double* times = malloc(reps*sizeof(double));
+   double start, median, base = 0.0;
+   char* places = getenv("OMP_PLACES");
+   char* proc_bind = getenv("OMP_PROC_BIND");
+
+   printf("# OMP_PLACES=%s OMP_PROC_BIND=%s places=%d n=%lld reps=%d%s\n",
+         places != NULL ? places : "(unset)",
+         proc_bind != NULL ? proc_bind : "(unset)",
+         omp_get_num_places(), n, reps, repro ? " reproducible" : "");
+   printf("bind,schedule,chunk_terms,threads,median_s,min_s,"
+         "terms_per_s,efficiency\n");
+
+   for (bind = BIND_NONE; bind <= BIND_SPREAD; bind++)
+      for (s = 0; s < 3; s++)
+         for (c = 0; c < 4; c++) {
+            omp_set_schedule(scheds[s], chunks[c]);
+            for (q = 1, last = 0; !last;
+                  q = (2*q < max_threads) ? 2*q : max_threads) {
+               last = (q == max_threads);
+               for (r = 0; r < warmups + reps; r++) {
+                  start = omp_get_wtime();
+                  Leibniz(n, q, bind, repro);
+                  if (r >= warmups)
+                     times[r - warmups] = omp_get_wtime() - start;
+               }
+               qsort(times, reps, sizeof(double), Compare_double);
+               median = (reps % 2 == 1) ? times[reps/2]
+                     : 0.5*(times[reps/2 - 1] + times[reps/2]);
+               if (q == 1) base = median;
+               printf("%s,%s,%lld,%d,%e,%e,%e,%f\n", bind_names[bind],
+                     sched_names[s], 2LL*PAIR_BLOCK*chunks[c]
+                        *(repro ? SUPER_BLOCKS : 1), q, median,
+                     times[0], n/median, base/(q*median));
+               fflush(stdout);
+            }
+         }
+   free(times);
+}  /* Run_benchmark */
+
+/*------------------------------------------------------------------
+ * Function:  Compare_double
+ * Purpose:   Compare two doubles for qsort
+ */
+int Compare_double(const void* x_p, const void* y_p) {
+   double x = *((const double*) x_p);
+   double y = *((const double*) y_p);
+
+   return (x > y) - (x < y);
+}  /* Compare_double */
+
+/*------------------------------------------------------------------
+ * Function:  Leibniz_pairs_ref
+ * Purpose:   Add up the pairs of terms of the Leibniz series
+ *            1/(4k+1) - 1/(4k+3) = 2/((4k+1)(4k+3)) for
+ *            first <= k < last
+ * Note:      The pairs are added smallest first:  adding 10^8 tiny
+ *            terms to a sum near 1 loses about 9 digits
+ * In args:   first, last
+ * Ret val:   The sum
+ */
+double Leibniz_pairs_ref(long long first, long long last) {
+   long long k;
+   double d, sum = 0.0;
+
+   for (k = last - 1; k >= first; k--) {
+      d = 4.0*k + 1.0;
+      sum += 2.0/(d*(d + 2.0));
+   }
+   return sum;
+}  /* Leibniz_pairs_ref */
+
+#ifdef HAVE_X86_SIMD
+/*------------------------------------------------------------------
+ * Function:  Leibniz_pairs_avx2
+ * Purpose:   AVX2/FMA version of Leibniz_pairs_ref:  4 pairs per
+ *            register, 2 registers per iteration
+ * In args, ret val:  see Leibniz_pairs_ref
+ */
+__attribute__((target("avx2,fma")))
+double Leibniz_pairs_avx2(long long first, long long last) {
+   __m256d d0 = _mm256_add_pd(_mm256_set1_pd(4.0*last - 31.0),
+         _mm256_set_pd(12.0, 8.0, 4.0, 0.0));
+   __m256d d1 = _mm256_add_pd(d0, _mm256_set1_pd(16.0));
+   __m256d step = _mm256_set1_pd(-32.0);
+   __m256d two = _mm256_set1_pd(2.0);
+   __m256d sum0 = _mm256_setzero_pd(), sum1 = _mm256_setzero_pd();
+   __m128d half;
+   long long k;
+
+   for (k = last; k - 8 >= first; k -= 8) {
+      sum0 = _mm256_add_pd(sum0, _mm256_div_pd(two,
+            _mm256_mul_pd(d0, _mm256_add_pd(d0, two))));
+      sum1 = _mm256_add_pd(sum1, _mm256_div_pd(two,
+            _mm256_mul_pd(d1, _mm256_add_pd(d1, two))));
+      d0 = _mm256_add_pd(d0, step);
+      d1 = _mm256_add_pd(d1, step);
+   }
+   sum0 = _mm256_add_pd(sum0, sum1);
+   half = _mm_add_pd(_mm256_castpd256_pd128(sum0),
+         _mm256_extractf128_pd(sum0, 1));
+   half = _mm_add_sd(half, _mm_unpackhi_pd(half, half));
+
+   return _mm_cvtsd_f64(half) + Leibniz_pairs_ref(first, k);
+}  /* Leibniz_pairs_avx2 */
+
+/*------------------------------------------------------------------
+ * Function:  Leibniz_pairs_avx512
+ * Purpose:   AVX-512 version of Leibniz_pairs_ref:  8 pairs per
+ *            register, 2 registers per iteration
+ * In args, ret val:  see Leibniz_pairs_ref
+ */
+__attribute__((target("avx512f")))
+double Leibniz_pairs_avx512(long long first, long long last) {
+   __m512d d0 = _mm512_add_pd(_mm512_set1_pd(4.0*last - 63.0),
+         _mm512_set_pd(28.0, 24.0, 20.0, 16.0, 12.0, 8.0, 4.0, 0.0));
+   __m512d d1 = _mm512_add_pd(d0, _mm512_set1_pd(32.0));
+   __m512d step = _mm512_set1_pd(-64.0);
+   __m512d two = _mm512_set1_pd(2.0);
+   __m512d sum0 = _mm512_setzero_pd(), sum1 = _mm512_setzero_pd();
+   long long k;
+
+   for (k = last; k - 16 >= first; k -= 16) {
+      sum0 = _mm512_add_pd(sum0, _mm512_div_pd(two,
+            _mm512_mul_pd(d0, _mm512_add_pd(d0, two))));
+      sum1 = _mm512_add_pd(sum1, _mm512_div_pd(two,
+            _mm512_mul_pd(d1, _mm512_add_pd(d1, two))));
+      d0 = _mm512_add_pd(d0, step);
+      d1 = _mm512_add_pd(d1, step);
+   }
+
+   return _mm512_reduce_add_pd(_mm512_add_pd(sum0, sum1))
+         + Leibniz_pairs_ref(first, k);
+}  /* Leibniz_pairs_avx512 */
+#endif  /* HAVE_X86_SIMD */
+
+/*------------------------------------------------------------------
+ * Function:  Select_leibniz_pairs
+ * Purpose:   Choose the fastest version of Leibniz_pairs the CPU
+ *            supports
+ * Ret val:   Pointer to it
+ */
+Leibniz_pairs_t Select_leibniz_pairs(void) {
+#  ifdef HAVE_X86_SIMD
+   __builtin_cpu_init();
+   if (__builtin_cpu_supports("avx512f"))
+      return Leibniz_pairs_avx512;
+   if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+      return Leibniz_pairs_avx2;
+#  endif
+   return Leibniz_pairs_ref;
+}  /* Select_leibniz_pairs */
+
+/*------------------------------------------------------------------
+ * Function:  Euler
+ * Purpose:   Estimate pi with the Euler transform of the Leibniz
+ *            series, pi = 2*sum t_k, where t_0 = 1 and
+ *            t_k = t_{k-1}*k/(2k+1)
+ * In arg:    n:  the most terms to use
+ * Out arg:   terms_p:  the number of terms used
+ * Ret val:   The estimate
+ */
+double Euler(long long n, long long* terms_p) {
+   long long k;
+   double term = 1.0, sum = 1.0;
+
+   for (k = 1; k < n; k++) {
+      term = term*k/(2*k + 1);
+      if (term < 0.5*DBL_EPSILON*sum) break;
+      sum += term;
+   }
+   *terms_p = k;
+
+   return 2.0*sum;
+}  /* Euler */
+
+/*------------------------------------------------------------------
+ * Function:  Arctan_inv
+ * Purpose:   Compute arctan(1/x) = sum (-1)^k/((2k+1)x^(2k+1)) for
+ *            x > 1, stopping after n terms or when the terms no
+ *            longer change the sum
+ * In args:   x, n
+ * Out arg:   terms_p:  the number of terms used
+ * Ret val:   arctan(1/x)
+ */
+double Arctan_inv(double x, long long n, long long* terms_p) {
+   long long k;
+   double power = 1.0/x;   /* 1/x^(2k+1) */
+   double sum = power, term;
+
+   for (k = 1; k < n; k++) {
+      power /= x*x;
+      term = power/(2*k + 1);
+      if (term < 0.5*DBL_EPSILON*sum) break;
+      sum += (k % 2 == 0) ? term : -term;
+   }
+   *terms_p = k;
+
+   return sum;
+}  /* Arctan_inv */
+
+/*------------------------------------------------------------------
+ * Function:  Machin
+ * Purpose:   Estimate pi with Machin's formula
+ *            pi = 16*arctan(1/5) - 4*arctan(1/239)
+ * In arg:    n:  the most terms to use in each arctangent
+ * Out arg:   terms_p:  the total number of terms used
+ * Ret val:   The estimate
+ */
+double Machin(long long n, long long* terms_p) {
+   long long terms5, terms239;
+   double pi = 16.0*Arctan_inv(5.0, n, &terms5)
+         - 4.0*Arctan_inv(239.0, n, &terms239);
+
+   *terms_p = terms5 + terms239;
+   return pi;
+}  /* Machin */